@@ -62,14 +62,14 @@ mex('queryOpenCL.cpp',[clode_path,'OpenCLResource.cpp'],...
 
 
 %% CLODE
-mex('clODEmex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'CLODE.cpp'],...
+mex('clODEmex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'NativeResource.cpp'],[clode_path,'CLODE.cpp'],...
     debugchar,verbosechar,compflags,...
     ['-DCLODE_ROOT=\"' clode_path '\"'],...
     ['-I' clode_path], ['-I' opencl_include_dir],...
     ldflags, opencl_lib_dir, libopencl );
 
 %% CLODEfeatures
-mex('clODEfeaturesmex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'CLODE.cpp'],...
+mex('clODEfeaturesmex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'NativeResource.cpp'],[clode_path,'CLODE.cpp'],...
     [clode_path,'CLODEfeatures.cpp'],...
     debugchar,verbosechar,compflags,...
     ['-DCLODE_ROOT=\"' clode_path '\"'],...
@@ -77,7 +77,7 @@ mex('clODEfeaturesmex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'CLODE.
     ldflags, opencl_lib_dir, libopencl );
 
 %% CLODEtrajectory
-mex('clODEtrajectorymex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'CLODE.cpp'],...
+mex('clODEtrajectorymex.cpp',[clode_path,'OpenCLResource.cpp'],[clode_path,'NativeResource.cpp'],[clode_path,'CLODE.cpp'],...
     [clode_path,'CLODEtrajectory.cpp'],...
     debugchar,verbosechar,compflags,...
     ['-DCLODE_ROOT=\"' clode_path '\"'],...
@@ -0,0 +1,150 @@
+/*
+ * benchLowStorage.cpp: compares the low-storage adaptive pairs rk435 and rk549 with dopri5 on a ring of coupled
+ * FitzHugh-Nagumo cells, for N_VAR = 4, 16 and 32. For each stepper it reports the transient kernel's resource use on the
+ * device (work-group size limit and private memory, a proxy for occupancy), the transient time, throughput, and the largest
+ * difference of xf from dopri5. Without an OpenCL device it runs on the native CPU backend, with fewer points and no resource
+ * use (there is no occupancy to measure there).
+ * The RHS file for each size is written to the working directory: "./benchLowStorage --device gpu"
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+
+double maxAbsDiff(const std::vector<double> &a, const std::vector<double> &b)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		d = std::max(d, std::fabs(a[i] - b[i]));
+	return d;
+}
+
+//ring of nVar/2 FitzHugh-Nagumo cells with diffusive coupling p_[0] and slightly different drive per cell
+void writeRingRHS(std::string filename, int nVar)
+{
+	std::ofstream out(filename);
+	out << "void getRHS(const realtype t, const realtype x_[], const realtype p_[], realtype dx_[], realtype aux_[], const realtype w_[]) {\n";
+	int nCell = nVar / 2;
+	for (int i = 0; i < nCell; ++i)
+	{
+		int left = 2 * ((i + nCell - 1) % nCell), right = 2 * ((i + 1) % nCell);
+		out << "dx_[" << 2 * i << "]=x_[" << 2 * i << "]-x_[" << 2 * i << "]*x_[" << 2 * i << "]*x_[" << 2 * i << "]/RCONST(3.0)-x_[" << 2 * i + 1
+			<< "]+RCONST(" << std::to_string(0.5 + 0.02 * i) << ")+p_[0]*(x_[" << left << "]-RCONST(2.0)*x_[" << 2 * i << "]+x_[" << right << "]);\n";
+		out << "dx_[" << 2 * i + 1 << "]=RCONST(0.08)*(x_[" << 2 * i << "]+RCONST(0.7)-RCONST(0.8)*x_[" << 2 * i + 1 << "]);\n";
+	}
+	out << "aux_[0]=x_[0];\n}\n";
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=16384;
+	bool CLSinglePrecision=false;
+	int nReps=3;
+
+	std::vector<std::string> steppers({"dopri5", "rk435", "rk549"});
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=10.0;
+	sp.abstol=1e-8;
+	sp.reltol=1e-6;
+	sp.max_steps=10000000;
+	sp.max_store=10000000;
+	sp.nout=50;
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+		nPts=1024; //host CPU threads: fewer points
+	}
+	NativeResource native;
+	printf("%s\n", opencl ? "OpenCL device" : ("native backend, threads: " + std::to_string(native.getNumThreads())).c_str());
+	std::chrono::duration<double, std::milli> elapsed_ms;
+
+	for (int nVar : {4, 16, 32})
+	{
+		ProblemInfo prob;
+		prob.clRHSfilename="benchLowStorage_ring" + std::to_string(nVar) + ".cl";
+		prob.nVar=nVar;
+		prob.nPar=1;
+		prob.nAux=1;
+		prob.nWiener=0;
+		for (int j=0; j<nVar; ++j)
+			prob.varNames.push_back((j%2 ? "w" : "v") + std::to_string(j/2));
+		prob.parNames.assign({"coupling"});
+		prob.auxNames.assign({"v0"});
+		writeRingRHS(prob.clRHSfilename, nVar);
+
+		//coupling swept over [0, 0.5]; random initial states
+		srand(1);
+		std::vector<double> pars(nPts);
+		for (int i=0; i<nPts; ++i)
+			pars[i]=0.5*i/(nPts-1.0);
+		std::vector<double> x0(nPts*nVar);
+		for (size_t k=0; k<x0.size(); ++k)
+			x0[k]=-2.0+4.0*rand()/(double)RAND_MAX;
+
+		printf("\nN_VAR=%d, nPts=%d\n", nVar, nPts);
+		printf("stepper  wgSize  privateMem(B)  transient(ms)  traj/s      max|dxf|\n");
+
+		std::unique_ptr<CLODE> clo(opencl ? new CLODE(prob, steppers[0], CLSinglePrecision, *opencl) : new CLODE(prob, steppers[0], native));
+		std::vector<double> xfRef;
+		for (std::string stepper : steppers)
+		{
+			clo->setStepper(stepper);
+			clo->buildCL();
+			clo->initialize(tspan, x0, pars, sp);
+			std::string wgSize="-", privateMem="-"; //kernel resource use is only known on a device
+			if (opencl)
+			{
+				KernelResourceInfo info=clo->getTransientKernelInfo();
+				wgSize=std::to_string(info.workGroupSize);
+				privateMem=std::to_string(info.privateMemSize);
+			}
+
+			clo->transient(); //warm-up
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int k=0; k<nReps; ++k)
+				clo->transient();
+			elapsed_ms = std::chrono::high_resolution_clock::now() - start;
+			double tTransient = elapsed_ms.count()/nReps;
+			std::vector<double> xf=clo->getXf();
+
+			if (stepper == steppers[0])
+				xfRef=xf;
+			printf("%-7s  %6s  %13s  %13.1f  %9.3g  %9.3g\n", stepper.c_str(), wgSize.c_str(), privateMem.c_str(),
+				tTransient, nPts/(tTransient*1e-3), maxAbsDiff(xf, xfRef));
+		}
+	}
+	std::cout<<std::endl;
+	delete opencl;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+
+	return 0;
+}
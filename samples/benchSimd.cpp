@@ -0,0 +1,151 @@
+/*
+ * benchSimd.cpp: compares the lane-batched kernels (CLODE::setSimdLanes) with the scalar kernels on the lactotroph sample.
+ * Times transient and features for each lane count, and reports the largest difference from the scalar results.
+ * Mostly of interest on CPU OpenCL devices: "./benchSimd --device cpu". Without an OpenCL device it runs on the native CPU
+ * backend, which compiles the lane-batched kernels over compiler vector types.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+
+double maxAbsDiff(const std::vector<double> &a, const std::vector<double> &b)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		d = std::max(d, std::fabs(a[i] - b[i]));
+	return d;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=16384; //a multiple of every lane count
+	bool CLSinglePrecision=false;
+	int nReps=3;
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	std::vector<std::string> steppers({"rk4", "dopri5"});
+	std::string observer="localmax";
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=1.00;
+	sp.abstol=1e-6;
+	sp.reltol=1e-3;
+	sp.max_steps=10000000;
+	sp.max_store=10000000;
+	sp.nout=50;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=100;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.3;
+	op.xDownThresh=0.2;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+		nPts=2048; //host CPU threads: fewer points, still a multiple of every lane count
+	}
+	NativeResource native;
+
+	//random parameters in a box that contains both oscillating and steady-state points, so lanes finish at different times
+	srand(1);
+	std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+	std::vector<double> pars(3*nPts);
+	for (int j=0; j<3; ++j)
+		for (int i=0; i<nPts; ++i)
+			pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	printf("%s\n", opencl ? "OpenCL device" : ("native backend, threads: " + std::to_string(native.getNumThreads())).c_str());
+
+	std::unique_ptr<CLODEfeatures> clo(opencl ? new CLODEfeatures(prob, "rk4", observer, CLSinglePrecision, *opencl) : new CLODEfeatures(prob, "rk4", observer, native));
+	std::chrono::duration<double, std::milli> elapsed_ms;
+
+	for (std::string stepper : steppers)
+	{
+		printf("\n%s, nPts=%d\n", stepper.c_str(), nPts);
+		printf("lanes  transient(ms)  features(ms)  max|dxf|    max|dF|\n");
+
+		clo->setStepper(stepper);
+		std::vector<double> xfScalar, FScalar;
+		for (cl_int lanes : {1, 2, 4, 8, 16})
+		{
+			clo->setSimdLanes(lanes);
+			clo->buildCL();
+			clo->initialize(tspan, x0, pars, sp, op);
+
+			clo->transient(); //warm-up
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int k=0; k<nReps; ++k)
+				clo->transient();
+			elapsed_ms = std::chrono::high_resolution_clock::now() - start;
+			double tTransient = elapsed_ms.count()/nReps;
+			std::vector<double> xf=clo->getXf();
+
+			clo->features(true);
+			start = std::chrono::high_resolution_clock::now();
+			for (int k=0; k<nReps; ++k)
+				clo->features(true);
+			elapsed_ms = std::chrono::high_resolution_clock::now() - start;
+			double tFeatures = elapsed_ms.count()/nReps;
+			std::vector<double> F=clo->getF();
+
+			if (lanes == 1)
+			{
+				xfScalar=xf;
+				FScalar=F;
+			}
+			printf("%5d  %13.1f  %12.1f  %9.3g  %9.3g\n", lanes, tTransient, tFeatures, maxAbsDiff(xf, xfScalar), maxAbsDiff(F, FScalar));
+		}
+	}
+	std::cout<<std::endl;
+	delete opencl;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+
+	return 0;
+}
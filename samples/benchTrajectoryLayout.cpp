@@ -0,0 +1,138 @@
+/*
+ * benchTrajectoryLayout.cpp: times trajectory() on the lactotroph sample for each output layout
+ * (CLODEtrajectory::setOutputLayout), and reports the write bandwidth of the stored outputs. Also checks that the
+ * per-trajectory getters return the same time series for every layout.
+ * "./benchTrajectoryLayout --device cpu" vs "--device gpu": the fastest layout is usually different. Without an OpenCL device
+ * it runs on the native CPU backend
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEtrajectory.hpp"
+
+double maxAbsDiff(const std::vector<double> &a, const std::vector<double> &b)
+{
+	if (a.size() != b.size())
+		return INFINITY;
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		d = std::max(d, std::fabs(a[i] - b[i]));
+	return d;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=4100; //not a multiple of the tile size, to exercise the padding
+	bool CLSinglePrecision=false;
+	int nReps=3;
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	std::string stepper="rk4";
+	std::vector<double> tspan({0.0,100.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=1.00;
+	sp.abstol=1e-6;
+	sp.reltol=1e-3;
+	sp.max_steps=10000000;
+	sp.max_store=1001;
+	sp.nout=1; //store every step, so the stores are a large part of the run
+
+	srand(1);
+	std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+	std::vector<double> pars(3*nPts);
+	for (int j=0; j<3; ++j)
+		for (int i=0; i<nPts; ++i)
+			pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+	}
+	NativeResource native;
+	printf("%s\n", opencl ? "OpenCL device" : ("native backend, threads: " + std::to_string(native.getNumThreads())).c_str());
+
+	std::unique_ptr<CLODEtrajectory> clo(opencl ? new CLODEtrajectory(prob, stepper, CLSinglePrecision, *opencl) : new CLODEtrajectory(prob, stepper, native));
+	std::chrono::duration<double, std::milli> elapsed_ms;
+
+	const char *names[] = {"time-major", "trajectory-major", "tiled (32)"};
+	std::vector<cl_int> checkIx({0, nPts/2, nPts-1});
+	std::vector<std::vector<double>> xRef;
+
+	printf("\n%s, nPts=%d, max_store=%d\n", stepper.c_str(), nPts, sp.max_store);
+	printf("layout             trajectory(ms)  write(GB/s)  max|dx(i)|\n");
+
+	for (TrajectoryLayout layout : {TrajectoryLayout::TimeMajor, TrajectoryLayout::TrajectoryMajor, TrajectoryLayout::Tiled})
+	{
+		clo->setOutputLayout(layout, 32);
+		clo->buildCL();
+		clo->initialize(tspan, x0, pars, sp);
+
+		clo->trajectory(); //warm-up
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int k=0; k<nReps; ++k)
+			clo->trajectory();
+		elapsed_ms = std::chrono::high_resolution_clock::now() - start;
+		double tTrajectory = elapsed_ms.count()/nReps;
+
+		//bytes written by one run: t, x, dx and aux of every stored point
+		std::vector<cl_int> nStored=clo->getNstored();
+		double nPoints=0;
+		for (cl_int n : nStored)
+			nPoints+=n+1;
+		double bytes=nPoints*(1+2*prob.nVar+prob.nAux)*(CLSinglePrecision ? sizeof(float) : sizeof(double));
+
+		double diff=0;
+		for (size_t k=0; k<checkIx.size(); ++k)
+		{
+			std::vector<double> xi=clo->getX(checkIx[k]);
+			if (layout == TrajectoryLayout::TimeMajor)
+				xRef.push_back(xi);
+			diff=std::max(diff, maxAbsDiff(xi, xRef[k]));
+		}
+
+		printf("%-17s  %14.1f  %11.2f  %10.3g\n", names[(int)layout], tTrajectory, bytes/(tTrajectory*1e6), diff);
+	}
+	std::cout<<std::endl;
+	delete opencl;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * benchWorkPrecision.cpp: work-precision comparison of the adaptive steppers bs23, dopri5 and rkf78 on the lactotroph sample,
+ * in double precision. For each stepper and tolerance it reports the transient time and the largest relative error of xf
+ * against a reference computed by rkf78 at reltol=abstol=1e-13. Without an OpenCL device it runs on the native CPU backend.
+ * "./benchWorkPrecision --device gpu"
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+
+double maxRelDiff(const std::vector<double> &a, const std::vector<double> &ref)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+		d = std::max(d, std::fabs(a[i] - ref[i]) / std::max(std::fabs(ref[i]), 1.0));
+	return d;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=4096;
+	bool CLSinglePrecision=false;
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	std::vector<std::string> steppers({"bs23", "dopri5", "rkf78"});
+	std::vector<double> tolerances({1e-4, 1e-6, 1e-8, 1e-10, 1e-12});
+	double bs23MinTol=1e-10; //bs23 needs millions of steps per trajectory below this
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=10.0;
+	sp.abstol=1e-13;
+	sp.reltol=1e-13;
+	sp.max_steps=100000000;
+	sp.max_store=10000000;
+	sp.nout=50;
+
+	//random parameters in a box that contains both oscillating and steady-state points
+	srand(1);
+	std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+	std::vector<double> pars(3*nPts);
+	for (int j=0; j<3; ++j)
+		for (int i=0; i<nPts; ++i)
+			pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+	}
+	NativeResource native;
+
+	std::unique_ptr<CLODE> clo(opencl ? new CLODE(prob, "rkf78", CLSinglePrecision, *opencl) : new CLODE(prob, "rkf78", native));
+	clo->buildCL();
+	clo->initialize(tspan, x0, pars, sp);
+	clo->transient();
+	std::vector<double> xfRef=clo->getXf();
+
+	std::chrono::duration<double, std::milli> elapsed_ms;
+	printf("\nnPts=%d, tspan=[%g, %g], reference: rkf78 at tol=%g, %s\n", nPts, tspan[0], tspan[1], sp.reltol, opencl ? "OpenCL device" : "native backend");
+	printf("stepper  reltol=abstol  transient(ms)  max rel err\n");
+
+	for (std::string stepper : steppers)
+	{
+		clo->setStepper(stepper);
+		clo->buildCL();
+		clo->initialize(tspan, x0, pars, sp);
+		clo->transient(); //warm-up
+
+		for (double tol : tolerances)
+		{
+			if (stepper == "bs23" && tol < bs23MinTol)
+				continue;
+
+			sp.abstol=tol;
+			sp.reltol=tol;
+			clo->setSolverParams(sp); //also resets dt to sp.dt
+
+			auto start = std::chrono::high_resolution_clock::now();
+			clo->transient();
+			std::vector<double> xf=clo->getXf();
+			elapsed_ms = std::chrono::high_resolution_clock::now() - start;
+
+			printf("%-7s  %13.0e  %13.1f  %11.3g\n", stepper.c_str(), tol, elapsed_ms.count(), maxRelDiff(xf, xfRef));
+		}
+	}
+	std::cout<<std::endl;
+
+	clo.reset();
+	delete opencl;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+
+	return 0;
+}
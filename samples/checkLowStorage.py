@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# Checks of the coefficients of the low-storage pairs rk435 and rk549 (src/steppers/adaptive_rk435.clh, adaptive_rk549.clh),
+# RK4(3)5[2R+]C and RK5(4)9[2R+]S of Kennedy, Carpenter & Lewis (2000), Appl. Numer. Math. 35:177-219. They are 2R schemes,
+# a[i][j] = b[j] for j < i-1, so a pair is given by the subdiagonal a[i+1][i], the weights b and the embedded weights bhat.
+# The #defines are read back from the .clh files (fractions are evaluated to 50 digits) and checked: order condition residuals
+# of the solution and of the embedded solution, c = row sums of A, principal error norm, real stability interval, and the
+# observed convergence orders of the solution and of the error estimate on a small nonlinear test problem.
+#
+# The principal error norm is the 2-norm of the residuals of the order p+1 conditions, sum(b*Phi(t)) - 1/gamma(t), over
+# the rooted trees t of order p+1.
+#
+# usage: python3 checkLowStorage.py
+
+import math
+import os
+import re
+import sys
+from decimal import Decimal, getcontext
+
+getcontext().prec = 50
+
+STEPPER_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "steppers")
+
+# the pairs: stages, order of the solution, .clh file and #define prefix
+PAIRS = {
+    "rk435": dict(stages=5, order=4, file="adaptive_rk435.clh", prefix="RK435"),
+    "rk549": dict(stages=9, order=5, file="adaptive_rk549.clh", prefix="RK549"),
+}
+
+
+# rooted trees, as sorted tuples of their subtrees
+_trees = {}
+
+
+def trees(n):
+    if n in _trees:
+        return _trees[n]
+    if n == 1:
+        _trees[n] = [()]
+        return _trees[n]
+
+    def forests(rem, largest):
+        if rem == 0:
+            yield ()
+            return
+        for size in range(1, rem + 1):
+            for t in trees(size):
+                key = (size, t)
+                if largest is not None and key > largest:
+                    continue
+                for rest in forests(rem - size, key):
+                    yield (t,) + rest
+
+    _trees[n] = sorted(set(tuple(sorted(f)) for f in forests(n - 1, None)))
+    return _trees[n]
+
+
+def tree_order(t):
+    return 1 + sum(tree_order(c) for c in t)
+
+
+def gamma(t):
+    g = tree_order(t)
+    for c in t:
+        g *= gamma(c)
+    return g
+
+
+def phi(t, A, zero, one):
+    """Phi(t) per stage: the product over the subtrees c of A.Phi(c)"""
+    s = len(A)
+    v = [one] * s
+    for c in t:
+        pc = phi(c, A, zero, one)
+        v = [v[i] * sum((A[i][j] * pc[j] for j in range(s)), zero) for i in range(s)]
+    return v
+
+
+def conditions(A, b, orders, zero=0.0, one=1.0):
+    """residuals sum(b*Phi(t)) - 1/gamma(t) for the trees of the given orders"""
+    r = []
+    for n in orders:
+        for t in trees(n):
+            r.append(sum((bi * x for bi, x in zip(b, phi(t, A, zero, one))), zero) - one / gamma(t))
+    return r
+
+
+def tableau(x, s, zero=0.0):
+    """full A and b of the 2R scheme with x = [a21, a32, ..., b1, ..., bs]"""
+    a, b = x[:s - 1], x[s - 1:]
+    A = [[zero] * s for _ in range(s)]
+    for i in range(1, s):
+        for j in range(i - 1):
+            A[i][j] = b[j]
+        A[i][i - 1] = a[i - 1]
+    return A, list(b)
+
+
+def principal_error_norm(A, b, p):
+    return math.sqrt(sum(float(v) ** 2 for v in conditions(A, b, [p + 1], A[0][0] * 0, A[0][0] * 0 + 1)))
+
+
+def real_stability_interval(A, b):
+    """largest x such that |R(-y)| <= 1 for 0 <= y <= x, in steps of 0.01. R(z) = 1 + sum_k b.A^(k-1).1 z^k"""
+    s = len(b)
+    coeffs, v = [1.0], [1.0] * s
+    for _ in range(s):
+        coeffs.append(sum(float(b[i]) * v[i] for i in range(s)))
+        v = [sum(float(A[i][j]) * v[j] for j in range(s)) for i in range(s)]
+    y = 0.0
+    while y < 50:
+        z = -(y + 0.01)
+        if abs(sum(c * z ** k for k, c in enumerate(coeffs))) > 1:
+            return y
+        y += 0.01
+    return y
+
+
+def test_problem(t, y):
+    return [-2 * y[0] + y[1] ** 2 + math.sin(t), y[0] - y[1] - 0.1 * y[1] ** 3 + 0.1 * t]
+
+
+def observed_orders(a, b, c, e):
+    """global error of the solution at t=1, and the largest local error estimate, for N = 10, 20, 40 steps. The 2R stage
+    update is the one of lowstorage_2R.clh"""
+    s = len(b)
+
+    def run(N):
+        t, y, h, est = 0.0, [1.0, 0.5], 1.0 / N, 0.0
+        for _ in range(N):
+            xs, err = y[:], [0.0] * len(y)
+            for i in range(s):
+                k = test_problem(t + c[i] * h, xs)
+                for m in range(len(y)):
+                    y[m] += h * b[i] * k[m]
+                    err[m] += h * e[i] * k[m]
+                if i < s - 1:
+                    xs = [y[m] + h * (a[i] - b[i]) * k[m] for m in range(len(y))]
+            t += h
+            est = max(est, max(abs(v) for v in err))
+        return y, est
+
+    ref, _ = run(4000)
+    errors = []
+    for N in (10, 20, 40):
+        y, est = run(N)
+        errors.append((max(abs(y[m] - ref[m]) for m in range(2)), est))
+    return [(math.log2(errors[k][0] / errors[k + 1][0]), math.log2(errors[k][1] / errors[k + 1][1])) for k in range(2)]
+
+
+def read_pair(name):
+    """a (subdiagonal), b, c and bhat from the #defines of the .clh file: RCONST(x) or RCONST(n)/RCONST(d)"""
+    pair = PAIRS[name]
+    s = pair["stages"]
+    text = open(os.path.join(STEPPER_DIR, pair["file"])).read()
+    values = {}
+    for m in re.finditer(pair["prefix"] + r"_(\w+) RCONST\(([-+0-9.eE]+)\)(?:/RCONST\(([-+0-9.eE]+)\))?", text):
+        values[m.group(1)] = Decimal(m.group(2)) / (Decimal(m.group(3)) if m.group(3) else 1)
+    a = [values["A%d%d" % (i + 1, i)] for i in range(1, s)]
+    b = [values["B%d" % (i + 1)] for i in range(s)]
+    c = [Decimal(0)] + [values["C%d" % (i + 1)] for i in range(1, s)]
+    bhat = [values["BHAT%d" % (i + 1)] for i in range(s)]
+    return a, b, c, bhat
+
+
+def check(name):
+    pair = PAIRS[name]
+    s, p = pair["stages"], pair["order"]
+    a, b, c, bhat = read_pair(name)
+    A, b = tableau(a + b, s, Decimal(0))
+    e = [b[i] - bhat[i] for i in range(s)]
+    zero, one = Decimal(0), Decimal(1)
+
+    order_residual = max(abs(v) for v in conditions(A, b, range(1, p + 1), zero, one))
+    embedded_residual = max(abs(v) for v in conditions(A, bhat, range(1, p), zero, one))
+    c_residual = max(abs(sum(A[i]) - c[i]) for i in range(s))
+    rates = observed_orders([float(v) for v in a], [float(v) for v in b], [float(v) for v in c], [float(v) for v in e])
+
+    ok = order_residual < 1e-15 and embedded_residual < 1e-15 and c_residual < 1e-15
+    print("%s: %d stages, order %d(%d)" % (name, s, p, p - 1))
+    print("  order conditions of b up to order %d: max residual %.1e" % (p, order_residual))
+    print("  order conditions of bhat up to order %d: max residual %.1e" % (p - 1, embedded_residual))
+    print("  c = row sums of A: max residual %.1e" % c_residual)
+    print("  principal error norm %.3g, real stability interval [-%.2f, 0]" % (principal_error_norm(A, b, p), real_stability_interval(A, b)))
+    print("  observed order of the solution %.2f, %.2f; of the error estimate %.2f, %.2f (expected %d and %d)"
+          % (rates[0][0], rates[1][0], rates[0][1], rates[1][1], p, p))
+    return ok
+
+
+if __name__ == "__main__":
+    failed = [name for name in PAIRS if not check(name)]
+    print("all checks passed" if not failed else "FAILED: " + ", ".join(failed))
+    sys.exit(1 if failed else 0)
@@ -17,3 +17,10 @@ dx_[3]=-RCONST(0.010)*(RCONST(0.00150)*ica+RCONST(0.20)*x_[3]);
 aux_[0]=ica;
 }
 
+//gating variables n and f, x'=(xinf-x)/tau, for the Rush-Larsen steppers
+void getGates(const realtype t, const realtype x_[], const realtype p_[], realtype xinf_[], realtype tau_[], const realtype w_[]) {
+xinf_[1]=RCONST(1.0)/(RCONST(1.0)+exp((RCONST(-5.0)-x_[0])/RCONST(10.0)));
+tau_[1]=RCONST(30.0);
+xinf_[2]=RCONST(1.0)/(RCONST(1.0)+exp((RCONST(-20.0)-x_[0])/RCONST(2.0)));
+tau_[2]=RCONST(8.0);
+}
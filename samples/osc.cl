@@ -0,0 +1,8 @@
+
+//harmonic oscillator x''=-w^2 x, with x(0)=1, v(0)=0: x(t)=cos(w t), v(t)=-w sin(w t). aux: the energy, which is conserved
+void getRHS(const realtype t, const realtype x_[], const realtype p_[], realtype dx_[], realtype aux_[], const realtype w_[]) {
+realtype w2=p_[0]*p_[0];
+dx_[0]=x_[1];
+dx_[1]=-w2*x_[0];
+aux_[0]=RCONST(0.5)*(x_[1]*x_[1]+w2*x_[0]*x_[0]);
+}
@@ -0,0 +1,198 @@
+/*
+ * testChunked.cpp: checks that a features run split into chunks (setMaxChunkDuration) gives the features of the same run in
+ * one kernel launch, in double precision on the OpenCL device, or with the native CPU backend when there is no device.
+ * rk4 takes the same steps either way, so its features must match to roundoff, also when sp.max_steps stops the run early:
+ * the step count and the time reached are carried across chunks. dt=0.1 is not exact in binary, so the last step of a
+ * chunk can end past the chunk's edge. dopri5 takes a shortened step at each chunk
+ * boundary, which changes the per-step features (means, sampled extrema), so for dopri5 only the final state is compared,
+ * and the step count feature must stop at sp.max_steps in the chunked run. A run cancelled after its first chunk must report
+ * it, and the next run must give the uncancelled features. Returns nonzero if a check fails.
+ * "./testChunked --device cpu"
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+
+//largest difference relative to max(|ref|, 1). NaN features (e.g. no events) must be NaN in both
+double maxRelDiff(const std::vector<double> &a, const std::vector<double> &ref)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (std::isnan(a[i]) || std::isnan(ref[i]))
+		{
+			if (std::isnan(a[i]) != std::isnan(ref[i]))
+				return INFINITY;
+			continue;
+		}
+		d = std::max(d, std::fabs(a[i] - ref[i]) / std::max(std::fabs(ref[i]), 1.0));
+	}
+	return d;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=256;
+	bool CLSinglePrecision=false; //the native backend is double precision only
+	double chunkDuration=10.0;
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	std::string observer="basicall";
+	std::vector<double> tspan({0.0,200.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.125;
+	sp.dtmax=1.0;
+	sp.abstol=1e-9;
+	sp.reltol=1e-9;
+	sp.max_steps=10000000;
+	sp.max_store=100000;
+	sp.nout=10;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=10000;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.5;
+	op.xDownThresh=0.05;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	//random parameters in a box that contains both oscillating and steady-state points
+	srand(1);
+	std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+	std::vector<double> pars(3*nPts);
+	for (int j=0; j<3; ++j)
+		for (int i=0; i<nPts; ++i)
+			pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+	}
+	NativeResource native;
+
+	std::vector<double> F, xf;
+	std::vector<std::string> featureNames;
+	auto runFeatures=[&](std::string stepper, SolverParams<double> spRun, double maxChunkDuration) {
+		std::unique_ptr<CLODEfeatures> feat(opencl ? new CLODEfeatures(prob, stepper, observer, CLSinglePrecision, *opencl)
+		                                           : new CLODEfeatures(prob, stepper, observer, native));
+		feat->buildCL();
+		feat->initialize(tspan, x0, pars, spRun, op);
+		feat->setMaxChunkDuration(maxChunkDuration);
+		feat->features();
+		F=feat->getF();
+		xf=feat->getXf();
+		featureNames=feat->getFeatureNames();
+	};
+
+	printf("\nnPts=%d, tspan=[%g, %g], chunk duration: %g\n", nPts, tspan[0], tspan[1], chunkDuration);
+
+	int nFailed=0;
+	auto report=[&](std::string name, bool ok, double d) {
+		printf("%-42s max rel diff = %-10.3g %s\n", name.c_str(), d, ok ? "ok" : "FAILED");
+		nFailed+=!ok;
+	};
+
+	//fixed step: identical steps, so all the features must match
+	for (double dt : {0.125, 0.1})
+	{
+		SolverParams<double> spRun=sp;
+		spRun.dt=dt;
+		for (int maxSteps : {sp.max_steps, 500}) //500 steps stop every point in the 6th or 7th chunk
+		{
+			spRun.max_steps=maxSteps;
+			runFeatures("rk4", spRun, 0);
+			std::vector<double> FRef=F, xfRef=xf;
+			runFeatures("rk4", spRun, chunkDuration);
+			double d=std::max(maxRelDiff(F, FRef), maxRelDiff(xf, xfRef));
+			char name[64];
+			snprintf(name, sizeof(name), "rk4 features, dt=%g, max_steps=%d", dt, maxSteps);
+			report(name, !F.empty() && d <= 1e-12, d);
+		}
+	}
+
+	//adaptive step: the final state matches to the tolerance
+	runFeatures("dopri5", sp, 0);
+	std::vector<double> xfRef=xf;
+	runFeatures("dopri5", sp, chunkDuration);
+	double d=maxRelDiff(xf, xfRef);
+	report("dopri5 xf", d <= 1e-5, d);
+
+	//the max_steps budget is for the whole run, not per chunk
+	SolverParams<double> spShort=sp;
+	spShort.max_steps=100;
+	runFeatures("dopri5", spShort, chunkDuration);
+	size_t stepcountIx=std::find(featureNames.begin(), featureNames.end(), "stepcount") - featureNames.begin();
+	int nOver=0;
+	for (int i=0; i<nPts; ++i)
+		nOver+=F[stepcountIx*nPts+i] != spShort.max_steps;
+	printf("%-42s points not at max_steps: %d %s\n", "dopri5 stepcount, max_steps=100", nOver, nOver==0 ? "ok" : "FAILED");
+	nFailed+=nOver>0;
+
+	//cancel after the first chunk: features() returns false, and the next run re-initializes the observer
+	runFeatures("rk4", sp, 0);
+	std::vector<double> FRef=F;
+	{
+		std::unique_ptr<CLODEfeatures> feat(opencl ? new CLODEfeatures(prob, "rk4", observer, CLSinglePrecision, *opencl)
+		                                           : new CLODEfeatures(prob, "rk4", observer, native));
+		feat->buildCL();
+		feat->initialize(tspan, x0, pars, sp, op);
+		feat->setMaxChunkDuration(chunkDuration);
+		CancelToken token=feat->getCancelToken();
+		feat->setProgressCallback([token](double) mutable { token.cancel(); });
+		bool completed=feat->features();
+		printf("%-42s returned %s %s\n", "rk4 cancelled features", completed ? "true" : "false", completed ? "FAILED" : "ok");
+		nFailed+=completed;
+
+		feat->setProgressCallback(nullptr);
+		token.reset();
+		completed=feat->features();
+		d=maxRelDiff(feat->getF(), FRef);
+		report("rk4 features after cancel", completed && d <= 1e-12, d);
+	}
+
+	delete opencl;
+	printf("\n%s\n", nFailed==0 ? "all checks passed" : "some checks FAILED");
+	return nFailed==0 ? 0 : 1;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+}
@@ -0,0 +1,138 @@
+/*
+ * testDriver.cpp: example to get features and the stored trajectory from one integration with CLODEdriver, checked
+ * against separate CLODEfeatures::features() and CLODEtrajectory::trajectory() runs
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "OpenCLResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEdriver.hpp"
+#include "CLODEfeatures.hpp"
+#include "CLODEtrajectory.hpp"
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=1024;
+	bool CLSinglePrecision=true;
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	std::string stepper="rk4";
+	std::string observer="localmax";
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=1.00;
+	sp.abstol=1e-6;
+	sp.reltol=1e-3;
+	sp.max_steps=10000000;
+	sp.max_store=1000;
+	sp.nout=50;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=100;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.3;
+	op.xDownThresh=0.2;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	//gcal swept over [0.5, 2.5]
+	std::vector<double> pars(3*nPts);
+	for (int i=0; i<nPts; ++i)
+	{
+		pars[i]=0.5+2.0*i/(nPts-1.0);
+		pars[nPts+i]=3.0;
+		pars[2*nPts+i]=1.0;
+	}
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	OpenCLResource opencl(argc, argv);
+	std::chrono::duration<double, std::milli> elapsed_ms;
+
+	//fused: one launch for F, the trajectory and xf
+	CLODEdriver driver(prob, stepper, observer, CLSinglePrecision, opencl);
+	driver.buildCL();
+	driver.initialize(tspan, x0, pars, sp, op);
+
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+	driver.odedriver();
+	elapsed_ms = std::chrono::steady_clock::now() - start;
+	std::cout << "odedriver: " << elapsed_ms.count() << "ms\n";
+
+	std::vector<double> F=driver.getF();
+	std::vector<double> xDriver=driver.getX();
+	std::vector<int> nStored=driver.getNstored();
+
+	//reference: the same run integrated twice
+	CLODEfeatures feat(prob, stepper, observer, CLSinglePrecision, opencl);
+	feat.buildCL();
+	feat.initialize(tspan, x0, pars, sp, op);
+
+	CLODEtrajectory traj(prob, stepper, CLSinglePrecision, opencl);
+	traj.buildCL();
+	traj.initialize(tspan, x0, pars, sp);
+
+	start = std::chrono::steady_clock::now();
+	feat.features();
+	traj.trajectory();
+	elapsed_ms = std::chrono::steady_clock::now() - start;
+	std::cout << "features + trajectory: " << elapsed_ms.count() << "ms\n";
+
+	std::vector<double> Fref=feat.getF();
+	std::vector<double> xRef=traj.getX();
+	std::vector<int> nStoredRef=traj.getNstored();
+
+	double maxFdiff=0, maxXdiff=0;
+	for (size_t k=0; k<F.size(); ++k)
+		if (!std::isnan(F[k]) || !std::isnan(Fref[k]))
+			maxFdiff=std::max(maxFdiff, std::fabs(F[k]-Fref[k]));
+
+	int nStoredMismatch=0;
+	for (int i=0; i<nPts; ++i)
+	{
+		nStoredMismatch+=nStored[i]!=nStoredRef[i];
+		for (int k=0; k<=std::min(nStored[i], nStoredRef[i]); ++k)
+			for (int j=0; j<prob.nVar; ++j)
+			{
+				size_t ix=((size_t)k*prob.nVar+j)*nPts+i;
+				maxXdiff=std::max(maxXdiff, std::fabs(xDriver[ix]-xRef[ix]));
+			}
+	}
+
+	std::vector<std::string> fnames=driver.getFeatureNames();
+	std::cout << "\nFeatures of the first point (odedriver / features):\n";
+	for (int j=0; j<driver.getNFeatures(); ++j)
+		std::cout << " " << fnames[j] << " = " << F[j*nPts] << " / " << Fref[j*nPts] << "\n";
+
+	std::cout << "\nmax |F - Fref| = " << maxFdiff << ", max |x - xref| = " << maxXdiff << ", nStored mismatches: " << nStoredMismatch << "\n";
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+
+	return 0;
+}
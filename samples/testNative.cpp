@@ -0,0 +1,388 @@
+/*
+ * testNative.cpp: checks the native CPU backend (NativeResource) against the exact solution of the harmonic oscillator
+ * x''=-w^2 x (osc.cl), x(t)=cos(w t), v(t)=-w sin(w t): transient, a chunked transient with a dt that is not exact in
+ * binary, features and trajectory, with rk4 and dopri5. Then the async runs: the blocking getters and setters called while a
+ * run is pending must wait for it, and a cancelled run must fail its future. With an OpenCL device, the lactotroph runs are
+ * also compared between the device and the native backend in double precision. Returns nonzero if a check fails.
+ * "./testNative --device cpu"
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+#include "CLODEtrajectory.hpp"
+
+//largest difference relative to max(|ref|, 1). NaN features (e.g. no events) must be NaN in both
+double maxRelDiff(const std::vector<double> &a, const std::vector<double> &ref)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (std::isnan(a[i]) || std::isnan(ref[i]))
+		{
+			if (std::isnan(a[i]) != std::isnan(ref[i]))
+				return INFINITY;
+			continue;
+		}
+		d = std::max(d, std::fabs(a[i] - ref[i]) / std::max(std::fabs(ref[i]), 1.0));
+	}
+	return d;
+}
+
+//exact oscillator state at t, [x0..x(nPts-1), v0..v(nPts-1)] as in xf
+std::vector<double> oscExact(const std::vector<double> &w, double t)
+{
+	size_t nPts = w.size();
+	std::vector<double> x(2 * nPts);
+	for (size_t i = 0; i < nPts; ++i)
+	{
+		x[i] = std::cos(w[i] * t);
+		x[nPts + i] = -w[i] * std::sin(w[i] * t);
+	}
+	return x;
+}
+
+//the times a fixed-step run steps to: ti is summed as in the kernels, so the last step can end past tspan[1]
+std::vector<double> fixedStepTimes(const std::vector<double> &tspan, double dt)
+{
+	std::vector<double> t;
+	for (double ti = tspan[0]; ti < tspan[1];)
+	{
+		ti += dt;
+		t.push_back(ti);
+	}
+	return t;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	NativeResource native;
+	int nFailed=0;
+	auto report=[&](std::string name, bool ok, double d) {
+		printf("%-36s max error = %-10.3g %s\n", name.c_str(), d, ok ? "ok" : "FAILED");
+		nFailed+=!ok;
+	};
+
+	//harmonic oscillator, one frequency per point
+	cl_int nPts=64;
+	double tolerance=1e-6; //rk4 at dt=0.01 and dopri5 at tol=1e-10 are accurate to ~1e-8 here
+
+	ProblemInfo osc;
+	osc.clRHSfilename=CLODE_ROOT "../samples/osc.cl";
+	osc.nVar=2;
+	osc.nPar=1;
+	osc.nAux=1;
+	osc.nWiener=0;
+	osc.varNames.assign({"x","v"});
+	osc.parNames.assign({"w"});
+	osc.auxNames.assign({"energy"});
+
+	std::vector<double> tspan({0.0,10.0});
+	std::vector<double> w(nPts), w2(nPts);
+	for (int i=0; i<nPts; ++i)
+	{
+		w[i]=0.5+1.5*i/(nPts-1.0);
+		w2[i]=1.5*w[i];
+	}
+	std::vector<double> x0(2*nPts, 0.0);
+	std::fill(x0.begin(), x0.begin()+nPts, 1.0);
+
+	SolverParams<double> sp;
+	sp.dt=0.01; //not exact in binary
+	sp.dtmax=1.0;
+	sp.abstol=1e-10;
+	sp.reltol=1e-10;
+	sp.max_steps=10000000;
+	sp.max_store=10000;
+	sp.nout=1;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=10000;
+	op.minXamp=0;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.5;
+	op.xDownThresh=0.05;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	printf("\nnative backend, threads: %u\n", native.getNumThreads());
+	printf("\noscillator x''=-w^2 x, nPts=%d, w in [%g, %g], tspan=[%g, %g], tolerance: %g\n", nPts, w[0], w[nPts-1], tspan[0], tspan[1], tolerance);
+
+	std::vector<double> tSteps=fixedStepTimes(tspan, sp.dt);
+	for (std::string stepper : {"rk4", "dopri5"})
+	{
+		bool fixedStep = stepper=="rk4";
+		double tEnd = fixedStep ? tSteps.back() : tspan[1]; //adaptive steps end on tspan[1]
+
+		//transient, in one launch and in chunks that don't hold a whole number of steps exactly
+		CLODE clo(osc, stepper, native);
+		clo.buildCL();
+		clo.initialize(tspan, x0, w, sp);
+		clo.transient();
+		double d=maxRelDiff(clo.getXf(), oscExact(w, tEnd));
+		report(stepper + " transient xf", d<=tolerance, d);
+
+		clo.setMaxChunkDuration(1.0);
+		clo.transient();
+		d=maxRelDiff(clo.getXf(), oscExact(w, tEnd));
+		report(stepper + " chunked transient xf", d<=tolerance, d);
+
+		//features: the extrema and mean of x over the steps. Fixed steps only: adaptive steps sample x at other times
+		if (fixedStep)
+		{
+			CLODEfeatures feat(osc, stepper, "basicall", native);
+			feat.buildCL();
+			feat.initialize(tspan, x0, w, sp, op);
+			feat.setMaxChunkDuration(1.0);
+			feat.features();
+			std::vector<double> F=feat.getF();
+			std::vector<std::string> names=feat.getFeatureNames();
+			size_t maxIx=std::find(names.begin(), names.end(), "max x")-names.begin();
+			size_t minIx=std::find(names.begin(), names.end(), "min x")-names.begin();
+			size_t meanIx=std::find(names.begin(), names.end(), "mean x")-names.begin();
+
+			std::vector<double> FStep, FExact;
+			for (int i=0; i<nPts; ++i)
+			{
+				double xMax=-INFINITY, xMin=INFINITY, xMean=0;
+				for (double t : tSteps)
+				{
+					double x=std::cos(w[i]*t);
+					xMax=std::max(xMax, x);
+					xMin=std::min(xMin, x);
+					xMean+=x/tSteps.size();
+				}
+				FStep.insert(FStep.end(), {F[maxIx*nPts+i], F[minIx*nPts+i], F[meanIx*nPts+i]});
+				FExact.insert(FExact.end(), {xMax, xMin, xMean});
+			}
+			d=maxRelDiff(FStep, FExact);
+			report(stepper + " chunked features max/min/mean x", d<=tolerance, d);
+		}
+
+		//trajectory: every stored point lies on the exact solution
+		CLODEtrajectory traj(osc, stepper, native);
+		traj.buildCL();
+		traj.initialize(tspan, x0, w, sp);
+		traj.setMaxChunkDuration(1.0);
+		traj.trajectory();
+		std::vector<double> t=traj.getT(), x=traj.getX();
+		std::vector<int> nStored=traj.getNstored();
+		d=0;
+		int nShort=0;
+		for (int i=0; i<nPts; ++i)
+		{
+			nShort+=nStored[i] < (fixedStep ? (int)tSteps.size() : 2);
+			for (int k=0; k<nStored[i]; ++k)
+			{
+				double tk=t[(size_t)k*nPts+i];
+				d=std::max(d, std::fabs(x[((size_t)k*osc.nVar+0)*nPts+i]-std::cos(w[i]*tk)));
+				d=std::max(d, std::fabs(x[((size_t)k*osc.nVar+1)*nPts+i]+w[i]*std::sin(w[i]*tk)));
+			}
+		}
+		report(stepper + " chunked trajectory x(t)", nShort==0 && d<=tolerance, d);
+	}
+
+	//async runs. The blocking calls made while a run is pending must wait for it, as on an OpenCL in-order queue
+	printf("\nasync runs, rk4\n");
+	{
+		double tEnd=tSteps.back();
+		CLODE clo(osc, "rk4", native);
+		clo.buildCL();
+		clo.initialize(tspan, x0, w, sp);
+
+		std::future<void> done=clo.transientAsync();
+		double d=maxRelDiff(clo.getXf(), oscExact(w, tEnd)); //without waiting on done
+		report("getXf after transientAsync", d<=tolerance, d);
+		done.get();
+
+		done=clo.transientAsync();
+		clo.setPars(w2); //for the next run only
+		done.get();
+		d=maxRelDiff(clo.getXf(), oscExact(w, tEnd));
+		report("setPars during transientAsync", d<=tolerance, d);
+		clo.transient();
+		d=maxRelDiff(clo.getXf(), oscExact(w2, tEnd));
+		report("transient after setPars", d<=tolerance, d);
+
+		clo.setPars(w);
+		clo.transientAsync();
+		d=maxRelDiff(clo.getXfAsync().get(), oscExact(w, tEnd));
+		report("getXfAsync after transientAsync", d<=tolerance, d);
+
+		//cancelled after the first chunk: the future throws
+		clo.setMaxChunkDuration(1.0);
+		CancelToken token=clo.getCancelToken();
+		clo.setProgressCallback([token](double) mutable { token.cancel(); });
+		bool threw=false;
+		try
+		{
+			clo.transientAsync().get();
+		}
+		catch (std::runtime_error &er)
+		{
+			threw=true;
+		}
+		printf("%-36s %s %s\n", "cancelled transientAsync", threw ? "threw" : "did not throw", threw ? "ok" : "FAILED");
+		nFailed+=!threw;
+		clo.setProgressCallback(nullptr);
+		token.reset();
+
+		//a first features run, as the observer continues from the previous run
+		CLODEfeatures featRef(osc, "rk4", "basicall", native);
+		featRef.buildCL();
+		featRef.initialize(tspan, x0, w, sp, op);
+		featRef.features();
+		CLODEfeatures feat(osc, "rk4", "basicall", native);
+		feat.buildCL();
+		feat.initialize(tspan, x0, w, sp, op);
+		feat.featuresAsync();
+		d=maxRelDiff(feat.getF(), featRef.getF());
+		report("getF after featuresAsync", d<=1e-12, d);
+
+		CLODEtrajectory traj(osc, "rk4", native);
+		traj.buildCL();
+		traj.initialize(tspan, x0, w, sp);
+		traj.trajectoryAsync();
+		std::vector<int> nStored=traj.getNstored();
+		int nShort=0;
+		for (int n : nStored)
+			nShort+=n != (int)tSteps.size();
+		printf("%-36s short trajectories: %d %s\n", "getNstored after trajectoryAsync", nShort, nShort==0 ? "ok" : "FAILED");
+		nFailed+=nShort>0;
+	}
+
+	//the device is optional: without one, the lactotroph comparison is skipped
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "\nNo OpenCL device (" << er.what() << "), skipping the device comparison\n";
+		opencl=nullptr;
+	}
+
+	if (opencl)
+	{
+		nPts=256;
+		bool CLSinglePrecision=false; //the native backend is double precision only
+		tolerance=1e-6; //same algorithm and precision; differences come from FMA contraction and the math libraries
+
+		ProblemInfo prob;
+		prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+		prob.nVar=4;
+		prob.nPar=3;
+		prob.nAux=1;
+		prob.nWiener=0;
+		prob.varNames.assign({"v","n","f","c"});
+		prob.parNames.assign({"gcal","gsk","gbk"});
+		prob.auxNames.assign({"ical"});
+
+		tspan.assign({0.0,200.0});
+		sp.dt=0.05;
+		sp.abstol=1e-9;
+		sp.reltol=1e-9;
+		sp.max_store=100000;
+		sp.nout=10;
+		op.minXamp=1;
+
+		//random parameters in a box that contains both oscillating and steady-state points
+		srand(1);
+		std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+		std::vector<double> pars(3*nPts);
+		for (int j=0; j<3; ++j)
+			for (int i=0; i<nPts; ++i)
+				pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+		x0.assign(nPts*prob.nVar, 0.0);
+		printf("\nlactotroph, device vs native, nPts=%d, tspan=[%g, %g], tolerance: %g\n", nPts, tspan[0], tspan[1], tolerance);
+
+		for (std::string stepper : {"rk4", "dopri5"})
+		{
+			//transient
+			CLODE cloNative(prob, stepper, native);
+			cloNative.buildCL();
+			cloNative.initialize(tspan, x0, pars, sp);
+			cloNative.transient();
+
+			CLODE clo(prob, stepper, CLSinglePrecision, *opencl);
+			clo.buildCL();
+			clo.initialize(tspan, x0, pars, sp);
+			clo.transient();
+			double d=maxRelDiff(cloNative.getXf(), clo.getXf());
+			report(stepper + " transient xf", d<=tolerance, d);
+
+			//features. The observer's initialization and the features have NaN where a point has no events
+			CLODEfeatures featNative(prob, stepper, "basicall", native);
+			featNative.buildCL();
+			featNative.initialize(tspan, x0, pars, sp, op);
+			featNative.features();
+
+			CLODEfeatures feat(prob, stepper, "basicall", CLSinglePrecision, *opencl);
+			feat.buildCL();
+			feat.initialize(tspan, x0, pars, sp, op);
+			feat.features();
+			d=maxRelDiff(featNative.getF(), feat.getF());
+			report(stepper + " features F", d<=tolerance, d);
+
+			//trajectory: the number of stored points must match exactly
+			CLODEtrajectory trajNative(prob, stepper, native);
+			trajNative.buildCL();
+			trajNative.initialize(tspan, x0, pars, sp);
+			trajNative.trajectory();
+			std::vector<double> x=trajNative.getX();
+			std::vector<int> nStored=trajNative.getNstored();
+
+			CLODEtrajectory traj(prob, stepper, CLSinglePrecision, *opencl);
+			traj.buildCL();
+			traj.initialize(tspan, x0, pars, sp);
+			traj.trajectory();
+			std::vector<double> xDevice=traj.getX();
+			std::vector<int> nStoredDevice=traj.getNstored();
+
+			//only the stored part of each trajectory is defined
+			int nStoredMismatch=0;
+			std::vector<double> xStored, xStoredDevice;
+			for (int i=0; i<nPts; ++i)
+			{
+				nStoredMismatch+=nStored[i]!=nStoredDevice[i];
+				for (int k=0; k<std::min(nStored[i], nStoredDevice[i]); ++k)
+					for (int j=0; j<prob.nVar; ++j)
+					{
+						size_t ix=((size_t)k*prob.nVar+j)*nPts+i;
+						xStored.push_back(x[ix]);
+						xStoredDevice.push_back(xDevice[ix]);
+					}
+			}
+			printf("%-36s nStored mismatches: %d %s\n", (stepper + " trajectory").c_str(), nStoredMismatch, nStoredMismatch==0 ? "ok" : "FAILED");
+			nFailed+=nStoredMismatch>0;
+			d=maxRelDiff(xStored, xStoredDevice);
+			report(stepper + " trajectory x", d<=tolerance, d);
+		}
+	}
+
+	delete opencl;
+	printf("\n%s\n", nFailed==0 ? "all checks passed" : "some checks FAILED");
+	return nFailed==0 ? 0 : 1;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+}
@@ -0,0 +1,115 @@
+/*
+ * testPipeline.cpp: example to stream parameter batches through CLODEfeaturesPipeline, reporting throughput
+ * 
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "OpenCLResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+#include "CLODEfeaturesPipeline.hpp"
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try 
+	{
+	cl_int nPts=8192;
+	bool CLSinglePrecision=true;
+	size_t nBatches=20;
+	
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+	
+	std::string stepper="rk4";
+	std::string observer="localmax";
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=1.00;
+	sp.abstol=1e-6;
+	sp.reltol=1e-3;
+	sp.max_steps=10000000;
+	sp.max_store=10000000;
+	sp.nout=50;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=100;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.3;
+	op.xDownThresh=0.2;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	std::vector<double> pars(3*nPts, 1.0);
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	OpenCLResource opencl(argc, argv);
+	
+	CLODEfeaturesPipeline clo(prob, stepper, observer, CLSinglePrecision, opencl);
+	clo.buildCL();
+	clo.initialize(tspan, x0, pars, sp, op); 
+
+	//batch k sweeps gcal over [0.5+k*0.1, 0.6+k*0.1]
+	BatchSource source = [&](size_t k, std::vector<double> &bx0, std::vector<double> &bpars) {
+		for (int i=0; i<nPts; ++i)
+		{
+			bpars[i]=0.5+0.1*(k+i/(nPts-1.0));
+			bpars[nPts+i]=3.0;
+			bpars[2*nPts+i]=1.0;
+		}
+		std::fill(bx0.begin(), bx0.end(), 0.0);
+	};
+
+	std::vector<double> meanIMI(nBatches);
+	BatchSink sink = [&](size_t k, const std::vector<double> &F) {
+		meanIMI[k]=F[2*nPts]; //mean IMI of the first point in the batch
+	};
+
+	for (int nSets=2; nSets<=3; ++nSets)
+	{
+		clo.setNumBufferSets(nSets);
+		std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+		clo.runBatches(nBatches, source, sink);
+		std::chrono::duration<double, std::milli> elapsed_ms = std::chrono::steady_clock::now() - start;
+
+		std::cout << nSets << " buffer sets: " << nBatches << " batches of " << nPts << " in " << elapsed_ms.count() << "ms, steady state " << clo.getThroughput() << " trajectories/s\n";
+	}
+
+	//unpipelined reference: blocking upload, features, download per batch
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+	for (size_t k=0; k<nBatches; ++k)
+	{
+		source(k, x0, pars);
+		clo.setProblemData(x0, pars);
+		clo.transient();
+		clo.shiftX0();
+		clo.features(true);
+		sink(k, clo.getF());
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "blocking loop: " << nBatches*nPts/elapsed.count() << " trajectories/s\n";
+	
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+    
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * testSharded.cpp: example to run CLODEfeatures split across all devices of an OpenCL context
+ * 
+ * Try with a platform exposing several devices (e.g. pocl with multiple CPU devices, or several GPUs):
+ *   ./testShard --device cpu
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "OpenCLResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+#include "CLODEsharded.hpp"
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try 
+	{
+	cl_int nPts=4096;
+	bool CLSinglePrecision=true;
+	int nBatches=5;
+	
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+	
+	std::string stepper="rk4";
+	std::string observer="localmax";
+	std::vector<double> tspan({0.0,1000.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.1;
+	sp.dtmax=1.00;
+	sp.abstol=1e-6;
+	sp.reltol=1e-3;
+	sp.max_steps=10000000;
+	sp.max_store=10000000;
+	sp.nout=50;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=100;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.3;
+	op.xDownThresh=0.2;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	//gcal sweep, other parameters fixed
+	std::vector<double> pars(3*nPts);
+	for (int i=0; i<nPts; ++i)
+	{
+		pars[i]=0.5+1.5*i/(nPts-1.0);
+		pars[nPts+i]=3.0;
+		pars[2*nPts+i]=1.0;
+	}
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	OpenCLResource opencl(argc, argv);
+	
+	CLODEsharded<CLODEfeatures> clo(opencl, [&](OpenCLResource device) { 
+		return new CLODEfeatures(prob, stepper, observer, CLSinglePrecision, device); 
+	});
+	std::cout << "Using " << clo.getNumShards() << " device(s)\n";
+
+	clo.buildCL();
+	clo.initialize(tspan, x0, pars, sp, op); 
+
+	//each batch re-splits nPts using the throughput measured on the previous one
+	for (int batch=0; batch<nBatches; ++batch)
+	{
+		std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+		clo.setProblemData(x0, pars);
+		clo.transient();
+		clo.features();
+		std::vector<double> F=clo.getF();
+		std::chrono::duration<double, std::milli> elapsed_ms = std::chrono::steady_clock::now() - start;
+
+		std::vector<cl_int> split=clo.getShardNpts();
+		std::cout << "batch " << batch << ": " << elapsed_ms.count() << "ms, split:";
+		for (size_t d=0; d<split.size(); ++d)
+			std::cout << " " << split[d];
+		std::cout << "\n";
+	}
+	
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+    
+	return 0;
+}
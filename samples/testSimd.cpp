@@ -0,0 +1,182 @@
+/*
+ * testSimd.cpp: checks the lane-batched kernels (CLODE::setSimdLanes) against the scalar kernels on the lactotroph sample, for
+ * every stepper they support and 2, 4, 8 and 16 lanes: transient xf, features (localmax) F, and trajectory nStored, t and x.
+ * Each lane takes the same steps as the scalar kernel, so results must agree to roundoff. Runs in double precision on the
+ * OpenCL device, or with the native CPU backend when there is no device. Returns nonzero if a check fails.
+ * "./testSimd --device cpu"
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "OpenCLResource.hpp"
+#include "NativeResource.hpp"
+#include "CLODE.hpp"
+#include "CLODEfeatures.hpp"
+#include "CLODEtrajectory.hpp"
+
+//largest difference relative to max(|ref|, 1). NaN features (e.g. no events) must be NaN in both
+double maxRelDiff(const std::vector<double> &a, const std::vector<double> &ref)
+{
+	double d = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (std::isnan(a[i]) || std::isnan(ref[i]))
+		{
+			if (std::isnan(a[i]) != std::isnan(ref[i]))
+				return INFINITY;
+			continue;
+		}
+		d = std::max(d, std::fabs(a[i] - ref[i]) / std::max(std::fabs(ref[i]), 1.0));
+	}
+	return d;
+}
+
+//currently the only command line arguments are to select device/vendor type ("--device cpu/gpu/accel", "--vendor amd/intel/nvidia")
+int main(int argc, char **argv)
+{
+	try
+	{
+	cl_int nPts=256; //a multiple of every lane count
+	bool CLSinglePrecision=false; //the native backend is double precision only
+	double tolerance=1e-12; //same operations per lane: only contraction and vector math libraries can differ
+
+	ProblemInfo prob;
+	prob.clRHSfilename=CLODE_ROOT "../samples/lactotroph.cl";
+	prob.nVar=4;
+	prob.nPar=3;
+	prob.nAux=1;
+	prob.nWiener=0;
+	prob.varNames.assign({"v","n","f","c"});
+	prob.parNames.assign({"gcal","gsk","gbk"});
+	prob.auxNames.assign({"ical"});
+
+	//the steppers of the lane-batched kernels: explicit one-step methods (clODE_simd.cl)
+	std::vector<std::string> steppers({"euler", "heun", "rk4", "bs23", "dopri5", "rkf78", "rk435", "rk549"});
+	std::vector<double> tspan({0.0,200.0});
+
+	SolverParams<double> sp;
+	sp.dt=0.05;
+	sp.dtmax=1.0;
+	sp.abstol=1e-8;
+	sp.reltol=1e-6;
+	sp.max_steps=10000000;
+	sp.max_store=20000;
+	sp.nout=1;
+
+	ObserverParams<double> op;
+	op.eVarIx=0;
+	op.fVarIx=0;
+	op.maxEventCount=100;
+	op.minXamp=1;
+	op.nHoodRadius=0.01;
+	op.xUpThresh=0.3;
+	op.xDownThresh=0.2;
+	op.dxUpThresh=0;
+	op.dxDownThresh=0;
+	op.eps_dx=1e-7;
+
+	//random parameters in a box that contains both oscillating and steady-state points, so lanes finish at different times
+	srand(1);
+	std::vector<double> lb({0.5,0.5,0.0}), ub({2.5,4.0,2.0});
+	std::vector<double> pars(3*nPts);
+	for (int j=0; j<3; ++j)
+		for (int i=0; i<nPts; ++i)
+			pars[j*nPts+i]=lb[j]+(ub[j]-lb[j])*rand()/(double)RAND_MAX;
+
+	std::vector<double> x0(nPts*prob.nVar, 0.0);
+
+	//use the device if there is one, otherwise the native backend
+	OpenCLResource *opencl=nullptr;
+	try
+	{
+		opencl=new OpenCLResource(argc, argv);
+	}
+	catch (std::exception &er)
+	{
+		std::cout << "No OpenCL device (" << er.what() << "), using the native backend\n";
+		opencl=nullptr;
+	}
+	NativeResource native;
+
+	std::unique_ptr<CLODEfeatures> feat(opencl ? new CLODEfeatures(prob, "rk4", "localmax", CLSinglePrecision, *opencl) : new CLODEfeatures(prob, "rk4", "localmax", native));
+	std::unique_ptr<CLODEtrajectory> traj(opencl ? new CLODEtrajectory(prob, "rk4", CLSinglePrecision, *opencl) : new CLODEtrajectory(prob, "rk4", native));
+
+	printf("\nnPts=%d, tspan=[%g, %g], %s, tolerance: %g\n", nPts, tspan[0], tspan[1], opencl ? "OpenCL device" : "native backend", tolerance);
+	printf("stepper  lanes  max rel diff: xf         F          trajectory x  nStored mismatches\n");
+
+	int nFailed=0;
+	for (std::string stepper : steppers)
+	{
+		feat->setStepper(stepper);
+		traj->setStepper(stepper);
+		std::vector<double> xfScalar, FScalar, tScalar, xScalar;
+		std::vector<int> nStoredScalar;
+		for (cl_int lanes : {1, 2, 4, 8, 16})
+		{
+			feat->setSimdLanes(lanes);
+			feat->buildCL();
+			feat->initialize(tspan, x0, pars, sp, op);
+			feat->transient();
+			std::vector<double> xf=feat->getXf();
+			feat->setX0(x0);
+			feat->features(true);
+			std::vector<double> F=feat->getF();
+
+			traj->setSimdLanes(lanes);
+			traj->buildCL();
+			traj->initialize(tspan, x0, pars, sp);
+			traj->trajectory();
+			std::vector<double> t=traj->getT(), x=traj->getX();
+			std::vector<int> nStored=traj->getNstored();
+
+			if (lanes == 1)
+			{
+				xfScalar=xf;
+				FScalar=F;
+				tScalar=t;
+				xScalar=x;
+				nStoredScalar=nStored;
+				continue;
+			}
+
+			//only the stored part of each trajectory is defined
+			int nStoredMismatch=0;
+			std::vector<double> stored, storedScalar;
+			for (int i=0; i<nPts; ++i)
+			{
+				nStoredMismatch+=nStored[i]!=nStoredScalar[i];
+				for (int k=0; k<std::min(nStored[i], nStoredScalar[i]); ++k)
+				{
+					stored.push_back(t[(size_t)k*nPts+i]);
+					storedScalar.push_back(tScalar[(size_t)k*nPts+i]);
+					for (int j=0; j<prob.nVar; ++j)
+					{
+						stored.push_back(x[((size_t)k*prob.nVar+j)*nPts+i]);
+						storedScalar.push_back(xScalar[((size_t)k*prob.nVar+j)*nPts+i]);
+					}
+				}
+			}
+
+			double dxf=maxRelDiff(xf, xfScalar), dF=maxRelDiff(F, FScalar), dx=maxRelDiff(stored, storedScalar);
+			bool ok=dxf<=tolerance && dF<=tolerance && dx<=tolerance && nStoredMismatch==0;
+			printf("%-7s  %5d  %16.3g  %9.3g  %12.3g  %18d  %s\n", stepper.c_str(), lanes, dxf, dF, dx, nStoredMismatch, ok ? "ok" : "FAILED");
+			nFailed+=!ok;
+		}
+	}
+
+	delete opencl;
+	printf("\n%s\n", nFailed==0 ? "all checks passed" : "some checks FAILED");
+	return nFailed==0 ? 0 : 1;
+
+	} catch (std::exception &er) {
+        std::cout<< "ERROR: " << er.what() << std::endl;
+        std::cout<<"exiting...\n";
+		return -1;
+	}
+}
@@ -3,6 +3,10 @@
 #include "OpenCLResource.hpp"
 #include "steppers.cl"
 
+#ifdef CLODE_EMBED_SOURCES
+#include "clODE_embedded_sources.hpp"
+#endif
+
 // #define __CL_ENABLE_EXCEPTIONS
 // #if defined(__APPLE__) || defined(__MACOSX)
 //     #include "OpenCL/cl.hpp"
@@ -19,7 +23,10 @@
 
 #include <algorithm> //std::max
 #include <cmath>
+#include <exception>
+#include <limits>
 #include <random>
+#include <thread>
 #include <stdexcept>
 #include <stdio.h>
 
@@ -38,7 +45,7 @@ CLODE::CLODE(ProblemInfo prob, std::string stepper, bool clSinglePrecision, Open
 	setPrecision(clSinglePrecision);
 	setOpenCL(opencl);
 
-	clprogramstring = read_file(clodeRoot + "transient.cl");
+	clprogramstring = getKernelSource("transient.cl");
 	dbg_printf("constructor clODE\n");
 }
 
@@ -50,16 +57,44 @@ CLODE::CLODE(ProblemInfo prob, std::string stepper, bool clSinglePrecision, unsi
 	setPrecision(clSinglePrecision);
 	setOpenCL(platformID, deviceID);
 
-	clprogramstring = read_file(clodeRoot + "transient.cl");
+	clprogramstring = getKernelSource("transient.cl");
 	dbg_printf("constructor clODE\n");
 }
 
+CLODE::CLODE(ProblemInfo prob, std::string stepper, NativeResource native)
+	: opencl(OpenCLResource::empty())
+{
+	getStepperDefineMap(stepperDefineMap, availableSteppers); //from steppers.cl
+	setNewProblem(prob);
+	setStepper(stepper);
+	setNative(native);
+
+	clprogramstring = getKernelSource("transient.cl");
+	dbg_printf("constructor clODE (native)\n");
+}
+
 CLODE::~CLODE()
 {
+	if (nativePending.valid())
+		nativePending.wait();
+}
+
+//kernel sources are compiled in with CLODE_EMBED_SOURCES, otherwise they are read from the clODE root directory
+std::string CLODE::getKernelSource(std::string filename)
+{
+#ifdef CLODE_EMBED_SOURCES
+	auto loc = clodeEmbeddedSources.find(filename);
+	if (loc == clodeEmbeddedSources.end())
+		throw std::invalid_argument("kernel source not embedded: " + filename);
+	return loc->second;
+#else
+	return read_file(clodeRoot + filename);
+#endif
 }
 
 void CLODE::setNewProblem(ProblemInfo newProb)
 { //TODO: not equality check for ProblemInfo struct, error checking: at least one variable!
+	waitNative();
 	prob=newProb;
 	clRHSfilename = newProb.clRHSfilename;
 	ODEsystemsource = read_file(clRHSfilename);
@@ -67,6 +102,7 @@ void CLODE::setNewProblem(ProblemInfo newProb)
 	nPar = newProb.nPar>0?newProb.nPar:1; //support zero params
 	nAux = newProb.nAux>0?newProb.nAux:1; //support zero aux
 	nWiener = newProb.nWiener>0?newProb.nWiener:1; //support zero wiener
+	clearUniformPars();
 
 	clInitialized = false;
 	dbg_printf("set new problem\n");
@@ -74,6 +110,7 @@ void CLODE::setNewProblem(ProblemInfo newProb)
 
 void CLODE::setStepper(std::string newStepper)
 {
+	waitNative();
 	// if (newStepper!=stepper)
 	// {
 	auto loc = stepperDefineMap.find(newStepper); //from steppers.cl
@@ -92,8 +129,14 @@ void CLODE::setStepper(std::string newStepper)
 
 void CLODE::setPrecision(bool newPrecision)
 {
+	waitNative();
 	// if (newPrecision != clSinglePrecision)
 	// {
+	if (useNative && newPrecision)
+	{
+		printf("Warning: the native backend runs in double precision\n");
+		newPrecision = false;
+	}
 	clSinglePrecision = newPrecision;
 	realSize = newPrecision ? sizeof(cl_float) : sizeof(cl_double);
 	clInitialized = false;
@@ -103,8 +146,10 @@ void CLODE::setPrecision(bool newPrecision)
 
 void CLODE::setOpenCL(OpenCLResource newOpencl)
 {//TODO: not equality check for OpenCLResource class
+	waitNative();
 	//~ if (newOpencl!=opencl) {
 	opencl = newOpencl;
+	useNative = false;
 	clInitialized = false;
 	//~ }
 	dbg_printf("set OpenCL\n");
@@ -112,18 +157,30 @@ void CLODE::setOpenCL(OpenCLResource newOpencl)
 
 void CLODE::setOpenCL(unsigned int platformID, unsigned int deviceID)
 {//TODO: not equality check for OpenCLResource class
+	waitNative();
 	//~ if (newOpencl!=opencl) {
 	opencl = OpenCLResource(platformID, deviceID);
+	useNative = false;
 	clInitialized = false;
 	//~ }
 	dbg_printf("set OpenCL\n");
 }
 
+void CLODE::setNative(NativeResource newNative)
+{
+	waitNative();
+	native = newNative;
+	useNative = true;
+	setPrecision(false);
+	clInitialized = false;
+	dbg_printf("set native\n");
+}
+
 
 void CLODE::setCLbuildOpts(std::string extraBuildOpts)
 {
 	
-	if (!clSinglePrecision && !opencl.getDoubleSupport())
+	if (!useNative && !clSinglePrecision && !opencl.getDoubleSupport())
 	{ //TODO: make this an error?
 		clSinglePrecision = true;
 		printf("Warning: device selected does not support double precision. Using single precision\n");
@@ -148,9 +205,29 @@ void CLODE::setCLbuildOpts(std::string extraBuildOpts)
 	buildOptions += " -DN_VAR=" + std::to_string((long long)nVar);
 	buildOptions += " -DN_AUX=" + std::to_string((long long)nAux);
 	buildOptions += " -DN_WIENER=" + std::to_string((long long)nWiener);
+	buildOptions += getUniformParsDefine();
+	buildOptions += getParameterGridDefine();
+
+	//analytic Jacobian for the Rosenbrock steppers, if the RHS file has one (steppers/rosenbrock_common.clh)
+	if (ODEsystemsource.find("void getJacobian") != std::string::npos)
+		buildOptions += " -DUSER_JACOBIAN";
+
+	//gating variables for the Rush-Larsen steppers (steppers/rush_larsen_common.clh)
+	if (ODEsystemsource.find("void getGates") != std::string::npos)
+		buildOptions += " -DUSER_GATES";
 
-	//include folder for CLODE
+	//parameter array address space
+	parsInGlobal = parsMemory == ParsMemory::Global || (parsMemory == ParsMemory::Automatic && gridAxes.empty());
+	if (parsInGlobal)
+		buildOptions += " -DPARS_GLOBAL";
+
+	if (simdLanes > 1)
+		buildOptions += " -DCLODE_SIMD_LANES=" + std::to_string((long long)simdLanes);
+
+	//include folder for CLODE. Embedded sources have their includes expanded already
+#ifndef CLODE_EMBED_SOURCES
 	buildOptions += " -I" + clodeRoot;
+#endif
 
 	buildOptions += extraBuildOpts;
 }
@@ -159,6 +236,7 @@ void CLODE::setCLbuildOpts(std::string extraBuildOpts)
 //build creates build option defined constants based on selected options, adds the ODEsystem source to clprogramstring then builds for selected OpenCL resource
 void CLODE::buildProgram(std::string extraBuildOpts)
 {
+	waitNative();
 	setCLbuildOpts(extraBuildOpts);
 
 	//ODEsystem source is delayed to here, in case we change it
@@ -170,7 +248,12 @@ void CLODE::buildProgram(std::string extraBuildOpts)
 	// printf("%s", buildOptions.c_str());
 
 	//now build
-	opencl.buildProgramFromString(clprogramstring + ODEsystemsource, buildOptions);
+	if (useNative)
+	{
+		native.buildProgramFromString(getKernelSource("clODE_native_shim.h") + getProgramSource() + ODEsystemsource, buildOptions);
+	}
+	else
+		opencl.buildProgramFromString(getProgramSource() + ODEsystemsource, buildOptions);
 
 	// printStatus();
 	dbg_printf("build clODE\n");
@@ -179,7 +262,11 @@ void CLODE::buildProgram(std::string extraBuildOpts)
 // build program and create kernel objects. requires host variables to be set
 void CLODE::buildCL()
 {
+	waitNative();
 	buildProgram();
+	clInitialized = false;
+	if (useNative)
+		return;
 
 	//set up the kernel
 	try
@@ -204,6 +291,7 @@ void CLODE::buildCL()
 //initialize everything: build the program, create the kernels, and set all needed problem data.
 void CLODE::initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp)
 {
+	waitNative();
 	clInitialized = false;
 
 	setTspan(newTspan);
@@ -217,6 +305,7 @@ void CLODE::initialize(std::vector<cl_double> newTspan, std::vector<cl_double> n
 //initialize new set of trajectories (nPts may change)
 void CLODE::setProblemData(std::vector<cl_double> newX0, std::vector<cl_double> newPars)
 {	//check if newX0 and newPars are valid, and update nPts if needed:
+	waitNative();
 	if (newX0.size() % nVar != 0)
 	{
 		printf("Invalid initial condition vector: not a multiple of nVar=%d\n", nVar);
@@ -231,9 +320,12 @@ void CLODE::setProblemData(std::vector<cl_double> newX0, std::vector<cl_double>
 		return;
 	}
 
+	if (!gridAxes.empty() && !newPars.empty())
+		printf("Warning: parameter vector ignored in grid-sweep mode\n");
+
 	// now check if newX0 and newPars represent same number of sets
 	cl_int nPtsX0 = newX0.size() / nVar;
-	cl_int nPtsPars = newPars.size() / nPar;
+	cl_int nPtsPars = gridAxes.empty() ? newPars.size() / nPar : getGridNpts();
 	// printf("Computed nPts: %d %d\n", nPtsX0, nPtsPars);
 	if (nPtsX0 != nPtsPars)
 	{
@@ -255,20 +347,34 @@ void CLODE::setProblemData(std::vector<cl_double> newX0, std::vector<cl_double>
 //resize all the nPts dependent variables, only if nPts changed
 void CLODE::setNpts(cl_int newNpts)
 {	//unlikely that any of these should ever exceed memory limits...
-	size_t largestAlloc = std::max(nVar, std::max(nPar, nAux)) * nPts * realSize;
+	waitNative();
+	size_t largestAlloc = std::max(nVar, std::max(gridAxes.empty() ? nPar : 1, nAux)) * (size_t)newNpts * realSize;
 	// printf("Computed largestAlloc: %d\n", largestAlloc);
 
-	if (largestAlloc > opencl.getMaxMemAllocSize())
+	if (!useNative && largestAlloc > opencl.getMaxMemAllocSize())
 	{
 		throw std::invalid_argument("nPts*nVar, nPts*nPar, or nPts*nAux is too large");
 	}
 
+	if (newNpts % simdLanes != 0)
+	{
+		printf("nPts=%d is not a multiple of the number of SIMD lanes (%d)\n", newNpts, simdLanes);
+		throw std::invalid_argument("nPts must be a multiple of the number of SIMD lanes");
+	}
+
 	if (!clInitialized || newNpts != nPts)
 	{
 		nPts = newNpts;
 
 		x0elements = nVar * nPts;
-		parselements = nPar * nPts;
+		parselements = gridAxes.empty() ? nPar * nPts : 0;
+		devParselements = gridAxes.empty() ? std::max(varyingParIx.size(), (size_t)1) * nPts : nPar + 3 * gridAxes.size();
+
+		if (!useNative && !parsInGlobal && realSize * devParselements > opencl.getMaxConstantBufferSize())
+		{
+			printf("Parameter array (%lu bytes) exceeds CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE (%lu bytes)\n", (unsigned long)(realSize * devParselements), (unsigned long)opencl.getMaxConstantBufferSize());
+			throw std::invalid_argument("Parameter array too large for __constant memory: use setParsMemory(ParsMemory::Global) or Automatic");
+		}
 		RNGelements = nRNGstate * nPts;
 
 		//resize host variables
@@ -277,15 +383,22 @@ void CLODE::setNpts(cl_int newNpts)
 		xf.resize(x0elements);
 		RNGstate.resize(RNGelements);
 		dt.resize(nPts);
+		stepCount.resize(nPts);
+		tNow.resize(nPts);
 
 		//new device variables
 		try
 		{
-			d_x0 = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * x0elements, NULL, &opencl.error);
-			d_pars = cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY, realSize * parselements, NULL, &opencl.error);
-			d_xf = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * x0elements, NULL, &opencl.error);
-			d_RNGstate = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, sizeof(cl_ulong) * RNGelements, NULL, &opencl.error);
-			d_dt = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * nPts, NULL, &opencl.error);
+			if (!useNative)
+			{
+				d_x0 = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * x0elements, NULL, &opencl.error);
+				d_pars = cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY, realSize * devParselements, NULL, &opencl.error);
+				d_xf = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * x0elements, NULL, &opencl.error);
+				d_RNGstate = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, sizeof(cl_ulong) * RNGelements, NULL, &opencl.error);
+				d_dt = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * nPts, NULL, &opencl.error);
+				d_stepCount = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, sizeof(cl_int) * nPts, NULL, &opencl.error);
+				d_tNow = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, realSize * nPts, NULL, &opencl.error);
+			}
 		}
 		catch (cl::Error &er)
 		{
@@ -301,6 +414,13 @@ void CLODE::setNpts(cl_int newNpts)
 
 void CLODE::setTspan(std::vector<cl_double> newTspan)
 {
+	waitNative();
+	if (useNative)
+	{
+		tspan = newTspan;
+		return;
+	}
+
 	try
 	{
 		if (!clInitialized)
@@ -328,6 +448,7 @@ void CLODE::setTspan(std::vector<cl_double> newTspan)
 
 void CLODE::shiftTspan()
 {
+	waitNative();
 	std::vector<cl_double> newTspan({tspan[1], tspan[1] + (tspan[1] - tspan[0])});
 	setTspan(newTspan);
 	dbg_printf("shift tspan\n");
@@ -336,9 +457,12 @@ void CLODE::shiftTspan()
 //set new x0. Cannot update nPts
 void CLODE::setX0(std::vector<cl_double> newX0)
 {
+	waitNative();
 	if (newX0.size() == (size_t)nPts * nVar)
 	{
 		x0 = newX0;
+		if (useNative)
+			return;
 
 		//sync to device
 		try
@@ -370,6 +494,13 @@ void CLODE::setX0(std::vector<cl_double> newX0)
 
 void CLODE::shiftX0()
 {
+	waitNative();
+	if (useNative)
+	{
+		x0 = xf;
+		return;
+	}
+
 	//device to device transfer of Xf to X0
 	try
 	{
@@ -386,21 +517,48 @@ void CLODE::shiftX0()
 //set new Pars. Cannot update nPts
 void CLODE::setPars(std::vector<cl_double> newPars)
 {
-	if (newPars.size() == (size_t)nPts * nPar)
+	waitNative();
+	if (!gridAxes.empty())
 	{
+		if (!newPars.empty())
+			printf("Warning: parameter vector ignored in grid-sweep mode\n");
+		uploadParameterGrid();
+	}
+	else if (newPars.size() == (size_t)nPts * nPar)
+	{
+		for (size_t k = 0; k < uniformParIx.size(); ++k)
+		{
+			for (cl_int i = 0; i < nPts; ++i)
+			{
+				if (newPars[uniformParIx[k] * nPts + i] != uniformParValues[k])
+				{
+					printf("Parameter %d is compiled in as uniform (%g), but point %d has %g\n", uniformParIx[k], uniformParValues[k], i, newPars[uniformParIx[k] * nPts + i]);
+					throw std::invalid_argument("Parameter vector does not match the compiled-in uniform parameters");
+				}
+			}
+		}
+
 		pars = newPars;
 
-		//sync to device
+		//sync to device. Only the varying columns are needed
 		try
 		{
-			if (clSinglePrecision)
-			{ //downcast to float if desired
-				std::vector<cl_float> parsF(pars.begin(), pars.end());
-				opencl.error = copy(opencl.getQueue(), parsF.begin(), parsF.end(), d_pars);
-			}
+			if (uniformParIx.empty())
+				devPars = pars;
 			else
+				packPars(pars, devPars);
+
+			if (!useNative && !devPars.empty())
 			{
-				opencl.error = copy(opencl.getQueue(), pars.begin(), pars.end(), d_pars);
+				if (clSinglePrecision)
+				{ //downcast to float if desired
+					std::vector<cl_float> parsF(devPars.begin(), devPars.end());
+					opencl.error = copy(opencl.getQueue(), parsF.begin(), parsF.end(), d_pars);
+				}
+				else
+				{
+					opencl.error = copy(opencl.getQueue(), devPars.begin(), devPars.end(), d_pars);
+				}
 			}
 		}
 		catch (cl::Error &er)
@@ -418,8 +576,266 @@ void CLODE::setPars(std::vector<cl_double> newPars)
 	}
 }
 
+void CLODE::setUniformPars(std::vector<cl_int> parIx, std::vector<cl_double> values)
+{
+	waitNative();
+	if (parIx.size() != values.size())
+		throw std::invalid_argument("setUniformPars: parIx and values must have the same length");
+
+	std::vector<bool> isUniform(nPar, false);
+	for (size_t k = 0; k < parIx.size(); ++k)
+	{
+		if (parIx[k] < 0 || parIx[k] >= nPar)
+			throw std::invalid_argument("setUniformPars: parameter index out of range");
+		if (!std::isfinite(values[k]))
+			throw std::invalid_argument("setUniformPars: uniform parameter values must be finite");
+		isUniform[parIx[k]] = true;
+	}
+
+	uniformParIx.clear();
+	uniformParValues.clear();
+	varyingParIx.clear();
+	for (cl_int j = 0; j < nPar; ++j)
+	{
+		if (isUniform[j])
+		{
+			uniformParIx.push_back(j);
+			uniformParValues.push_back(values[std::find(parIx.begin(), parIx.end(), j) - parIx.begin()]);
+		}
+		else
+			varyingParIx.push_back(j);
+	}
+
+	clInitialized = false;
+	dbg_printf("set %d uniform pars\n", (int)uniformParIx.size());
+}
+
+void CLODE::specializeUniformPars(std::vector<cl_double> newPars)
+{
+	waitNative();
+	if (newPars.size() == 0 || newPars.size() % nPar != 0)
+		throw std::invalid_argument("specializeUniformPars: parameter vector is not a multiple of nPar");
+
+	size_t nPtsPars = newPars.size() / nPar;
+	std::vector<cl_int> parIx;
+	std::vector<cl_double> values;
+	for (cl_int j = 0; j < nPar; ++j)
+	{
+		cl_double value = newPars[j * nPtsPars];
+		bool uniform = std::isfinite(value);
+		for (size_t i = 1; i < nPtsPars && uniform; ++i)
+			uniform = newPars[j * nPtsPars + i] == value;
+
+		if (uniform)
+		{
+			parIx.push_back(j);
+			values.push_back(value);
+		}
+	}
+	setUniformPars(parIx, values);
+}
+
+void CLODE::setParsMemory(ParsMemory newParsMemory)
+{
+	waitNative();
+	parsMemory = newParsMemory;
+	clInitialized = false;
+}
+
+void CLODE::setSimdLanes(cl_int lanes)
+{
+	waitNative();
+	if (lanes != 1 && lanes != 2 && lanes != 4 && lanes != 8 && lanes != 16)
+	{
+		printf("Invalid number of SIMD lanes: %d\n", lanes);
+		throw std::invalid_argument("SIMD lanes must be 1, 2, 4, 8 or 16");
+	}
+	simdLanes = lanes;
+	clInitialized = false;
+}
+
+std::string CLODE::getSimdProgramSource()
+{
+	return getKernelSource("transient_simd.cl");
+}
+
+void CLODE::clearUniformPars()
+{
+	waitNative();
+	setUniformPars(std::vector<cl_int>(), std::vector<cl_double>());
+}
+
+//-DUNIFORM_PARS={values} -DPAR_COLUMN={column of each parameter in d_pars, -1 if uniform}, consumed by loadPars in clODE_utilities.cl
+std::string CLODE::getUniformParsDefine()
+{
+	if (uniformParIx.empty())
+		return "";
+
+	std::string values, columns;
+	size_t u = 0, v = 0;
+	for (cl_int j = 0; j < nPar; ++j)
+	{
+		std::string sep = j > 0 ? "," : "";
+		if (u < uniformParIx.size() && uniformParIx[u] == j)
+		{
+			char literal[32];
+			snprintf(literal, sizeof(literal), clSinglePrecision ? "%.9e" : "%.17e", uniformParValues[u]);
+			values += sep + literal + (clSinglePrecision ? "f" : "");
+			columns += sep + "-1";
+			++u;
+		}
+		else
+		{
+			values += sep + "0";
+			columns += sep + std::to_string((long long)v);
+			++v;
+		}
+	}
+	return " -DUNIFORM_PARS=" + values + " -DPAR_COLUMN=" + columns;
+}
+
+void CLODE::setParameterGrid(std::vector<ParameterGridAxis> axes, std::vector<cl_double> basePars)
+{
+	waitNative();
+	if (basePars.size() != (size_t)nPar)
+		throw std::invalid_argument("setParameterGrid: basePars must have nPar elements");
+
+	std::vector<bool> isAxis(nPar, false);
+	size_t nGridPts = 1;
+	for (const ParameterGridAxis &axis : axes)
+	{
+		if (axis.parIx < 0 || axis.parIx >= nPar || isAxis[axis.parIx])
+			throw std::invalid_argument("setParameterGrid: axis parameter indices must be distinct and in range");
+		if (axis.n < 1 || !std::isfinite(axis.lb) || !std::isfinite(axis.ub))
+			throw std::invalid_argument("setParameterGrid: each axis needs n>=1 and finite bounds");
+		isAxis[axis.parIx] = true;
+		nGridPts *= axis.n;
+	}
+	if (nGridPts > (size_t)std::numeric_limits<cl_int>::max())
+		throw std::invalid_argument("setParameterGrid: too many grid points");
+
+	//the axis parameter indices are compiled in: the program must be rebuilt if they change
+	bool sameStructure = axes.size() == gridAxes.size() && !axes.empty();
+	for (size_t a = 0; sameStructure && a < axes.size(); ++a)
+		sameStructure = axes[a].parIx == gridAxes[a].parIx;
+
+	gridAxes = axes;
+	gridBasePars = basePars;
+
+	if (clInitialized && sameStructure && (cl_int)nGridPts == nPts)
+		uploadParameterGrid();
+	else
+		clInitialized = false;
+
+	dbg_printf("set parameter grid: %d axes, %d points\n", (int)gridAxes.size(), (int)nGridPts);
+}
+
+void CLODE::clearParameterGrid()
+{
+	waitNative();
+	if (!gridAxes.empty())
+		clInitialized = false;
+	gridAxes.clear();
+	gridBasePars.clear();
+}
+
+cl_int CLODE::getGridNpts()
+{
+	cl_int nGridPts = 1;
+	for (const ParameterGridAxis &axis : gridAxes)
+		nGridPts *= axis.n;
+	return nGridPts;
+}
+
+//-DGRID_AXES=nAxes -DGRID_PAR_IX={parameter index of each axis}, consumed by loadPars in clODE_utilities.cl
+std::string CLODE::getParameterGridDefine()
+{
+	if (gridAxes.empty())
+		return "";
+
+	std::string parIx;
+	for (size_t a = 0; a < gridAxes.size(); ++a)
+		parIx += (a > 0 ? "," : "") + std::to_string((long long)gridAxes[a].parIx);
+
+	return " -DGRID_AXES=" + std::to_string((long long)gridAxes.size()) + " -DGRID_PAR_IX=" + parIx;
+}
+
+void CLODE::uploadParameterGrid()
+{
+	std::vector<cl_double> gridPars(gridBasePars);
+	for (const ParameterGridAxis &axis : gridAxes)
+	{
+		gridPars.push_back(axis.lb);
+		gridPars.push_back(axis.n > 1 ? (axis.ub - axis.lb) / (axis.n - 1) : 0.0);
+		gridPars.push_back(axis.n);
+	}
+
+	if (useNative)
+	{
+		devPars = gridPars;
+		return;
+	}
+
+	try
+	{
+		if (clSinglePrecision)
+		{ //downcast to float if desired
+			std::vector<cl_float> gridParsF(gridPars.begin(), gridPars.end());
+			opencl.error = copy(opencl.getQueue(), gridParsF.begin(), gridParsF.end(), d_pars);
+		}
+		else
+		{
+			opencl.error = copy(opencl.getQueue(), gridPars.begin(), gridPars.end(), d_pars);
+		}
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODE::uploadParameterGrid: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	dbg_printf("upload parameter grid\n");
+}
+
+std::vector<cl_double> CLODE::getPars()
+{
+	waitNative();
+	if (gridAxes.empty())
+		return pars;
+
+	std::vector<cl_double> gridPars(nPar * nPts);
+	for (cl_int j = 0; j < nPar; ++j)
+		std::fill(gridPars.begin() + j * nPts, gridPars.begin() + (j + 1) * nPts, gridBasePars[j]);
+
+	for (cl_int i = 0; i < nPts; ++i)
+	{
+		cl_int k = i;
+		for (const ParameterGridAxis &axis : gridAxes)
+		{
+			cl_double step = axis.n > 1 ? (axis.ub - axis.lb) / (axis.n - 1) : 0.0;
+			gridPars[axis.parIx * nPts + i] = axis.lb + (k % axis.n) * step;
+			k /= axis.n;
+		}
+	}
+	return gridPars;
+}
+
+void CLODE::packPars(const std::vector<cl_double> &fullPars, std::vector<cl_double> &devicePars)
+{
+	devicePars.resize(varyingParIx.size() * nPts);
+	for (size_t k = 0; k < varyingParIx.size(); ++k)
+		std::copy(fullPars.begin() + varyingParIx[k] * nPts, fullPars.begin() + (varyingParIx[k] + 1) * nPts, devicePars.begin() + k * nPts);
+}
+
 void CLODE::setSolverParams(SolverParams<cl_double> newSp)
 {//TODO: equality operator for SolverParams struct
+	waitNative();
+	if (useNative)
+	{
+		sp = newSp;
+		resetChunkState();
+		return;
+	}
+
 	try
 	{
 		if (!clInitialized)
@@ -431,23 +847,17 @@ void CLODE::setSolverParams(SolverParams<cl_double> newSp)
 		}
 	
 		sp = newSp;
-		std::fill(dt.begin(), dt.end(), sp.dt);
 		
 		if (clSinglePrecision)
 		{ //downcast to float if desired
 			SolverParams<cl_float> spF = solverParamsToFloat(sp);
 			opencl.error = opencl.getQueue().enqueueWriteBuffer(d_sp, CL_TRUE, 0, sizeof(spF), &spF);
-			std::vector<cl_float> dtF(dt.begin(), dt.end());
-			opencl.error = copy(opencl.getQueue(), dtF.begin(), dtF.end(), d_dt);
-			// opencl.error = opencl.getQueue().enqueueFillBuffer(d_dt, spF.dt, 0, sizeof(spF.dt));
 		}
 		else
 		{
 			opencl.error = opencl.getQueue().enqueueWriteBuffer(d_sp, CL_TRUE, 0, sizeof(sp), &sp);
-			opencl.error = copy(opencl.getQueue(), dt.begin(), dt.end(), d_dt);
-			// opencl.error = opencl.getQueue().enqueueFillBuffer(d_dt, sp.dt, 0, sizeof(sp.dt));
 		}
-		
+		resetChunkState();
 	}
 	catch (cl::Error &er)
 	{
@@ -457,6 +867,38 @@ void CLODE::setSolverParams(SolverParams<cl_double> newSp)
 	dbg_printf("set SolverParams\n");
 }
 
+//kernels start from the per-point dt in d_dt, step count in d_stepCount and time in d_tNow, and write back the last ones.
+//Reset to sp.dt, 0 and tspan[0] at the start of each run (non-blocking). Fixed steps don't end exactly on a chunk's edge
+//when dt is not a power of two, so the next chunk continues from the time reached, as the unchunked run does
+void CLODE::resetChunkState()
+{
+	try
+	{
+		dt.resize(nPts);
+		std::fill(dt.begin(), dt.end(), sp.dt);
+		stepCount.assign(nPts, 0);
+		cl_double t0 = tspan.empty() ? 0.0 : tspan[0];
+		tNow.assign(nPts, t0);
+		if (useNative)
+			return;
+
+		if (clSinglePrecision)
+			opencl.error = opencl.getQueue().enqueueFillBuffer(d_dt, (cl_float)sp.dt, 0, realSize * nPts);
+		else
+			opencl.error = opencl.getQueue().enqueueFillBuffer(d_dt, (cl_double)sp.dt, 0, realSize * nPts);
+		opencl.error = opencl.getQueue().enqueueFillBuffer(d_stepCount, (cl_int)0, 0, sizeof(cl_int) * nPts);
+		if (clSinglePrecision)
+			opencl.error = opencl.getQueue().enqueueFillBuffer(d_tNow, (cl_float)t0, 0, realSize * nPts);
+		else
+			opencl.error = opencl.getQueue().enqueueFillBuffer(d_tNow, (cl_double)t0, 0, realSize * nPts);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODE::resetChunkState: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+}
+
 //TODO: define an assignment/type cast operator in the struct?
 SolverParams<cl_float> CLODE::solverParamsToFloat(SolverParams<cl_double> sp)
 {
@@ -475,6 +917,7 @@ SolverParams<cl_float> CLODE::solverParamsToFloat(SolverParams<cl_double> sp)
 //populate the RNGstate vector on the device. nPts must be set
 void CLODE::seedRNG()
 {
+	waitNative();
 	//TODO: what is correct method??? here, using MT to get (nRNGstate x nPts) 64bit words
 
 	std::random_device rd;
@@ -486,6 +929,8 @@ void CLODE::seedRNG()
 		//~ uint64_t seed = (uint64_t(i) << 32) | i;
 		RNGstate[i] = dis(gen);
 	}
+	if (useNative)
+		return;
 
 	try
 	{
@@ -502,11 +947,14 @@ void CLODE::seedRNG()
 //populate the RNGstate vector on the device. nPts must be set
 void CLODE::seedRNG(cl_int mySeed)
 {
+	waitNative();
 
 	for (int i = 0; i < nRNGstate * nPts; ++i)
 	{
 		RNGstate[i] = mySeed + i;
 	}
+	if (useNative)
+		return;
 
 	try
 	{
@@ -520,27 +968,400 @@ void CLODE::seedRNG(cl_int mySeed)
 	dbg_printf("set fixed RNG seed\n");
 }
 
-//Simulation routine
-void CLODE::transient()
+//chunk boundaries t0=edges[0] < edges[1] < ... < edges[nChunks]=tf. Chunk durations are a whole number of sp.dt so fixed-step methods end on the boundary
+std::vector<cl_double> CLODE::getChunkEdges()
+{
+	std::vector<cl_double> edges({tspan[0]});
+	cl_double duration = tspan[1] - tspan[0];
+
+	if (maxChunkDuration > 0 && maxChunkDuration < duration)
+	{
+		cl_double chunk = maxChunkDuration;
+		if (sp.dt > 0)
+			chunk = std::max(1.0, std::floor(maxChunkDuration / sp.dt)) * sp.dt;
+
+		//don't leave a sliver of a last chunk
+		cl_int nChunks = (cl_int)std::ceil(duration / chunk - 1e-9);
+		for (cl_int k = 1; k < nChunks; ++k)
+			edges.push_back(tspan[0] + k * chunk);
+	}
+	edges.push_back(tspan[1]);
+
+	return edges;
+}
+
+//one small read-only tspan buffer per chunk, initialized at creation so no queue writes are needed between launches
+void CLODE::setChunkTspans()
+{
+	chunkEdges = getChunkEdges();
+	size_t nChunks = chunkEdges.size() - 1;
+
+	chunkTspans.clear();
+	if (nChunks == 1)
+	{
+		chunkTspans.push_back(d_tspan);
+		return;
+	}
+
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		std::vector<cl_double> tchunk({chunkEdges[k], chunkEdges[k + 1]});
+		if (clSinglePrecision)
+		{ //downcast to float if desired
+			std::vector<cl_float> tchunkF(tchunk.begin(), tchunk.end());
+			chunkTspans.push_back(cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, realSize * 2, tchunkF.data(), &opencl.error));
+		}
+		else
+		{
+			chunkTspans.push_back(cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, realSize * 2, tchunk.data(), &opencl.error));
+		}
+	}
+}
+
+//Enqueue the kernel once per chunk of tspan. The first chunk reads d_x0, later chunks continue from d_xf in place.
+//The other kernel args, including the full tspan if the kernel needs it, must already be set
+bool CLODE::runChunked(cl::Kernel &kernel)
+{
+	resetChunkState();
+	setChunkTspans();
+	size_t nChunks = chunkTspans.size();
+
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		kernel.setArg(0, chunkTspans[k]);
+		kernel.setArg(1, k == 0 ? d_x0 : d_xf);
+
+		//execute the kernel
+		opencl.error = opencl.getQueue().enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(getGlobalSize()));
+		opencl.error = opencl.getQueue().finish();
+
+		if (progressCallback)
+			progressCallback(getChunkFraction(k));
+
+		if (cancelToken.isCancelled() && k < nChunks - 1)
+		{
+			printf("Run cancelled at t=%g of tspan=[%g, %g]\n", chunkEdges[k + 1], chunkEdges[0], chunkEdges[nChunks]);
+			return false;
+		}
+		dbg_printf("run chunk %d of %d\n", (int)k + 1, (int)nChunks);
+	}
+	return true;
+}
+
+//native counterpart of runChunked: same chunk edges, progress callback and cancellation, with the host vectors as kernel args
+bool CLODE::runChunkedNative(std::string kernelName, std::vector<void *> args)
+{
+	resetChunkState();
+	chunkEdges = getChunkEdges();
+	size_t nChunks = chunkEdges.size() - 1;
+
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		std::vector<cl_double> tchunk({chunkEdges[k], chunkEdges[k + 1]});
+		args[0] = tchunk.data();
+		args[1] = k == 0 ? x0.data() : xf.data();
+		native.runKernel(kernelName, args, getGlobalSize());
+
+		if (progressCallback)
+			progressCallback(getChunkFraction(k));
+
+		if (cancelToken.isCancelled() && k < nChunks - 1)
+		{
+			printf("Run cancelled at t=%g of tspan=[%g, %g]\n", chunkEdges[k + 1], chunkEdges[0], chunkEdges[nChunks]);
+			return false;
+		}
+		dbg_printf("run chunk %d of %d (native)\n", (int)k + 1, (int)nChunks);
+	}
+	return true;
+}
+
+//set on the threads of nativeAsync: the runs they execute call the same setters and getters, which must not wait on themselves
+static thread_local bool inNativeAsync = false;
+
+//run on a background thread after any pending native runs, like an in-order queue
+std::future<void> CLODE::nativeAsync(std::function<bool()> run)
+{
+	std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+	std::shared_ptr<std::promise<void>> pending = std::make_shared<std::promise<void>>();
+	std::future<void> future = done->get_future();
+	std::shared_future<void> previous = nativePending;
+	nativePending = pending->get_future().share();
+
+	std::thread([previous, run, done, pending]() {
+		inNativeAsync = true;
+		try
+		{
+			if (previous.valid())
+				previous.wait();
+			if (run())
+				done->set_value();
+			else
+				done->set_exception(std::make_exception_ptr(std::runtime_error("run cancelled")));
+			pending->set_value();
+		}
+		catch (...)
+		{
+			done->set_exception(std::current_exception());
+			pending->set_value();
+		}
+	}).detach();
+	return future;
+}
+
+void CLODE::waitNative()
+{
+	if (nativePending.valid() && !inNativeAsync)
+		nativePending.wait();
+}
+
+cl_double CLODE::getChunkFraction(size_t k)
+{
+	return (chunkEdges[k + 1] - chunkEdges[0]) / (chunkEdges.back() - chunkEdges[0]);
+}
+
+//helpers to turn OpenCL events into std::futures. The callbacks run on an OpenCL runtime thread once the command completes
+struct ProgressNotify
+{
+	ProgressCallback callback;
+	cl_double fraction;
+};
+
+static void CL_CALLBACK progressNotify(cl_event, cl_int status, void *user_data)
+{
+	ProgressNotify *pn = (ProgressNotify *)user_data;
+	if (status == CL_COMPLETE)
+		pn->callback(pn->fraction);
+	delete pn;
+}
+
+static void CL_CALLBACK eventNotify(cl_event, cl_int status, void *user_data)
+{
+	std::promise<void> *promise = (std::promise<void> *)user_data;
+	if (status == CL_COMPLETE)
+		promise->set_value();
+	else
+		promise->set_exception(std::make_exception_ptr(std::runtime_error("OpenCL command failed: " + CLErrorString(status))));
+	delete promise;
+}
+
+struct ReadNotify
+{
+	std::promise<std::vector<cl_double>> promise;
+	std::vector<cl_float> dataF;
+	std::vector<cl_double> data;
+	bool singlePrecision;
+};
+
+static void CL_CALLBACK readNotify(cl_event, cl_int status, void *user_data)
+{
+	ReadNotify *rn = (ReadNotify *)user_data;
+	if (status == CL_COMPLETE)
+	{
+		if (rn->singlePrecision) //cast back to double
+			rn->data.assign(rn->dataF.begin(), rn->dataF.end());
+		rn->promise.set_value(std::move(rn->data));
+	}
+	else
+		rn->promise.set_exception(std::make_exception_ptr(std::runtime_error("OpenCL read failed: " + CLErrorString(status))));
+	delete rn;
+}
+
+struct IntReadNotify
+{
+	std::promise<std::vector<cl_int>> promise;
+	std::vector<cl_int> data;
+};
+
+static void CL_CALLBACK intReadNotify(cl_event, cl_int status, void *user_data)
+{
+	IntReadNotify *rn = (IntReadNotify *)user_data;
+	if (status == CL_COMPLETE)
+		rn->promise.set_value(std::move(rn->data));
+	else
+		rn->promise.set_exception(std::make_exception_ptr(std::runtime_error("OpenCL read failed: " + CLErrorString(status))));
+	delete rn;
+}
+
+//Non-blocking version of runChunked: all chunks are enqueued at once, so there is no cancellation. The progress callback, if set, is called from an OpenCL runtime thread
+std::future<void> CLODE::enqueueChunksAsync(cl::Kernel &kernel)
+{
+	resetChunkState();
+	setChunkTspans();
+	size_t nChunks = chunkTspans.size();
+
+	cl::Event event;
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		kernel.setArg(0, chunkTspans[k]);
+		kernel.setArg(1, k == 0 ? d_x0 : d_xf);
+		opencl.error = opencl.getQueue().enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(getGlobalSize()), cl::NullRange, NULL, &event);
+
+		if (progressCallback)
+			event.setCallback(CL_COMPLETE, progressNotify, new ProgressNotify{progressCallback, getChunkFraction(k)});
+	}
+	return eventFuture(event);
+}
+
+std::future<void> CLODE::eventFuture(cl::Event &event)
+{
+	std::promise<void> *promise = new std::promise<void>();
+	std::future<void> future = promise->get_future();
+	event.setCallback(CL_COMPLETE, eventNotify, promise);
+	opencl.getQueue().flush(); //make sure the commands are submitted, or the callback may never fire
+	return future;
+}
+
+std::future<void> CLODE::notInitializedFuture()
+{
+	printf("CLODE has not been initialized\n");
+	std::promise<void> promise;
+	promise.set_exception(std::make_exception_ptr(std::runtime_error("CLODE has not been initialized")));
+	return promise.get_future();
+}
+
+//Non-blocking read of a realtype device buffer, converted to double when it arrives
+std::future<std::vector<cl_double>> CLODE::readBufferAsync(cl::Buffer &buffer, size_t nElements)
+{
+	ReadNotify *rn = new ReadNotify();
+	rn->singlePrecision = clSinglePrecision;
+	std::future<std::vector<cl_double>> future = rn->promise.get_future();
+
+	try
+	{
+		cl::Event event;
+		if (clSinglePrecision)
+		{
+			rn->dataF.resize(nElements);
+			opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_FALSE, 0, realSize * nElements, rn->dataF.data(), NULL, &event);
+		}
+		else
+		{
+			rn->data.resize(nElements);
+			opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_FALSE, 0, realSize * nElements, rn->data.data(), NULL, &event);
+		}
+		event.setCallback(CL_COMPLETE, readNotify, rn);
+		opencl.getQueue().flush();
+	}
+	catch (cl::Error &er)
+	{
+		delete rn;
+		printf("ERROR in CLODE::readBufferAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	return future;
+}
+
+//Non-blocking read of an int device buffer (e.g. stored counts)
+std::future<std::vector<cl_int>> CLODE::readIntBufferAsync(cl::Buffer &buffer, size_t nElements)
+{
+	IntReadNotify *rn = new IntReadNotify();
+	rn->data.resize(nElements);
+	std::future<std::vector<cl_int>> future = rn->promise.get_future();
+
+	try
+	{
+		cl::Event event;
+		opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_FALSE, 0, sizeof(cl_int) * nElements, rn->data.data(), NULL, &event);
+		event.setCallback(CL_COMPLETE, intReadNotify, rn);
+		opencl.getQueue().flush();
+	}
+	catch (cl::Error &er)
+	{
+		delete rn;
+		printf("ERROR in CLODE::readIntBufferAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	return future;
+}
+
+//affine maps of Quantized16 storage from [lo, hi] ranges of n components: q=0 at lo, q=65535 at hi. In single precision the maps
+//are rounded to float, the values the kernels use, so host decoding matches the device encoding
+std::vector<QuantizationMap> CLODE::getQuantizationMaps(const std::vector<cl_double> &ranges, cl_int n, const char *name)
+{
+	if (ranges.size() != 2 * (size_t)n)
+	{
+		printf("Quantized16 storage of %s needs a [lo, hi] range for each of its %d components (got %d values)\n", name, n, (int)ranges.size());
+		throw std::invalid_argument("wrong number of quantization range values");
+	}
+
+	std::vector<QuantizationMap> maps(n);
+	for (cl_int j = 0; j < n; ++j)
+	{
+		cl_double lo = ranges[2 * j], hi = ranges[2 * j + 1];
+		if (!(hi > lo) || !std::isfinite(lo) || !std::isfinite(hi))
+		{
+			printf("Invalid quantization range of %s component %d: [%g, %g]\n", name, j, lo, hi);
+			throw std::invalid_argument("quantization ranges must be finite with hi > lo");
+		}
+		maps[j].scale = (hi - lo) / 65535.0;
+		maps[j].offset = lo;
+		if (clSinglePrecision)
+		{
+			maps[j].scale = (cl_float)maps[j].scale;
+			maps[j].offset = (cl_float)maps[j].offset;
+		}
+	}
+	return maps;
+}
+
+//hexadecimal literals, so the kernels get exactly the host's maps
+std::string CLODE::getQuantizationDefine(std::string name, const std::vector<QuantizationMap> &maps)
+{
+	std::string define = " -D" + name + "=";
+	for (size_t j = 0; j < maps.size(); ++j)
+	{
+		char literal[64];
+		snprintf(literal, sizeof(literal), clSinglePrecision ? "%af,%af" : "%a,%a", maps[j].scale, maps[j].offset);
+		define += (j > 0 ? "," : "") + std::string(literal);
+	}
+	return define;
+}
+
+void CLODE::checkStorageFormat(StorageFormat format)
 {
+	if (useNative && format != StorageFormat::Real)
+		throw std::invalid_argument("Reduced-precision storage requires an OpenCL device: the native backend stores to host arrays of double");
+}
+
+//IEEE binary16 to double, including subnormals, inf and nan
+cl_double CLODE::halfToDouble(cl_ushort h)
+{
+	int exponent = (h >> 10) & 0x1f;
+	int mantissa = h & 0x3ff;
+	cl_double value;
+	if (exponent == 0)
+		value = std::ldexp((cl_double)mantissa, -24);
+	else if (exponent == 31)
+		value = mantissa == 0 ? std::numeric_limits<cl_double>::infinity() : std::numeric_limits<cl_double>::quiet_NaN();
+	else
+		value = std::ldexp((cl_double)(mantissa | 0x400), exponent - 25);
+	return (h & 0x8000) ? -value : value;
+}
 
-	if (clInitialized)
+//Simulation routine
+bool CLODE::transient()
+{
+	waitNative();
+	bool completed = false;
+	if (clInitialized && useNative)
+	{
+		completed = runChunkedNative("transient", {nullptr, nullptr, devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data()});
+	}
+	else if (clInitialized)
 	{
 		try
 		{
-			//kernel args
-			int ix=0;
-			cl_transient.setArg(ix++, d_tspan);
-			cl_transient.setArg(ix++, d_x0);
+			//kernel args. tspan and x0 are set per chunk
+			int ix=2;
 			cl_transient.setArg(ix++, d_pars);
 			cl_transient.setArg(ix++, d_sp);
 			cl_transient.setArg(ix++, d_xf);
 			cl_transient.setArg(ix++, d_RNGstate);
 			cl_transient.setArg(ix++, d_dt);
+			cl_transient.setArg(ix++, d_stepCount);
+			cl_transient.setArg(ix++, d_tNow);
 
-			//execute the kernel
-			opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_transient, cl::NullRange, cl::NDRange(nPts));
-			opencl.getQueue().finish();
+			completed = runChunked(cl_transient);
 		}
 		catch (cl::Error &er)
 		{
@@ -553,10 +1374,14 @@ void CLODE::transient()
 	{
 		printf("CLODE has not been initialized\n");
 	}
+	return completed;
 }
 
 std::vector<cl_double> CLODE::getX0()
 {
+	waitNative();
+	if (useNative)
+		return x0;
 
 	if (clSinglePrecision)
 	{ //cast back to double
@@ -574,6 +1399,9 @@ std::vector<cl_double> CLODE::getX0()
 
 std::vector<cl_double> CLODE::getXf()
 {
+	waitNative();
+	if (useNative)
+		return xf;
 
 	if (clSinglePrecision)
 	{ //cast back to double
@@ -590,10 +1418,80 @@ std::vector<cl_double> CLODE::getXf()
 }
 
 
+//Non-blocking run: returns once the kernels are enqueued. Wait on the future before reading results with the blocking getters
+std::future<void> CLODE::transientAsync()
+{
+	if (!clInitialized)
+		return notInitializedFuture();
+
+	if (useNative)
+		return nativeAsync([this]() { return transient(); });
+
+	try
+	{
+		//kernel args. tspan and x0 are set per chunk
+		int ix=2;
+		cl_transient.setArg(ix++, d_pars);
+		cl_transient.setArg(ix++, d_sp);
+		cl_transient.setArg(ix++, d_xf);
+		cl_transient.setArg(ix++, d_RNGstate);
+		cl_transient.setArg(ix++, d_dt);
+		cl_transient.setArg(ix++, d_stepCount);
+		cl_transient.setArg(ix++, d_tNow);
+
+		return enqueueChunksAsync(cl_transient);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODE::transientAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+}
+
+std::future<std::vector<cl_double>> CLODE::getX0Async()
+{
+	if (useNative)
+		return nativeReadAsync(x0);
+	return readBufferAsync(d_x0, x0elements);
+}
+
+std::future<std::vector<cl_double>> CLODE::getXfAsync()
+{
+	if (useNative)
+		return nativeReadAsync(xf);
+	return readBufferAsync(d_xf, x0elements);
+}
+
 std::string CLODE::getProgramString() 
 {
 	setCLbuildOpts();
-	return buildOptions+clprogramstring+ODEsystemsource; 
+	return buildOptions+getProgramSource()+ODEsystemsource; 
+}
+
+KernelResourceInfo CLODE::getKernelResourceInfo(cl::Kernel &kernel)
+{
+	if (useNative)
+		throw std::invalid_argument("Kernel resource info requires an OpenCL device");
+
+	KernelResourceInfo info;
+	try
+	{
+		cl::Device device = opencl.getDevice();
+		info.workGroupSize = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		info.preferredMultiple = kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+		info.privateMemSize = kernel.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(device);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODE::getKernelResourceInfo(): %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	return info;
+}
+
+KernelResourceInfo CLODE::getTransientKernelInfo()
+{
+	return getKernelResourceInfo(cl_transient);
 }
 
 
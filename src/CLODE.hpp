@@ -7,25 +7,28 @@
 
 //TODO: namespaces?
 
-//TODO: break up computation (timespan) into chunks that don't crash the system. some fine-grained max time chunk to run a kernel, a while loop in C++ to do all chunks
-
 //TODO: choosing specific RNG - get nRNGstate using a switch
 
 //TODO: device-to-device transfers instead of overwriting x0?
 
 //TODO: separate flags for initialized state and built state
 
-//TODO: use kernel.getWorkGroupInfo with CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE to offer the user a hint of nPts to use
-
 //when compiling, be sure to provide the clODE root directory as a define:
 // -DCLODE_ROOT="path/to/my/clODE/"
+//or compile the kernel sources into the library (no file access at runtime) by generating clODE_embedded_sources.hpp with
+// embed_cl_sources.py and defining -DCLODE_EMBED_SOURCES
 
 #ifndef CLODE_HPP_
 #define CLODE_HPP_
 
 #include "clODE_struct_defs.cl"
+#include "NativeResource.hpp"
 #include "OpenCLResource.hpp"
 
+#if defined(CLODE_EMBED_SOURCES) && !defined(CLODE_ROOT)
+#define CLODE_ROOT ""
+#endif
+
 // #define __CL_ENABLE_EXCEPTIONS
 // #if defined(__APPLE__) || defined(__MACOSX)
 // #include "OpenCL/cl.hpp"
@@ -38,7 +41,11 @@
 #define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY
 #include "OpenCL/cl2.hpp"
 
+#include <atomic>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -55,6 +62,68 @@ struct ProblemInfo
     std::vector<std::string> auxNames;
 };
 
+//address space of the parameter array in the kernels. __constant is cached for uniform access but usually capped at 64KB, while
+//per-point parameters are read at a different address by every work-item: __global const (restrict) suits them better.
+//Automatic: __constant for the small grid-sweep array, __global const otherwise
+enum class ParsMemory
+{
+    Automatic,
+    Constant,
+    Global
+};
+
+//one axis of a regular parameter grid: n values of parameter parIx from lb to ub (as linspace)
+struct ParameterGridAxis
+{
+    cl_int parIx;
+    cl_double lb;
+    cl_double ub;
+    cl_int n;
+};
+
+//device storage of the large outputs (stored trajectories, feature matrix). Integration stays in realtype: values are converted
+//when written and decoded to double by the host getters. Half: IEEE binary16 via vstore_half (11 significant bits).
+//Quantized16: unsigned 16-bit q per value, with an affine map per component set from a [lo, hi] range (saturates outside)
+enum class StorageFormat
+{
+    Real,
+    Half,
+    Quantized16
+};
+
+//affine map of one component in Quantized16 storage: value = offset + scale * q, q in [0, 65535]
+struct QuantizationMap
+{
+    cl_double scale;
+    cl_double offset;
+};
+
+//resources a built kernel takes on the device (kernel.getWorkGroupInfo), a proxy for the occupancy the stepper and observer
+//allow: register pressure lowers workGroupSize on most GPUs, and privateMemSize is per work-item private memory that is not
+//held in registers. nPts is best a multiple of preferredMultiple
+struct KernelResourceInfo
+{
+    size_t workGroupSize;     //CL_KERNEL_WORK_GROUP_SIZE
+    size_t preferredMultiple; //CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    cl_ulong privateMemSize;  //CL_KERNEL_PRIVATE_MEM_SIZE, bytes
+};
+
+//called after each time chunk of a chunked run with the fraction of tspan completed so far
+typedef std::function<void(cl_double fractionComplete)> ProgressCallback;
+
+//shared flag to abort a chunked run between chunks, e.g. from another thread. Copies refer to the same flag.
+//Once cancelled, subsequent runs stop after their first chunk until reset() is called
+class CancelToken
+{
+    std::shared_ptr<std::atomic<bool>> flag;
+
+public:
+    CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)){};
+    void cancel() { *flag = true; };
+    void reset() { *flag = false; };
+    bool isCancelled() const { return *flag; };
+};
+
 class CLODE
 {
 
@@ -78,6 +147,14 @@ protected:
     OpenCLResource opencl;
     const std::string clodeRoot = CLODE_ROOT;
 
+    //native CPU backend instead of OpenCL: the host vectors (x0, xf, dt, RNGstate, devPars, ...) are the kernel arrays.
+    //Always double precision. Async runs go to a background thread, in order, like an in-order queue
+    bool useNative = false;
+    NativeResource native;
+    std::vector<cl_double> devPars; //pars as the kernels read them: varying columns, or the grid
+    std::shared_future<void> nativePending;
+    std::string getKernelSource(std::string filename); //embedded copy, or read from clodeRoot
+
     cl_int nRNGstate = 2; //TODO: different RNGs could be selected like steppers...?
 
     SolverParams<cl_double> sp;
@@ -85,9 +162,37 @@ protected:
     size_t x0elements, parselements, RNGelements;
 
     std::vector<cl_ulong> RNGstate;
+    std::vector<cl_int> stepCount; //steps taken so far in the current run, per point: max_steps applies across chunks
+    std::vector<cl_double> tNow; //time reached so far in the current run, per point: the next chunk continues from it
+
+    //parameters that are the same for every point can be compiled into the program as constants: d_pars then holds only the varying columns
+    std::vector<cl_int> uniformParIx, varyingParIx;
+    std::vector<cl_double> uniformParValues;
+    size_t devParselements;
+
+    //grid-sweep mode: parameters of point i are generated on the device from the grid index i (first axis fastest, as ndgrid).
+    //d_pars then holds {basePars [nPar], lb/step/n of each axis} and no nPts*nPar vector exists on the host
+    std::vector<ParameterGridAxis> gridAxes;
+    std::vector<cl_double> gridBasePars;
+
+    ParsMemory parsMemory = ParsMemory::Automatic;
+    bool parsInGlobal = true; //resolved at the last program build
+
+    //lane-batched kernels (*_simd.cl): each work-item integrates simdLanes points as floatN/doubleN vectors
+    cl_int simdLanes = 1;
+    virtual std::string getSimdProgramSource(); //lane-batched counterpart of clprogramstring
+    std::string getProgramSource() { return simdLanes > 1 ? getSimdProgramSource() : clprogramstring; };
+    size_t getGlobalSize() { return nPts / simdLanes; }; //number of work-items
 
     //Device variables
-    cl::Buffer d_tspan, d_x0, d_pars, d_sp, d_xf, d_RNGstate, d_dt;
+    cl::Buffer d_tspan, d_x0, d_pars, d_sp, d_xf, d_RNGstate, d_dt, d_stepCount, d_tNow;
+
+    //chunked execution: chunkTspans holds the [t0,tf] of each chunk of the current run
+    cl_double maxChunkDuration = 0; //<=0: run the whole tspan in one kernel launch
+    std::vector<cl_double> chunkEdges;
+    std::vector<cl::Buffer> chunkTspans;
+    ProgressCallback progressCallback;
+    CancelToken cancelToken;
 
     //kernel object
     std::string clprogramstring, buildOptions, ODEsystemsource;
@@ -99,8 +204,51 @@ protected:
     
     void setCLbuildOpts(std::string extraBuildOpts = "");
     std::string getStepperDefine();
+    std::string getUniformParsDefine();
+    std::string getParameterGridDefine();
+    void uploadParameterGrid();
+    void packPars(const std::vector<cl_double> &fullPars, std::vector<cl_double> &devicePars); //varying columns only, [nPts*nVaryingPar]
     SolverParams<cl_float> solverParamsToFloat(SolverParams<cl_double> sp);
 
+    std::vector<cl_double> getChunkEdges();
+    void setChunkTspans();
+    cl_double getChunkFraction(size_t k);
+    void resetChunkState();
+    bool runChunked(cl::Kernel &kernel); //kernel args 0 (tspan) and 1 (x0) are set per chunk. Returns false if cancelled
+    std::future<void> enqueueChunksAsync(cl::Kernel &kernel);
+
+    std::future<void> eventFuture(cl::Event &event); //resolves when the event completes
+    std::future<void> notInitializedFuture(); //already resolved: get() throws, so waiting callers see the error
+
+    bool runChunkedNative(std::string kernelName, std::vector<void *> args); //args 0 (tspan) and 1 (x0) are set per chunk
+    std::future<void> nativeAsync(std::function<bool()> run); //a run that returns false (cancelled) fails the future
+    void waitNative(); //block until the pending async runs are done, as the in-order queue orders the blocking OpenCL calls
+    template <typename T>
+    std::future<std::vector<T>> nativeReadAsync(const std::vector<T> &hostData) //copy taken after pending async runs finish
+    {
+        std::shared_future<void> previous = nativePending;
+        const std::vector<T> *data = &hostData;
+        return std::async(std::launch::async, [previous, data]() {
+            if (previous.valid())
+                previous.get();
+            return *data;
+        });
+    };
+    std::future<std::vector<cl_double>> readBufferAsync(cl::Buffer &buffer, size_t nElements);
+    std::future<std::vector<cl_int>> readIntBufferAsync(cl::Buffer &buffer, size_t nElements);
+    KernelResourceInfo getKernelResourceInfo(cl::Kernel &kernel);
+
+    //reduced-precision output storage (StorageFormat), shared by CLODEtrajectory and CLODEfeatures
+    size_t getStorageSize(StorageFormat format) { return format == StorageFormat::Real ? realSize : sizeof(cl_ushort); };
+    std::vector<QuantizationMap> getQuantizationMaps(const std::vector<cl_double> &ranges, cl_int n, const char *name); //{lo0, hi0, lo1, hi1, ...}
+    std::string getQuantizationDefine(std::string name, const std::vector<QuantizationMap> &maps); //-Dname=scale0,offset0,...
+    void checkStorageFormat(StorageFormat format); //reduced formats need an OpenCL device
+    static cl_double halfToDouble(cl_ushort h);
+    static cl_double decodeStored(cl_ushort value, StorageFormat format, const QuantizationMap &map)
+    {
+        return format == StorageFormat::Half ? halfToDouble(value) : map.offset + map.scale * value;
+    };
+
     //~private:
     //~ CLODE( const CLODE& other ); // non construction-copyable
     //~ CLODE& operator=( const CLODE& ); // non copyable
@@ -112,6 +260,7 @@ public:
     // CLODE(unsigned int platformID, unsigned int deviceID); //specify device only
     CLODE(ProblemInfo prob, std::string stepper, bool clSinglePrecision, OpenCLResource opencl);
     CLODE(ProblemInfo prob, std::string stepper, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID);
+    CLODE(ProblemInfo prob, std::string stepper, NativeResource native); //native CPU backend, no OpenCL platform needed
     //~ CLODE(ProblemInfo prob); //set stepper, precision, and opencl
     //~ CLODE(ProblemInfo prob, StepperType stepper=rungeKutta4, bool clSinglePrecision=true, OpenCLResource opencl=OpenCLResource()); //alt: use defaults?
     ~CLODE();
@@ -122,6 +271,8 @@ public:
     void setPrecision(bool clSinglePrecision);          //buildCL, all device vars. Opencl context OK
     void setOpenCL(OpenCLResource opencl);              //buildCL, all device vars. Host problem data OK
     void setOpenCL(unsigned int platformID, unsigned int deviceID);
+    void setNative(NativeResource newNative);           //buildCL, all device vars. Host problem data OK
+    bool isNative() { return useNative; };
 
     void buildProgram(std::string extraBuildOpts = ""); //build the program object (inherited by subclasses)
     void buildCL(); // build program and create kernel objects - overloaded by subclasses to include any extra kernels
@@ -136,11 +287,42 @@ public:
     void setPars(std::vector<cl_double> newPars); //no change in nPts: newPars must match nPts
     void setSolverParams(SolverParams<cl_double> newSp);
 
+    //compile-time specialization of parameters that are uniform across all points. Takes effect at the next buildCL + initialize;
+    //setPars then only uploads the varying columns, and throws if a uniform column doesn't match its compiled-in value
+    void setUniformPars(std::vector<cl_int> parIx, std::vector<cl_double> values);
+    void specializeUniformPars(std::vector<cl_double> newPars); //detect the uniform columns of newPars [nPar*nPts]
+    void clearUniformPars();
+    std::vector<cl_int> getUniformParIx() { return uniformParIx; };
+
+    void setParsMemory(ParsMemory newParsMemory); //requires buildCL
+
+    //integrate lanes (2, 4, 8 or 16) trajectories per work-item in lockstep, with realtype as a vector in the steppers and the
+    //RHS (which must then be branch-free: select/step/fmin... instead of if/else). Aimed at CPU OpenCL devices, where the scalar
+    //kernels rely on the implicit vectorizer. nPts must be a multiple of lanes. Not for stochastic steppers. The native backend
+    //compiles them as C++ over compiler vector types (clODE_native_shim.h). lanes=1 restores the scalar kernels. Requires buildCL
+    void setSimdLanes(cl_int lanes);
+    cl_int getSimdLanes() { return simdLanes; };
+
+    //grid-sweep mode: nPts = product of the axis counts; parameters not on an axis take their value from basePars.
+    //Changing which parameters are axes requires buildCL. Then initialize (or setProblemData) with empty pars. When only the
+    //bounds change, the new grid is uploaded immediately
+    void setParameterGrid(std::vector<ParameterGridAxis> axes, std::vector<cl_double> basePars);
+    void clearParameterGrid();
+    std::vector<ParameterGridAxis> getParameterGrid() { return gridAxes; };
+    cl_int getGridNpts();
+
     void seedRNG();
     void seedRNG(cl_int mySeed); //overload for setting reproducible seeds
 
+    //chunked execution: split tspan into kernel launches of at most maxChunkDuration time units (rounded to a multiple of sp.dt).
+    //xf, RNG state, dt and observer data carry over from one chunk to the next; x0 is left unchanged.
+    void setMaxChunkDuration(cl_double newMaxChunkDuration) { waitNative(); maxChunkDuration = newMaxChunkDuration; };
+    void setProgressCallback(ProgressCallback newProgressCallback) { waitNative(); progressCallback = newProgressCallback; };
+    CancelToken getCancelToken() { return cancelToken; };
+
     //simulation routine and overloads
-    void transient(); //integrate forward using stored tspan, x0, pars, and solver pars
+    bool transient(); //integrate forward using stored tspan, x0, pars, and solver pars. Returns false if cancelled (or not initialized): xf then holds the state where the run stopped
+    std::future<void> transientAsync(); //non-blocking: returns as soon as the kernel(s) are enqueued. Native: get() throws if the run was cancelled
     // void transient(std::vector<cl_double> newTspan); //integrate forward using stored x0, pars, and solver pars
     // void transient(std::vector<cl_double> newTspan, std::vector<cl_double> newX0); //integrate forward using stored pars, and solver pars
     // void transient(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars); //integrate forward using stored solver pars
@@ -149,10 +331,17 @@ public:
     void shiftTspan(); //t0 <- tf, tf<-(tf + tf-t0)
     void shiftX0();    //d_x0 <- d_xf (device to device transfer)
 
-    std::vector<cl_double> getTspan() { return tspan; };
+    std::vector<cl_double> getTspan() { waitNative(); return tspan; };
+    cl_int getNpts() { return nPts; };
+    cl_int getNvar() { return nVar; };
+    cl_int getNpar() { return nPar; };
     std::vector<cl_double> getX0();
+    std::vector<cl_double> getPars(); //expanded from the grid in grid-sweep mode
     std::vector<cl_double> getXf();
+    std::future<std::vector<cl_double>> getX0Async(); //non-blocking: queued behind any pending runs
+    std::future<std::vector<cl_double>> getXfAsync();
     std::string getProgramString();
+    KernelResourceInfo getTransientKernelInfo(); //requires buildCL, OpenCL device only
     std::vector<std::string> getAvailableSteppers() { return availableSteppers; };
 
     void printStatus();
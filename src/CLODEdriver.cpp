@@ -0,0 +1,345 @@
+#include "CLODEdriver.hpp"
+
+// #define dbg_printf printf
+#define dbg_printf
+#ifdef MATLAB_MEX_FILE
+#include "mex.h"
+#define printf mexPrintf
+#endif
+
+#include <algorithm> //std::max
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <stdio.h>
+
+CLODEdriver::CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, OpenCLResource opencl)
+	: CLODEfeatures(prob, stepper, observer, clSinglePrecision, opencl), nStoreMax(0), telements(0), xelements(0), dxelements(0), auxelements(0)
+{
+	clprogramstring += getKernelSource("odedriver.cl");
+	dbg_printf("constructor clODEdriver\n");
+}
+
+CLODEdriver::CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID)
+	: CLODEfeatures(prob, stepper, observer, clSinglePrecision, platformID, deviceID), nStoreMax(0), telements(0), xelements(0), dxelements(0), auxelements(0)
+{
+	clprogramstring += getKernelSource("odedriver.cl");
+	dbg_printf("constructor clODEdriver\n");
+}
+
+CLODEdriver::CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, NativeResource native)
+	: CLODEfeatures(prob, stepper, observer, native), nStoreMax(0), telements(0), xelements(0), dxelements(0), auxelements(0)
+{
+	clprogramstring += getKernelSource("odedriver.cl");
+	dbg_printf("constructor clODEdriver (native)\n");
+}
+
+CLODEdriver::~CLODEdriver() {}
+
+// build program and create kernel objects - requires host variables to be set (specifically observerBuildOpts)
+void CLODEdriver::buildCL()
+{
+	waitNative();
+	if (simdLanes > 1)
+		throw std::invalid_argument("CLODEdriver has no lane-batched kernel: use setSimdLanes(1)");
+	checkStorageFormat(storageFormat);
+	observerBuildOpts = getObserverBuildOpts();
+	buildProgram(observerBuildOpts + getStorageDefine());
+
+	//set up the kernels
+	try
+	{
+		if (!useNative)
+		{
+			cl_transient = cl::Kernel(opencl.getProgram(), "transient", &opencl.error);
+			cl_initializeObserver = cl::Kernel(opencl.getProgram(), "initializeObserver", &opencl.error);
+			cl_features = cl::Kernel(opencl.getProgram(), "features", &opencl.error);
+			cl_transientObserver = cl::Kernel(opencl.getProgram(), "transientObserver", &opencl.error);
+			cl_odedriver = cl::Kernel(opencl.getProgram(), "odedriver", &opencl.error);
+		}
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEdriver::buildCL: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	dbg_printf("initialize odedriver kernel\n");
+
+	clInitialized = false;
+	printf("Using observer: %s\n", observer.c_str());
+}
+
+//initialize everything
+void CLODEdriver::initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp, ObserverParams<cl_double> newOp)
+{
+	waitNative();
+	clInitialized = false;
+	//at the time of initialize, make sure observerDataSize and nFeatures are up to date (for d_F, d_odata)
+	updateObserverDefineMap();
+
+	setTspan(newTspan);
+	setProblemData(newX0, newPars); //will set nPts
+	resizeFeaturesVariables(); //set up d_F and d_odata too, which depend on nPts
+	setSolverParams(newSp);
+	setObserverParams(newOp);
+	//set up trajectory output variables, depends on sp.max_store, nPts, nVar, nAux
+	resizeTrajectoryVariables();
+
+	doObserverInitialization = true;
+	clInitialized = true;
+	dbg_printf("initialize clODEdriver.\n");
+}
+
+void CLODEdriver::resizeTrajectoryVariables()
+{
+	int currentStoreAlloc = sp.max_store;
+
+	//check largest desired memory chunk against device's maximum allowable variable size
+	size_t largestPointSize = realSize * std::max(1, std::max(nVar, nAux));
+	size_t largestAlloc = largestPointSize * nPts * currentStoreAlloc;
+
+	if (!useNative && largestAlloc > opencl.getMaxMemAllocSize())
+	{
+		int estimatedMaxStoreAlloc = std::floor(opencl.getMaxMemAllocSize() / (largestPointSize * nPts));
+		printf("ERROR: storage requested exceeds device maximum variable size. Try reducing storage to <%d time points, or reducing nPts. \n", estimatedMaxStoreAlloc);
+		throw std::invalid_argument("nPts*nStoreMax*nVar*realSize is too big");
+	}
+
+	size_t currentTelements = (size_t)currentStoreAlloc * nPts;
+
+	//only resize device variables if size changed, or if not yet initialized
+	if (!clInitialized || nStoreMax != currentStoreAlloc || telements != currentTelements || xelements != nVar * currentTelements || auxelements != nAux * currentTelements)
+	{
+		nStoreMax = currentStoreAlloc;
+		telements = currentTelements;
+		xelements = nVar * currentTelements;
+		dxelements = nVar * currentTelements;
+		auxelements = nAux * currentTelements;
+
+		t.resize(telements);
+		x.resize(xelements);
+		dx.resize(dxelements);
+		aux.resize(auxelements);
+		nStored.resize(nPts);
+		if (useNative)
+			return;
+
+		//resize device variables
+		try
+		{
+			d_t = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * telements, NULL, &opencl.error);
+			d_x = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * xelements, NULL, &opencl.error);
+			d_dx = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * dxelements, NULL, &opencl.error);
+			d_aux = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * std::max(auxelements, (size_t)1), NULL, &opencl.error); //nAux=0 still needs a valid buffer
+			d_nStored = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, sizeof(int) * nPts, NULL, &opencl.error);
+		}
+		catch (cl::Error &er)
+		{
+			printf("ERROR in CLODEdriver::resizeTrajectoryVariables: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+			throw er;
+		}
+		dbg_printf("resize d_t, d_x, d_dx, d_aux, d_nStored\n");
+	}
+}
+
+//kernel arguments. tspan and x0 are set per chunk
+void CLODEdriver::setDriverArgs()
+{
+	int ix = 2;
+	cl_odedriver.setArg(ix++, d_pars);
+	cl_odedriver.setArg(ix++, d_sp);
+	cl_odedriver.setArg(ix++, d_xf);
+	cl_odedriver.setArg(ix++, d_RNGstate);
+	cl_odedriver.setArg(ix++, d_dt);
+	cl_odedriver.setArg(ix++, d_stepCount);
+	cl_odedriver.setArg(ix++, d_tNow);
+	cl_odedriver.setArg(ix++, d_odata);
+	cl_odedriver.setArg(ix++, d_op);
+	cl_odedriver.setArg(ix++, d_F);
+	cl_odedriver.setArg(ix++, d_t);
+	cl_odedriver.setArg(ix++, d_x);
+	cl_odedriver.setArg(ix++, d_dx);
+	cl_odedriver.setArg(ix++, d_aux);
+	cl_odedriver.setArg(ix++, d_nStored);
+	cl_odedriver.setArg(ix++, d_tspan);
+}
+
+//Simulation routines
+
+//overload to allow manual re-initialization of observer data at any time.
+bool CLODEdriver::odedriver(bool newDoObserverInitFlag)
+{
+	waitNative();
+	doObserverInitialization = newDoObserverInitFlag;
+
+	return odedriver();
+}
+
+bool CLODEdriver::odedriver()
+{
+	waitNative();
+	bool completed = false;
+	if (clInitialized)
+	{
+		//resize output variables - will only occur if nPts or max_store has changed
+		resizeFeaturesVariables();
+		resizeTrajectoryVariables();
+
+		if (doObserverInitialization)
+			initializeObserver();
+
+		if (useNative)
+		{
+			completed = runChunkedNative("odedriver", {nullptr, nullptr, devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data(), odata.data(), &op, F.data(),
+													   t.data(), x.data(), dx.data(), aux.data(), nStored.data(), tspan.data()});
+		}
+		else
+		{
+			try
+			{
+				setDriverArgs();
+
+				//execute the kernel, one launch per chunk. Observer data stays on the device and the trajectory is appended between chunks
+				completed = runChunked(cl_odedriver);
+			}
+			catch (cl::Error &er)
+			{
+				printf("ERROR in CLODEdriver::odedriver: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+				throw er;
+			}
+		}
+		if (!completed)
+			doObserverInitialization = true; //a cancelled run did not finalize the observer data
+		dbg_printf("run odedriver\n");
+	}
+	else
+	{
+		printf("CLODE has not been initialized\n");
+	}
+	return completed;
+}
+
+//Non-blocking odedriver: observer initialization (if needed) and all chunks are enqueued, then this returns
+std::future<void> CLODEdriver::odedriverAsync()
+{
+	if (!clInitialized)
+		return notInitializedFuture();
+
+	if (useNative)
+		return nativeAsync([this]() { return odedriver(); });
+
+	//resize output variables - will only occur if nPts or max_store has changed
+	resizeFeaturesVariables();
+	resizeTrajectoryVariables();
+
+	try
+	{
+		if (doObserverInitialization)
+			enqueueInitializeObserver();
+
+		setDriverArgs();
+		return enqueueChunksAsync(cl_odedriver);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEdriver::odedriverAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+}
+
+std::future<void> CLODEdriver::odedriverAsync(bool newDoObserverInitFlag)
+{
+	doObserverInitialization = newDoObserverInitFlag;
+
+	return odedriverAsync();
+}
+
+void CLODEdriver::readToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData)
+{
+	if (useNative || hostData.empty())
+		return;
+
+	if (clSinglePrecision)
+	{ //cast back to double
+		std::vector<cl_float> dataF(hostData.size());
+		opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, 0, realSize * dataF.size(), dataF.data());
+		hostData.assign(dataF.begin(), dataF.end());
+	}
+	else
+	{
+		opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, 0, realSize * hostData.size(), hostData.data());
+	}
+}
+
+std::vector<cl_double> CLODEdriver::getT()
+{
+	waitNative();
+	readToHost(d_t, t);
+	return t;
+}
+
+std::vector<cl_double> CLODEdriver::getX()
+{
+	waitNative();
+	readToHost(d_x, x);
+	return x;
+}
+
+std::vector<cl_double> CLODEdriver::getDx()
+{
+	waitNative();
+	readToHost(d_dx, dx);
+	return dx;
+}
+
+std::vector<cl_double> CLODEdriver::getAux()
+{
+	waitNative();
+	readToHost(d_aux, aux);
+	return aux;
+}
+
+std::vector<cl_int> CLODEdriver::getNstored()
+{
+	waitNative();
+	if (useNative)
+		return nStored;
+
+	opencl.error = copy(opencl.getQueue(), d_nStored, nStored.begin(), nStored.end());
+	return nStored;
+}
+
+std::future<std::vector<cl_double>> CLODEdriver::getTAsync()
+{
+	if (useNative)
+		return nativeReadAsync(t);
+	return readBufferAsync(d_t, telements);
+}
+
+std::future<std::vector<cl_double>> CLODEdriver::getXAsync()
+{
+	if (useNative)
+		return nativeReadAsync(x);
+	return readBufferAsync(d_x, xelements);
+}
+
+std::future<std::vector<cl_double>> CLODEdriver::getDxAsync()
+{
+	if (useNative)
+		return nativeReadAsync(dx);
+	return readBufferAsync(d_dx, dxelements);
+}
+
+std::future<std::vector<cl_double>> CLODEdriver::getAuxAsync()
+{
+	if (useNative || auxelements == 0)
+		return nativeReadAsync(aux);
+	return readBufferAsync(d_aux, auxelements);
+}
+
+std::future<std::vector<cl_int>> CLODEdriver::getNstoredAsync()
+{
+	if (useNative)
+		return nativeReadAsync(nStored);
+	return readIntBufferAsync(d_nStored, nPts);
+}
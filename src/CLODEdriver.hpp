@@ -0,0 +1,82 @@
+/* clODE: a simulator class to run parallel ODE simulations on OpenCL capable hardware.
+ * A clODE simulator solves on initial value problem over a grid of parameters and/or initial conditions. At each timestep,
+ * "observer" rountine may be called to record/store/compute features of the solutions. Examples include storing the full
+ * trajectory, recording the times and values of local extrema in a variable of the system, or directly computing other
+ * features of the trajectory.
+ */
+
+//when compiling, be sure to provide the clODE root directory as a define:
+// -DCLODE_ROOT="path/to/my/clODE/"
+
+#ifndef CLODE_DRIVER_HPP_
+#define CLODE_DRIVER_HPP_
+
+#include "CLODEfeatures.hpp"
+#include "clODE_struct_defs.cl"
+#include "OpenCLResource.hpp"
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY
+#include "OpenCL/cl2.hpp"
+
+#include <future>
+#include <string>
+#include <vector>
+
+//features and trajectory from a single integration (odedriver.cl): one launch gives F (as CLODEfeatures::features), the
+//stored trajectory (as CLODEtrajectory::trajectory, every nout'th step up to max_store points) and xf. The trajectory is
+//stored time-major, all components, in realtype: the output options of CLODEtrajectory are not available here. F may use
+//a reduced storage format (CLODEfeatures::setStorageFormat)
+class CLODEdriver : public CLODEfeatures
+{
+
+protected:
+    cl_int nStoreMax;
+    std::vector<cl_int> nStored;
+    std::vector<cl_double> t, x, dx, aux;
+    size_t telements, xelements, dxelements, auxelements;
+
+    cl::Buffer d_t, d_x, d_dx, d_aux, d_nStored;
+    cl::Kernel cl_odedriver;
+
+    void resizeTrajectoryVariables(); //d_t, d_x, d_dx, d_aux, d_nStored depend on nPts and sp.max_store
+    void setDriverArgs(); //kernel args other than tspan and x0
+    void readToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData); //hostData.size() values
+
+public:
+    CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, OpenCLResource opencl);
+    CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID);
+    CLODEdriver(ProblemInfo prob, std::string stepper, std::string observer, NativeResource native); //native CPU backend
+    ~CLODEdriver();
+
+    //build program, set all problem data needed to run
+    virtual void initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp, ObserverParams<cl_double> newOp);
+
+    void buildCL(); // build program and create kernel objects
+
+    //simulation routine and overloads: features and trajectory over the interval (tf-t0). Storage stops at max_store points,
+    //the observer runs to tf
+    bool odedriver(); //false if cancelled (or not initialized), as features()
+    bool odedriver(bool newDoObserverInitFlag); //allow manually forcing re-init of observer data
+    std::future<void> odedriverAsync(); //non-blocking: returns as soon as the kernel(s) are enqueued
+    std::future<void> odedriverAsync(bool newDoObserverInitFlag);
+
+    //Get functions: getF, getXf etc. as in the base classes. Trajectory outputs are time-major: element j of stored point k of
+    //trajectory i is at [(k*nElem + j)*nPts + i], as in CLODEtrajectory's default layout
+    std::vector<cl_double> getT();
+    std::vector<cl_double> getX();
+    std::vector<cl_double> getDx();
+    std::vector<cl_double> getAux();
+    std::vector<cl_int> getNstored();
+
+    //non-blocking getters: queued behind any pending runs
+    std::future<std::vector<cl_double>> getTAsync();
+    std::future<std::vector<cl_double>> getXAsync();
+    std::future<std::vector<cl_double>> getDxAsync();
+    std::future<std::vector<cl_double>> getAuxAsync();
+    std::future<std::vector<cl_int>> getNstoredAsync();
+};
+
+#endif //CLODE_DRIVER_HPP_
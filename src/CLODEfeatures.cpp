@@ -9,6 +9,7 @@
 
 #include <algorithm> //std::max
 #include <cmath>
+#include <memory>
 #include <stdexcept>
 #include <stdio.h>
 
@@ -20,8 +21,8 @@ CLODEfeatures::CLODEfeatures(ProblemInfo prob, std::string stepper, std::string
 	op.eVarIx=0;
 	updateObserverDefineMap();
 
-	clprogramstring += read_file(clodeRoot + "initializeObserver.cl");
-	clprogramstring += read_file(clodeRoot + "features.cl");
+	clprogramstring += getKernelSource("initializeObserver.cl");
+	clprogramstring += getKernelSource("features.cl");
 	dbg_printf("constructor clODEfeatures\n");
 }
 
@@ -33,25 +34,50 @@ CLODEfeatures::CLODEfeatures(ProblemInfo prob, std::string stepper, std::string
 	op.eVarIx=0;
 	updateObserverDefineMap();
 
-	clprogramstring += read_file(clodeRoot + "initializeObserver.cl");
-	clprogramstring += read_file(clodeRoot + "features.cl");
+	clprogramstring += getKernelSource("initializeObserver.cl");
+	clprogramstring += getKernelSource("features.cl");
 	dbg_printf("constructor clODEfeatures\n");
 }
 
+CLODEfeatures::CLODEfeatures(ProblemInfo prob, std::string stepper, std::string observer, NativeResource native)
+	: CLODE(prob, stepper, native), observer(observer)
+{
+	// default fVarIx and eVarIx to allow first query of observer define map
+	op.fVarIx=0;
+	op.eVarIx=0;
+	updateObserverDefineMap();
+
+	clprogramstring += getKernelSource("initializeObserver.cl");
+	clprogramstring += getKernelSource("features.cl");
+	dbg_printf("constructor clODEfeatures (native)\n");
+}
+
 CLODEfeatures::~CLODEfeatures() {}
 
+std::string CLODEfeatures::getSimdProgramSource()
+{
+	return getKernelSource("initializeObserver_simd.cl") + getKernelSource("features_simd.cl") + getKernelSource("transient_simd.cl");
+}
+
 // build program and create kernel objects - requires host variables to be set (specifically observerBuildOpts)
 void CLODEfeatures::buildCL()
 {
-	observerBuildOpts=" -D" + observerDefineMap.at(observer).define;
-	buildProgram(observerBuildOpts);
+	waitNative();
+	checkStorageFormat(storageFormat);
+	observerBuildOpts=getObserverBuildOpts();
+	buildProgram(observerBuildOpts + getStorageDefine());
 
 	//set up the kernels
 	try
 	{
-		cl_transient = cl::Kernel(opencl.getProgram(), "transient", &opencl.error);
-		cl_initializeObserver = cl::Kernel(opencl.getProgram(), "initializeObserver", &opencl.error);
-		cl_features = cl::Kernel(opencl.getProgram(), "features", &opencl.error);
+		if (!useNative)
+		{
+			cl_transient = cl::Kernel(opencl.getProgram(), "transient", &opencl.error);
+			cl_initializeObserver = cl::Kernel(opencl.getProgram(), "initializeObserver", &opencl.error);
+			cl_features = cl::Kernel(opencl.getProgram(), "features", &opencl.error);
+			if (simdLanes == 1)
+				cl_transientObserver = cl::Kernel(opencl.getProgram(), "transientObserver", &opencl.error);
+		}
 
 		// size_t preferred_multiple;
 		// cl::Device dev;
@@ -73,14 +99,20 @@ void CLODEfeatures::buildCL()
 
 std::string CLODEfeatures::getProgramString() 
 {
-	observerBuildOpts=" -D" + observerDefineMap.at(observer).define;
-	setCLbuildOpts(observerBuildOpts);
-	return buildOptions+clprogramstring+ODEsystemsource; 
+	observerBuildOpts=getObserverBuildOpts();
+	setCLbuildOpts(observerBuildOpts + getStorageDefine());
+	return buildOptions+getProgramSource()+ODEsystemsource; 
+}
+
+KernelResourceInfo CLODEfeatures::getFeaturesKernelInfo()
+{
+	return getKernelResourceInfo(cl_features);
 }
 
 //initialize everything
 void CLODEfeatures::initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp, ObserverParams<cl_double> newOp)
 {
+	waitNative();
 	clInitialized = false;
 	//at the time of initialize, make sure observerDataSize and nFeatures are up to date (for d_F, d_odata)
 	updateObserverDefineMap(); 
@@ -98,6 +130,7 @@ void CLODEfeatures::initialize(std::vector<cl_double> newTspan, std::vector<cl_d
 
 void CLODEfeatures::setObserver(std::string newObserver)
 {
+	waitNative();
 	auto loc = observerDefineMap.find(newObserver); //from steppers.cl
 	if ( loc != observerDefineMap.end() )
 	{
@@ -115,8 +148,16 @@ void CLODEfeatures::setObserver(std::string newObserver)
 
 void CLODEfeatures::setObserverParams(ObserverParams<cl_double> newOp)
 {
+	waitNative();
 	try
 	{
+		op = newOp;
+		if (useNative)
+		{
+			updateObserverDefineMap();
+			return;
+		}
+
 		if (!clInitialized)
 		{
 			if (clSinglePrecision)
@@ -125,8 +166,6 @@ void CLODEfeatures::setObserverParams(ObserverParams<cl_double> newOp)
 				d_op = cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY, sizeof(ObserverParams<cl_double>), NULL, &opencl.error);
 		}
 
-		op = newOp; 
-
 		if (clSinglePrecision)
 		{ //downcast to float if desired
 			ObserverParams<cl_float> opF = observerParamsToFloat(newOp);
@@ -153,12 +192,19 @@ void CLODEfeatures::setObserverParams(ObserverParams<cl_double> newOp)
 void CLODEfeatures::updateObserverDefineMap()
 {
 	getObserverDefineMap(prob, op.fVarIx, op.eVarIx, observerDefineMap, availableObserverNames);
-	observerBuildOpts=" -D" + observerDefineMap.at(observer).define;
+	observerBuildOpts=getObserverBuildOpts();
 
 	if (clSinglePrecision)
 		observerDataSize=observerDefineMap.at(observer).observerDataSizeFloat;
 	else
 		observerDataSize=observerDefineMap.at(observer).observerDataSizeDouble;
+
+	observerColdSize=0;
+	if (observerStateGlobal)
+	{
+		observerColdSize=observerDefineMap.at(observer).observerColdReals * realSize;
+		observerDataSize-=observerColdSize;
+	}
 	dbg_printf("observerDataSize = %d\n",observerDataSize);
 	observerDataSize = observerDataSize + observerDataSize % realSize; //align to a multiple of realsize. is this necessary?
 
@@ -166,6 +212,66 @@ void CLODEfeatures::updateObserverDefineMap()
 	featureNames=observerDefineMap.at(observer).featureNames;
 }
 
+std::string CLODEfeatures::getObserverBuildOpts()
+{
+	std::string opts=" -D" + observerDefineMap.at(observer).define;
+	if (observerStateGlobal)
+		opts+=" -DOBSERVER_STATE_GLOBAL";
+	return opts;
+}
+
+size_t CLODEfeatures::getObserverDataBytes()
+{
+	size_t structBytes = (observerDataSize * nPts + realSize - 1) / realSize * realSize; //same offset as getObserverCold
+	return structBytes + observerColdSize * nPts;
+}
+
+void CLODEfeatures::setObserverStateGlobal(bool newObserverStateGlobal)
+{
+	waitNative();
+	observerStateGlobal = newObserverStateGlobal;
+	updateObserverDefineMap();
+	clInitialized = false;
+}
+
+void CLODEfeatures::setStorageFormat(StorageFormat newFormat, std::vector<cl_double> newFRange)
+{
+	waitNative();
+	if (newFormat == StorageFormat::Quantized16)
+		getQuantizationMaps(newFRange, nFeatures, "F"); //validate now. The feature count may still change with the observer
+
+	storageFormat = newFormat;
+	fRange = newFRange;
+	clInitialized = false;
+}
+
+std::vector<QuantizationMap> CLODEfeatures::getFQuantization()
+{
+	if (storageFormat != StorageFormat::Quantized16)
+		return std::vector<QuantizationMap>();
+	return getQuantizationMaps(fRange, nFeatures, "F");
+}
+
+std::string CLODEfeatures::getStorageDefine()
+{
+	switch (storageFormat)
+	{
+	case StorageFormat::Half:
+		return " -DFEATURE_STORAGE_HALF";
+	case StorageFormat::Quantized16:
+		return " -DFEATURE_STORAGE_Q16" + getQuantizationDefine("FEATURE_Q16", getFQuantization());
+	default:
+		return "";
+	}
+}
+
+void CLODEfeatures::decodeFeatures(const std::vector<cl_ushort> &raw, std::vector<cl_double> &hostF, const std::vector<QuantizationMap> &maps)
+{
+	hostF.resize(raw.size());
+	for (size_t k = 0; k < raw.size(); ++k)
+		hostF[k] = storageFormat == StorageFormat::Half ? halfToDouble(raw[k]) : decodeStored(raw[k], storageFormat, maps[k / nPts]);
+}
+
 //TODO: define an assignment/type cast operator in the struct?
 ObserverParams<cl_float> CLODEfeatures::observerParamsToFloat(ObserverParams<cl_double> op)
 {
@@ -188,11 +294,13 @@ ObserverParams<cl_float> CLODEfeatures::observerParamsToFloat(ObserverParams<cl_
 void CLODEfeatures::resizeFeaturesVariables()
 {
 	size_t currentFelements = nFeatures * nPts;
-	size_t largestAlloc = std::max(nFeatures * realSize, observerDataSize) * nPts;
+	size_t storeSize = getStorageSize(storageFormat);
+	size_t observerPointBytes = observerDataSize + observerColdSize;
+	size_t largestAlloc = std::max(nFeatures * storeSize * nPts, getObserverDataBytes());
 
-	if (largestAlloc > opencl.getMaxMemAllocSize())
+	if (!useNative && largestAlloc > opencl.getMaxMemAllocSize())
 	{
-		int maxNpts = floor(opencl.getMaxMemAllocSize() / (cl_ulong)std::max(nFeatures * realSize, observerDataSize));
+		int maxNpts = floor(opencl.getMaxMemAllocSize() / (cl_ulong)std::max(nFeatures * storeSize, observerPointBytes));
 		printf("nPts is too large, requested memory size exceeds selected device's limit. Maximum nPts appears to be %d \n", maxNpts);
 		throw std::invalid_argument("nPts is too large");
 	}
@@ -204,11 +312,17 @@ void CLODEfeatures::resizeFeaturesVariables()
 		Felements = currentFelements;
 		F.resize(currentFelements);
 
+		if (useNative)
+		{
+			odata.assign((getObserverDataBytes() + sizeof(cl_double) - 1) / sizeof(cl_double), 0.0);
+			return;
+		}
+
 		//resize device variables
 		try
 		{
-			d_odata = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, observerDataSize * nPts, NULL, &opencl.error);
-			d_F = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * currentFelements, NULL, &opencl.error);
+			d_odata = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, getObserverDataBytes(), NULL, &opencl.error);
+			d_F = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, storeSize * currentFelements, NULL, &opencl.error);
 		}
 		catch (cl::Error &er)
 		{
@@ -225,6 +339,7 @@ void CLODEfeatures::resizeFeaturesVariables()
 //
 void CLODEfeatures::initializeObserver()
 {
+	waitNative();
 
 	if (clInitialized)
 	{
@@ -234,23 +349,10 @@ void CLODEfeatures::initializeObserver()
 
 		try
 		{
-			//kernel arguments
-			int ix = 0;
-			cl_initializeObserver.setArg(ix++, d_tspan);
-			cl_initializeObserver.setArg(ix++, d_x0);
-			cl_initializeObserver.setArg(ix++, d_pars);
-			cl_initializeObserver.setArg(ix++, d_sp);
-			cl_initializeObserver.setArg(ix++, d_RNGstate);
-			cl_initializeObserver.setArg(ix++, d_dt);
-			cl_initializeObserver.setArg(ix++, d_odata);
-			cl_initializeObserver.setArg(ix++, d_op);
-
-			//execute the kernel
-			opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_initializeObserver, cl::NullRange, cl::NDRange(nPts));
-			// printf("Enqueue error code: %s\n",CLErrorString(opencl.error).c_str());
-			opencl.error = opencl.getQueue().finish();
+			enqueueInitializeObserver();
+			if (!useNative)
+				opencl.error = opencl.getQueue().finish();
 			// printf("Finish Queue error code: %s\n",CLErrorString(opencl.error).c_str());
-			doObserverInitialization = false;
 		}
 		catch (cl::Error &er)
 		{
@@ -265,17 +367,119 @@ void CLODEfeatures::initializeObserver()
 	}
 }
 
+//set kernel arguments and enqueue initializeObserver without waiting for it
+void CLODEfeatures::enqueueInitializeObserver()
+{
+	if (useNative)
+	{
+		native.runKernel("initializeObserver", {tspan.data(), x0.data(), devPars.data(), &sp, RNGstate.data(), dt.data(), odata.data(), &op}, getGlobalSize());
+		doObserverInitialization = false;
+		return;
+	}
+
+	//kernel arguments
+	int ix = 0;
+	cl_initializeObserver.setArg(ix++, d_tspan);
+	cl_initializeObserver.setArg(ix++, d_x0);
+	cl_initializeObserver.setArg(ix++, d_pars);
+	cl_initializeObserver.setArg(ix++, d_sp);
+	cl_initializeObserver.setArg(ix++, d_RNGstate);
+	cl_initializeObserver.setArg(ix++, d_dt);
+	cl_initializeObserver.setArg(ix++, d_odata);
+	cl_initializeObserver.setArg(ix++, d_op);
+
+	//execute the kernel
+	opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_initializeObserver, cl::NullRange, cl::NDRange(getGlobalSize()));
+	// printf("Enqueue error code: %s\n",CLErrorString(opencl.error).c_str());
+	doObserverInitialization = false;
+}
+
+//transient that also initializes the observer at its end state (setTransientWarmup), so a following features() skips the
+//observer's own warmup integration
+bool CLODEfeatures::transient()
+{
+	waitNative();
+	if (!transientWarmup || simdLanes > 1 || !clInitialized)
+		return CLODE::transient();
+
+	//d_odata depends on nPts
+	resizeFeaturesVariables();
+
+	bool completed;
+	if (useNative)
+	{
+		completed = runChunkedNative("transientObserver", {nullptr, nullptr, devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data(), odata.data(), &op, tspan.data()});
+	}
+	else
+	{
+		try
+		{
+			setTransientObserverArgs();
+			completed = runChunked(cl_transientObserver);
+		}
+		catch (cl::Error &er)
+		{
+			printf("ERROR in CLODEfeatures::transient: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+			throw er;
+		}
+	}
+	doObserverInitialization = !completed; //a cancelled run did not reach the observer initialization
+	dbg_printf("run transient with observer warmup\n");
+	return completed;
+}
+
+std::future<void> CLODEfeatures::transientAsync()
+{
+	if (!transientWarmup || simdLanes > 1 || !clInitialized)
+		return CLODE::transientAsync();
+
+	if (useNative)
+		return nativeAsync([this]() { return transient(); });
+
+	resizeFeaturesVariables();
+
+	try
+	{
+		setTransientObserverArgs();
+		std::future<void> done = enqueueChunksAsync(cl_transientObserver);
+		doObserverInitialization = false; //features enqueued after this run find the observer initialized
+		return done;
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEfeatures::transientAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+}
+
+void CLODEfeatures::setTransientObserverArgs()
+{
+	int ix = 2;
+	cl_transientObserver.setArg(ix++, d_pars);
+	cl_transientObserver.setArg(ix++, d_sp);
+	cl_transientObserver.setArg(ix++, d_xf);
+	cl_transientObserver.setArg(ix++, d_RNGstate);
+	cl_transientObserver.setArg(ix++, d_dt);
+	cl_transientObserver.setArg(ix++, d_stepCount);
+	cl_transientObserver.setArg(ix++, d_tNow);
+	cl_transientObserver.setArg(ix++, d_odata);
+	cl_transientObserver.setArg(ix++, d_op);
+	cl_transientObserver.setArg(ix++, d_tspan);
+}
+
 //overload to allow manual re-initialization of observer data at any time.
-void CLODEfeatures::features(bool newDoObserverInitFlag)
+bool CLODEfeatures::features(bool newDoObserverInitFlag)
 {
+	waitNative();
 	doObserverInitialization = newDoObserverInitFlag;
 
-	features();
+	return features();
 }
 
-void CLODEfeatures::features()
+bool CLODEfeatures::features()
 {
-
+	waitNative();
+	bool completed = false;
 	if (clInitialized)
 	{
 		// printf("do init=%s\n",doObserverInitialization?"true":"false");
@@ -285,44 +489,108 @@ void CLODEfeatures::features()
 		if (doObserverInitialization)
 			initializeObserver();
 
-		try
+		if (useNative)
 		{
-			//kernel arguments
-			int ix = 0;
-			cl_features.setArg(ix++, d_tspan);
-			cl_features.setArg(ix++, d_x0);
-			cl_features.setArg(ix++, d_pars);
-			cl_features.setArg(ix++, d_sp);
-			cl_features.setArg(ix++, d_xf);
-			cl_features.setArg(ix++, d_RNGstate);
-			cl_features.setArg(ix++, d_dt);
-			cl_features.setArg(ix++, d_odata);
-			cl_features.setArg(ix++, d_op);
-			cl_features.setArg(ix++, d_F);
-
-			//execute the kernel
-			opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_features, cl::NullRange, cl::NDRange(nPts));
-			// printf("Enqueue error code: %s\n",CLErrorString(opencl.error).c_str());
-			opencl.error = opencl.getQueue().finish();
-			// printf("Finish Queue error code: %s\n",CLErrorString(opencl.error).c_str());
+			completed = runChunkedNative("features", {nullptr, nullptr, devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data(), odata.data(), &op, F.data(), tspan.data()});
 		}
-		catch (cl::Error &er)
+		else
 		{
-			printf("ERROR in CLODEfeatures::features: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
-			throw er;
+			try
+			{
+				//kernel arguments. tspan and x0 are set per chunk
+				int ix = 2;
+				cl_features.setArg(ix++, d_pars);
+				cl_features.setArg(ix++, d_sp);
+				cl_features.setArg(ix++, d_xf);
+				cl_features.setArg(ix++, d_RNGstate);
+				cl_features.setArg(ix++, d_dt);
+				cl_features.setArg(ix++, d_stepCount);
+				cl_features.setArg(ix++, d_tNow);
+				cl_features.setArg(ix++, d_odata);
+				cl_features.setArg(ix++, d_op);
+				cl_features.setArg(ix++, d_F);
+				cl_features.setArg(ix++, d_tspan);
+
+				//execute the kernel, one launch per chunk. Observer data stays on the device between chunks
+				completed = runChunked(cl_features);
+			}
+			catch (cl::Error &er)
+			{
+				printf("ERROR in CLODEfeatures::features: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+				throw er;
+			}
 		}
+		if (!completed)
+			doObserverInitialization = true; //a cancelled run did not finalize the observer data
 		dbg_printf("run features\n");
 	}
 	else
 	{
 		printf("CLODE has not been initialized\n");
 	}
+	return completed;
 }
 
-std::vector<cl_double> CLODEfeatures::getF()
+//Non-blocking features: observer initialization (if needed) and all chunks are enqueued, then this returns
+std::future<void> CLODEfeatures::featuresAsync()
 {
+	if (!clInitialized)
+		return notInitializedFuture();
 
-	if (clSinglePrecision)
+	if (useNative)
+		return nativeAsync([this]() { return features(); });
+
+	//resize output variables - will only occur if nPts has changed
+	resizeFeaturesVariables();
+
+	try
+	{
+		if (doObserverInitialization)
+			enqueueInitializeObserver();
+
+		//kernel arguments. tspan and x0 are set per chunk
+		int ix = 2;
+		cl_features.setArg(ix++, d_pars);
+		cl_features.setArg(ix++, d_sp);
+		cl_features.setArg(ix++, d_xf);
+		cl_features.setArg(ix++, d_RNGstate);
+		cl_features.setArg(ix++, d_dt);
+		cl_features.setArg(ix++, d_stepCount);
+		cl_features.setArg(ix++, d_tNow);
+		cl_features.setArg(ix++, d_odata);
+		cl_features.setArg(ix++, d_op);
+		cl_features.setArg(ix++, d_F);
+		cl_features.setArg(ix++, d_tspan);
+
+		return enqueueChunksAsync(cl_features);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEfeatures::featuresAsync: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+}
+
+std::future<void> CLODEfeatures::featuresAsync(bool newDoObserverInitFlag)
+{
+	doObserverInitialization = newDoObserverInitFlag;
+
+	return featuresAsync();
+}
+
+std::vector<cl_double> CLODEfeatures::getF()
+{
+	waitNative();
+	if (useNative)
+		return F;
+
+	if (storageFormat != StorageFormat::Real)
+	{ //decode the reduced-precision values
+		std::vector<cl_ushort> FQ(Felements);
+		opencl.error = copy(opencl.getQueue(), d_F, FQ.begin(), FQ.end());
+		decodeFeatures(FQ, F, getFQuantization());
+	}
+	else if (clSinglePrecision)
 	{ //cast back to double
 		std::vector<cl_float> FF(Felements);
 		opencl.error = copy(opencl.getQueue(), d_F, FF.begin(), FF.end());
@@ -335,3 +603,25 @@ std::vector<cl_double> CLODEfeatures::getF()
 
 	return F;
 }
+
+std::future<std::vector<cl_double>> CLODEfeatures::getFAsync()
+{
+	if (useNative)
+		return nativeReadAsync(F);
+	if (storageFormat == StorageFormat::Real)
+		return readBufferAsync(d_F, Felements);
+
+	//reduced precision: raw values arrive, and are decoded on get()
+	std::shared_ptr<std::vector<cl_ushort>> FQ = std::make_shared<std::vector<cl_ushort>>(Felements);
+	cl::Event event;
+	opencl.error = opencl.getQueue().enqueueReadBuffer(d_F, CL_FALSE, 0, sizeof(cl_ushort) * Felements, FQ->data(), NULL, &event);
+	std::shared_future<void> done = eventFuture(event).share();
+	std::vector<QuantizationMap> maps = getFQuantization();
+
+	return std::async(std::launch::deferred, [this, done, FQ, maps]() {
+		done.get();
+		std::vector<cl_double> result;
+		decodeFeatures(*FQ, result, maps);
+		return result;
+	});
+}
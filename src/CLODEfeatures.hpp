@@ -45,14 +45,21 @@ protected:
 
     int nFeatures;
     size_t observerDataSize;
+    size_t observerColdSize; //OBSERVER_STATE_GLOBAL: bytes per point of cold observer fields, stored after the nPts structs
     std::vector<cl_double> F;
     ObserverParams<cl_double> op;
     size_t Felements;
     bool doObserverInitialization = true;
+    bool transientWarmup = false; //transient() also initializes the observer (transientObserver kernel)
+    bool observerStateGlobal = false; //cold observer fields in global memory (OBSERVER_STATE_GLOBAL)
+    StorageFormat storageFormat = StorageFormat::Real; //of F
+    std::vector<cl_double> fRange; //Quantized16: {lo, hi} of each feature
 
     cl::Buffer d_odata, d_op, d_F;
+    std::vector<cl_double> odata; //native backend: observer data structs and cold fields, [getObserverDataBytes()] bytes
     cl::Kernel cl_initializeObserver;
     cl::Kernel cl_features;
+    cl::Kernel cl_transientObserver;
 
     std::string observerBuildOpts;
     std::string observerName;
@@ -60,12 +67,19 @@ protected:
     ObserverParams<cl_float> observerParamsToFloat(ObserverParams<cl_double> op);
 
     std::string getObserverBuildOpts();
+    size_t getObserverDataBytes(); //d_odata: nPts structs, then the cold fields (if any) aligned to realSize
     void updateObserverDefineMap(); // update host variables representing feature detector: nFeatures, featureNames, observerDataSize
     void resizeFeaturesVariables(); //d_odata and d_F depend on nPts. nPts change invalidates d_odata
+    void enqueueInitializeObserver();
+    void setTransientObserverArgs(); //kernel args other than tspan and x0
+    std::string getSimdProgramSource(); //observers in the lane-batched program must precede clODE_simd.cl
+    std::string getStorageDefine();
+    void decodeFeatures(const std::vector<cl_ushort> &raw, std::vector<cl_double> &hostF, const std::vector<QuantizationMap> &maps); //[j*nPts+i] is feature j
 
 public:
     CLODEfeatures(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, OpenCLResource opencl);
     CLODEfeatures(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID);
+    CLODEfeatures(ProblemInfo prob, std::string stepper, std::string observer, NativeResource native); //native CPU backend
     ~CLODEfeatures();
 
     //build program, set all problem data needed to run
@@ -73,13 +87,37 @@ public:
 
     void setObserverParams(ObserverParams<cl_double> newOp);
     void setObserver(std::string newObserver); //rebuild: program, kernel, kernel args. Host + Device data OK
+
+    //reduced-precision device storage of F, decoded to double by getF. Quantized16 needs a [lo, hi] range for each feature of the
+    //observer, flattened {lo0, hi0, lo1, ...}. Not with the native backend. requires buildCL
+    void setStorageFormat(StorageFormat newFormat, std::vector<cl_double> newFRange = std::vector<cl_double>());
+    StorageFormat getStorageFormat() { return storageFormat; };
+    std::vector<QuantizationMap> getFQuantization(); //Quantized16: scale and offset of each feature. Empty otherwise
     
+    //fused warmup: transient() also initializes the observer at its end state, warming up two-pass observers (thresh2, nhood2)
+    //on the transient instead of a separate integration. For the flow transient(); shiftX0(); features(), which then integrates
+    //twice instead of three times. features(true) would discard it. Lane-batched programs (setSimdLanes) run a plain transient
+    void setTransientWarmup(bool newTransientWarmup) { transientWarmup = newTransientWarmup; };
+    bool getTransientWarmup() { return transientWarmup; };
+
+    //observer state in global memory: cold observer fields (trajectory max/min/mean, dt statistics) are kept structure-of-arrays
+    //in d_odata instead of the private copy of the observer struct, shrinking the private state of observers of large systems
+    //(basicall, nhood1, nhood2, thresh2). See observers.cl for the trade-off. Requires buildCL and initialize
+    void setObserverStateGlobal(bool newObserverStateGlobal);
+    bool getObserverStateGlobal() { return observerStateGlobal; };
+
     void buildCL(); // build program and create kernel objects
 
     //simulation routine and overloads
+    bool transient(); //CLODE::transient, or the fused warmup if set. Returns false if cancelled
+    std::future<void> transientAsync();
     void initializeObserver();                           //integrate forward an interval of duration (tf-t0)
-    void features();                           //integrate forward an interval of duration (tf-t0)//integrate forward using stored tspan, x0, pars, and solver pars
-    void features(bool newDoObserverInitFlag); //allow manually forcing re-init of observer data
+    bool features();                           //integrate forward an interval of duration (tf-t0)//integrate forward using stored tspan, x0, pars, and solver pars
+    bool features(bool newDoObserverInitFlag); //allow manually forcing re-init of observer data
+    //features return false if the run was cancelled (or not initialized). F then holds the features of the partial run, and
+    //the next features() re-initializes the observer, as its data was not finalized
+    std::future<void> featuresAsync(); //non-blocking: returns as soon as the kernel(s) are enqueued
+    std::future<void> featuresAsync(bool newDoObserverInitFlag);
     // void features(std::vector<cl_double> newTspan);
     // void features(std::vector<cl_double> newTspan, std::vector<cl_double> newX0);
     // void features(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars);
@@ -91,7 +129,9 @@ public:
 
     //Get functions
     std::string getProgramString();
+    KernelResourceInfo getFeaturesKernelInfo(); //requires buildCL, OpenCL device only
     std::vector<cl_double> getF();
+    std::future<std::vector<cl_double>> getFAsync(); //non-blocking: queued behind any pending runs
     int getNFeatures() { return nFeatures; };
     std::vector<std::string> getFeatureNames(){return featureNames;};
     std::vector<std::string> getAvailableObservers(){return availableObserverNames;};
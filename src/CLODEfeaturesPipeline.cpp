@@ -0,0 +1,298 @@
+#include "CLODEfeaturesPipeline.hpp"
+
+// #define dbg_printf printf
+#define dbg_printf
+#ifdef MATLAB_MEX_FILE
+#include "mex.h"
+#define printf mexPrintf
+#endif
+
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+
+CLODEfeaturesPipeline::CLODEfeaturesPipeline(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, OpenCLResource opencl)
+	: CLODEfeatures(prob, stepper, observer, clSinglePrecision, opencl)
+{
+	dbg_printf("constructor clODEfeaturesPipeline\n");
+}
+
+CLODEfeaturesPipeline::CLODEfeaturesPipeline(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID)
+	: CLODEfeatures(prob, stepper, observer, clSinglePrecision, platformID, deviceID)
+{
+	dbg_printf("constructor clODEfeaturesPipeline\n");
+}
+
+CLODEfeaturesPipeline::~CLODEfeaturesPipeline() {}
+
+void CLODEfeaturesPipeline::setNumBufferSets(int newNSets)
+{
+	if (newNSets == 2 || newNSets == 3)
+		nSets = newNSets;
+	else
+		printf("Warning: number of buffer sets must be 2 or 3. Using %d\n", nSets);
+}
+
+//(re)create the per-batch buffers and the transfer queue for the current nPts
+void CLODEfeaturesPipeline::resizePipelineSets()
+{
+	try
+	{
+		//the sets share the integration buffers (d_xf, d_odata, ...): only an in-order compute queue keeps batches apart
+		if (opencl.getQueue().getInfo<CL_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+		{
+			printf("CLODEfeaturesPipeline needs an in-order compute queue\n");
+			throw std::invalid_argument("CLODEfeaturesPipeline: the compute queue must be in-order");
+		}
+
+		transferQueue = cl::CommandQueue(opencl.getContext(), opencl.getDevice());
+
+		sets.clear();
+		sets.resize(nSets);
+		for (auto &set : sets)
+		{
+			set.d_x0 = cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY, realSize * x0elements, NULL, &opencl.error);
+			set.d_pars = cl::Buffer(opencl.getContext(), CL_MEM_READ_ONLY, realSize * devParselements, NULL, &opencl.error);
+			set.d_F = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, getStorageSize(storageFormat) * Felements, NULL, &opencl.error);
+			set.x0.resize(x0elements);
+			set.pars.resize(parselements);
+			set.F.resize(Felements);
+			if (storageFormat != StorageFormat::Real)
+				set.FQ.resize(Felements);
+			if (clSinglePrecision)
+			{
+				set.x0F.resize(x0elements);
+				set.parsF.resize(devParselements);
+				set.FF.resize(Felements);
+			}
+		}
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEfeaturesPipeline::resizePipelineSets: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	dbg_printf("resize pipeline sets: nSets=%d, nPts=%d\n", nSets, nPts);
+}
+
+//get batch k from the source and write it to its set, once the set's previous batch has finished computing
+void CLODEfeaturesPipeline::enqueueUpload(size_t k, BatchSource &source)
+{
+	PipelineSet &set = sets[k % nSets];
+
+	//host staging is reused: the previous upload from it must be done
+	if (set.uploaded() != NULL)
+		set.uploaded.wait();
+
+	source(k, set.x0, set.pars);
+
+	std::vector<cl::Event> waitFor;
+	if (set.computed() != NULL)
+		waitFor.push_back(set.computed);
+
+	//only the varying parameter columns go to the device. With all parameters uniform, upload a dummy column to keep the event chain
+	const std::vector<cl_double> *devPars = &set.pars;
+	if (!uniformParIx.empty())
+	{
+		packPars(set.pars, set.devPars);
+		if (set.devPars.empty())
+			set.devPars.assign(devParselements, 0.0);
+		devPars = &set.devPars;
+	}
+
+	if (clSinglePrecision)
+	{ //downcast to float if desired
+		set.x0F.assign(set.x0.begin(), set.x0.end());
+		set.parsF.assign(devPars->begin(), devPars->end());
+		opencl.error = transferQueue.enqueueWriteBuffer(set.d_x0, CL_FALSE, 0, realSize * x0elements, set.x0F.data(), &waitFor);
+		opencl.error = transferQueue.enqueueWriteBuffer(set.d_pars, CL_FALSE, 0, realSize * devParselements, set.parsF.data(), &waitFor, &set.uploaded);
+	}
+	else
+	{
+		opencl.error = transferQueue.enqueueWriteBuffer(set.d_x0, CL_FALSE, 0, realSize * x0elements, set.x0.data(), &waitFor);
+		opencl.error = transferQueue.enqueueWriteBuffer(set.d_pars, CL_FALSE, 0, realSize * devParselements, devPars->data(), &waitFor, &set.uploaded);
+	}
+}
+
+//transient (optional), observer initialization and features for batch k on the compute queue. The in-order compute queue
+//serializes batches on d_xf, d_odata, d_dt, d_stepCount and d_tNow; only the set's own buffers are waited for across queues
+void CLODEfeaturesPipeline::enqueueCompute(size_t k)
+{
+	PipelineSet &set = sets[k % nSets];
+
+	//inputs must be uploaded, and the set's previous F downloaded before it is overwritten
+	std::vector<cl::Event> waitFor(1, set.uploaded);
+	if (set.downloaded() != NULL)
+		waitFor.push_back(set.downloaded);
+
+	cl::CommandQueue computeQueue = opencl.getQueue();
+	if (clSinglePrecision)
+		opencl.error = computeQueue.enqueueFillBuffer(d_dt, (cl_float)sp.dt, 0, realSize * nPts, &waitFor);
+	else
+		opencl.error = computeQueue.enqueueFillBuffer(d_dt, (cl_double)sp.dt, 0, realSize * nPts, &waitFor);
+	opencl.error = computeQueue.enqueueFillBuffer(d_stepCount, (cl_int)0, 0, sizeof(cl_int) * nPts);
+	if (clSinglePrecision)
+		opencl.error = computeQueue.enqueueFillBuffer(d_tNow, (cl_float)tspan[0], 0, realSize * nPts);
+	else
+		opencl.error = computeQueue.enqueueFillBuffer(d_tNow, (cl_double)tspan[0], 0, realSize * nPts);
+
+	//features continue from the end of the transient. With the fused warmup, the transient also initializes the observer
+	cl::Buffer featuresX0 = set.d_x0;
+	bool fusedWarmup = doTransient && transientWarmup && simdLanes == 1;
+	if (fusedWarmup)
+	{
+		int ix = 0;
+		cl_transientObserver.setArg(ix++, d_tspan);
+		cl_transientObserver.setArg(ix++, set.d_x0);
+		cl_transientObserver.setArg(ix++, set.d_pars);
+		cl_transientObserver.setArg(ix++, d_sp);
+		cl_transientObserver.setArg(ix++, d_xf);
+		cl_transientObserver.setArg(ix++, d_RNGstate);
+		cl_transientObserver.setArg(ix++, d_dt);
+		cl_transientObserver.setArg(ix++, d_stepCount);
+		cl_transientObserver.setArg(ix++, d_tNow);
+		cl_transientObserver.setArg(ix++, d_odata);
+		cl_transientObserver.setArg(ix++, d_op);
+		cl_transientObserver.setArg(ix++, d_tspan);
+		opencl.error = computeQueue.enqueueNDRangeKernel(cl_transientObserver, cl::NullRange, cl::NDRange(getGlobalSize()));
+		featuresX0 = d_xf;
+	}
+	else if (doTransient)
+	{
+		int ix = 0;
+		cl_transient.setArg(ix++, d_tspan);
+		cl_transient.setArg(ix++, set.d_x0);
+		cl_transient.setArg(ix++, set.d_pars);
+		cl_transient.setArg(ix++, d_sp);
+		cl_transient.setArg(ix++, d_xf);
+		cl_transient.setArg(ix++, d_RNGstate);
+		cl_transient.setArg(ix++, d_dt);
+		cl_transient.setArg(ix++, d_stepCount);
+		cl_transient.setArg(ix++, d_tNow);
+		opencl.error = computeQueue.enqueueNDRangeKernel(cl_transient, cl::NullRange, cl::NDRange(getGlobalSize()));
+		featuresX0 = d_xf;
+	}
+
+	int ix = 0;
+	if (!fusedWarmup)
+	{
+		cl_initializeObserver.setArg(ix++, d_tspan);
+		cl_initializeObserver.setArg(ix++, featuresX0);
+		cl_initializeObserver.setArg(ix++, set.d_pars);
+		cl_initializeObserver.setArg(ix++, d_sp);
+		cl_initializeObserver.setArg(ix++, d_RNGstate);
+		cl_initializeObserver.setArg(ix++, d_dt);
+		cl_initializeObserver.setArg(ix++, d_odata);
+		cl_initializeObserver.setArg(ix++, d_op);
+		opencl.error = computeQueue.enqueueNDRangeKernel(cl_initializeObserver, cl::NullRange, cl::NDRange(getGlobalSize()));
+	}
+
+	//the features run has its own max_steps budget, and starts again at tspan[0]
+	if (doTransient)
+	{
+		opencl.error = computeQueue.enqueueFillBuffer(d_stepCount, (cl_int)0, 0, sizeof(cl_int) * nPts);
+		if (clSinglePrecision)
+			opencl.error = computeQueue.enqueueFillBuffer(d_tNow, (cl_float)tspan[0], 0, realSize * nPts);
+		else
+			opencl.error = computeQueue.enqueueFillBuffer(d_tNow, (cl_double)tspan[0], 0, realSize * nPts);
+	}
+
+	ix = 0;
+	cl_features.setArg(ix++, d_tspan);
+	cl_features.setArg(ix++, featuresX0);
+	cl_features.setArg(ix++, set.d_pars);
+	cl_features.setArg(ix++, d_sp);
+	cl_features.setArg(ix++, d_xf);
+	cl_features.setArg(ix++, d_RNGstate);
+	cl_features.setArg(ix++, d_dt);
+	cl_features.setArg(ix++, d_stepCount);
+	cl_features.setArg(ix++, d_tNow);
+	cl_features.setArg(ix++, d_odata);
+	cl_features.setArg(ix++, d_op);
+	cl_features.setArg(ix++, set.d_F);
+	cl_features.setArg(ix++, d_tspan);
+	opencl.error = computeQueue.enqueueNDRangeKernel(cl_features, cl::NullRange, cl::NDRange(getGlobalSize()), cl::NullRange, NULL, &set.computed);
+}
+
+void CLODEfeaturesPipeline::enqueueDownload(size_t k)
+{
+	PipelineSet &set = sets[k % nSets];
+
+	std::vector<cl::Event> waitFor(1, set.computed);
+	if (storageFormat != StorageFormat::Real)
+		opencl.error = transferQueue.enqueueReadBuffer(set.d_F, CL_FALSE, 0, sizeof(cl_ushort) * Felements, set.FQ.data(), &waitFor, &set.downloaded);
+	else if (clSinglePrecision)
+		opencl.error = transferQueue.enqueueReadBuffer(set.d_F, CL_FALSE, 0, realSize * Felements, set.FF.data(), &waitFor, &set.downloaded);
+	else
+		opencl.error = transferQueue.enqueueReadBuffer(set.d_F, CL_FALSE, 0, realSize * Felements, set.F.data(), &waitFor, &set.downloaded);
+}
+
+void CLODEfeaturesPipeline::deliver(size_t k, BatchSink &sink)
+{
+	PipelineSet &set = sets[k % nSets];
+	set.downloaded.wait();
+
+	if (storageFormat != StorageFormat::Real)
+		decodeFeatures(set.FQ, set.F, getFQuantization());
+	else if (clSinglePrecision) //cast back to double
+		set.F.assign(set.FF.begin(), set.FF.end());
+
+	sink(k, set.F);
+}
+
+//Batch k is uploaded while batch k-1 computes, and downloaded while batch k+1 computes. The host fills the next batch and
+//consumes the previous one's results in the meantime.
+void CLODEfeaturesPipeline::runBatches(size_t nBatches, BatchSource source, BatchSink sink)
+{
+	if (!clInitialized)
+	{
+		printf("CLODE has not been initialized\n");
+		return;
+	}
+	if (nBatches == 0)
+		return;
+	if (!gridAxes.empty())
+		throw std::invalid_argument("CLODEfeaturesPipeline: batches supply their own parameters, clear the parameter grid first");
+
+	resizeFeaturesVariables();
+
+	std::chrono::time_point<std::chrono::steady_clock> start, firstDelivered, end;
+	try
+	{
+		resizePipelineSets();
+
+		start = std::chrono::steady_clock::now();
+		firstDelivered = start;
+
+		enqueueUpload(0, source);
+		for (size_t k = 0; k < nBatches; ++k)
+		{
+			if (k + 1 < nBatches)
+				enqueueUpload(k + 1, source);
+			enqueueCompute(k);
+			enqueueDownload(k);
+			transferQueue.flush();
+			opencl.getQueue().flush();
+
+			if (k > 0)
+			{
+				deliver(k - 1, sink);
+				if (k == 1)
+					firstDelivered = std::chrono::steady_clock::now();
+			}
+		}
+		deliver(nBatches - 1, sink);
+		end = std::chrono::steady_clock::now();
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEfeaturesPipeline::runBatches: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+
+	//steady state: from the first delivery to the last. With one batch, the whole run
+	std::chrono::duration<double> elapsed = nBatches > 1 ? end - firstDelivered : end - start;
+	size_t nTimed = nBatches > 1 ? nBatches - 1 : 1;
+	throughput = nTimed * nPts / std::max(elapsed.count(), 1e-9);
+	dbg_printf("ran %d batches: %g trajectories/s\n", (int)nBatches, throughput);
+}
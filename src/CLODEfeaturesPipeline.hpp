@@ -0,0 +1,76 @@
+/* clODE: a simulator class to run parallel ODE simulations on OpenCL capable hardware.
+ * CLODEfeaturesPipeline runs a stream of parameter batches through CLODEfeatures with uploads, compute and downloads overlapped:
+ * while batch k integrates on the compute queue, batch k+1 uploads and batch k-1 downloads on a separate transfer queue.
+ * Two or three sets of d_x0, d_pars and d_F rotate between the batches. Each batch has the nPts set by initialize().
+ * The working buffers of a batch's integration (d_xf, d_odata, d_dt, d_stepCount, d_tNow, d_RNGstate) are not per set: only the
+ * compute queue touches them, and it runs in order, so batch k+1's kernels start after batch k's features are done.
+ */
+
+//when compiling, be sure to provide the clODE root directory as a define:
+// -DCLODE_ROOT="path/to/my/clODE/"
+
+#ifndef CLODE_FEATURES_PIPELINE_HPP_
+#define CLODE_FEATURES_PIPELINE_HPP_
+
+#include "CLODEfeatures.hpp"
+#include "OpenCLResource.hpp"
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY
+#include "OpenCL/cl2.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//fill x0 [nVar*nPts] and pars [nPar*nPts] for batch k (vectors arrive sized). Columns of parameters set by
+//setUniformPars are not uploaded, so they must hold the compiled-in values
+typedef std::function<void(size_t k, std::vector<cl_double> &x0, std::vector<cl_double> &pars)> BatchSource;
+//receive the features [nFeatures*nPts] of batch k
+typedef std::function<void(size_t k, const std::vector<cl_double> &F)> BatchSink;
+
+class CLODEfeaturesPipeline : public CLODEfeatures
+{
+
+protected:
+    //one rotating set of per-batch device buffers and host staging
+    struct PipelineSet
+    {
+        cl::Buffer d_x0, d_pars, d_F;
+        std::vector<cl_double> x0, pars, F;
+        std::vector<cl_double> devPars; //varying columns of pars, if some parameters are compiled in as uniform
+        std::vector<cl_float> x0F, parsF, FF; //single precision staging
+        std::vector<cl_ushort> FQ; //reduced-precision F (setStorageFormat), decoded at delivery
+        cl::Event uploaded, computed, downloaded;
+        bool inUse = false;
+    };
+
+    int nSets = 2;
+    std::vector<PipelineSet> sets;
+    cl::CommandQueue transferQueue;
+    bool doTransient = true;
+    cl_double throughput = 0;
+
+    void resizePipelineSets();
+    void enqueueUpload(size_t k, BatchSource &source);
+    void enqueueCompute(size_t k);
+    void enqueueDownload(size_t k);
+    void deliver(size_t k, BatchSink &sink);
+
+public:
+    CLODEfeaturesPipeline(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, OpenCLResource opencl);
+    CLODEfeaturesPipeline(ProblemInfo prob, std::string stepper, std::string observer, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID);
+    ~CLODEfeaturesPipeline();
+
+    void setNumBufferSets(int newNSets); //2 (double buffering) or 3
+    void setDoTransient(bool newDoTransient) { doTransient = newDoTransient; }; //run transient over tspan before features on each batch. setTransientWarmup fuses the observer warmup into it
+
+    //process nBatches batches. Observer data is initialized for every batch. Blocks until the last batch is delivered
+    void runBatches(size_t nBatches, BatchSource source, BatchSink sink);
+
+    cl_double getThroughput() { return throughput; }; //steady-state trajectories/second of the last runBatches (excludes pipeline fill)
+};
+
+#endif //CLODE_FEATURES_PIPELINE_HPP_
@@ -0,0 +1,344 @@
+/* clODE: a simulator class to run parallel ODE simulations on OpenCL capable hardware.
+ * CLODEsharded splits the nPts trajectories of a clODE simulator across all devices of an OpenCLResource context.
+ * Each device gets its own solver object (CLODE, CLODEfeatures or CLODEtrajectory) with its own buffers and queue,
+ * created from a single-device view of the shared context. Runs are launched on all devices at once with the async API,
+ * and the share of nPts given to each device follows its measured throughput (trajectories/second).
+ * Outputs are gathered back into the usual single-device layouts: point index fastest, and for CLODEtrajectory the output
+ * layout the shards were set to (setOutputLayout), as a single-device solver with all nPts would store it.
+ */
+
+//TODO: rebalance mid-run (between chunks) - requires moving observer data between devices
+
+//when compiling, be sure to provide the clODE root directory as a define:
+// -DCLODE_ROOT="path/to/my/clODE/"
+
+#ifndef CLODE_SHARDED_HPP_
+#define CLODE_SHARDED_HPP_
+
+#include "CLODE.hpp"
+#include "CLODEtrajectory.hpp"
+#include "OpenCLResource.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+template <class CLODEtype>
+class CLODEsharded
+{
+
+protected:
+    OpenCLResource opencl;
+    std::vector<std::unique_ptr<CLODEtype>> shards; //one solver per device
+    std::vector<cl_int> shardNpts;
+    std::vector<cl_double> throughput; //measured trajectories/second per device (0: not yet measured)
+    std::vector<cl_double> lastRunTime;
+    cl_int nPts = 0;
+
+    //split nPts in proportion to the measured throughput. Equal split until every device has been timed
+    void balance(cl_int newNpts)
+    {
+        size_t nShards = shards.size();
+        if ((size_t)newNpts < nShards)
+            throw std::invalid_argument("nPts must be at least the number of devices");
+
+        bool measured = true;
+        cl_double total = 0;
+        for (size_t d = 0; d < nShards; ++d)
+        {
+            measured = measured && throughput[d] > 0;
+            total += throughput[d];
+        }
+
+        shardNpts.resize(nShards);
+        cl_int remaining = newNpts;
+        for (size_t d = 0; d < nShards - 1; ++d)
+        {
+            cl_double share = measured ? throughput[d] / total : 1.0 / nShards;
+            cl_int n = (cl_int)std::floor(share * newNpts);
+            n = std::max(1, std::min(n, remaining - (cl_int)(nShards - 1 - d))); //leave at least one point for each remaining device
+            shardNpts[d] = n;
+            remaining -= n;
+        }
+        shardNpts[nShards - 1] = remaining;
+        nPts = newNpts;
+    }
+
+    //extract each device's columns from a (rows x nPts) array, point index fastest
+    std::vector<std::vector<cl_double>> scatter(const std::vector<cl_double> &full)
+    {
+        size_t nRows = full.size() / nPts;
+        std::vector<std::vector<cl_double>> parts(shards.size());
+        size_t offset = 0;
+        for (size_t d = 0; d < shards.size(); ++d)
+        {
+            parts[d].resize(nRows * shardNpts[d]);
+            for (size_t row = 0; row < nRows; ++row)
+                std::copy(full.begin() + row * nPts + offset, full.begin() + row * nPts + offset + shardNpts[d], parts[d].begin() + row * shardNpts[d]);
+            offset += shardNpts[d];
+        }
+        return parts;
+    }
+
+    //inverse of scatter
+    template <typename T>
+    std::vector<T> gather(const std::vector<std::vector<T>> &parts)
+    {
+        size_t nRows = parts[0].size() / shardNpts[0];
+        std::vector<T> full(nRows * nPts);
+        size_t offset = 0;
+        for (size_t d = 0; d < shards.size(); ++d)
+        {
+            for (size_t row = 0; row < nRows; ++row)
+                std::copy(parts[d].begin() + row * shardNpts[d], parts[d].begin() + (row + 1) * shardNpts[d], full.begin() + row * nPts + offset);
+            offset += shardNpts[d];
+        }
+        return full;
+    }
+
+    template <typename T>
+    std::vector<T> gatherFrom(std::function<std::vector<T>(CLODEtype &)> get)
+    {
+        std::vector<std::vector<T>> parts;
+        for (auto &shard : shards)
+            parts.push_back(get(*shard));
+        return gather(parts);
+    }
+
+    //position of row r (stored point k, component j: r = k*nElem + j) of trajectory i in a CLODEtrajectory output array of
+    //nRows rows, as CLODEtrajectory::storeIndex. nStoredPts is nPts padded to whole tiles in the tiled layout
+    static size_t trajectoryIndex(TrajectoryLayout layout, cl_int tile, size_t nRows, size_t nStoredPts, size_t i, size_t r)
+    {
+        switch (layout)
+        {
+        case TrajectoryLayout::TrajectoryMajor:
+            return i * nRows + r;
+        case TrajectoryLayout::Tiled:
+            return ((i / tile) * nRows + r) * tile + i % tile;
+        default:
+            return r * nStoredPts + i;
+        }
+    }
+
+    static size_t storedPts(TrajectoryLayout layout, cl_int tile, size_t n)
+    {
+        return layout == TrajectoryLayout::Tiled ? (n + tile - 1) / tile * tile : n;
+    }
+
+    //gather for the stored outputs of CLODEtrajectory (t, x, dx, aux), which are in each shard's output layout: every
+    //trajectory's rows are moved to their place in the layout of shard 0 with all nPts. Padding of the tiled layout stays zero
+    std::vector<cl_double> gatherTrajectory(std::function<std::vector<cl_double>(CLODEtype &)> get)
+    {
+        TrajectoryLayout layout = shards[0]->getOutputLayout();
+        cl_int tile = shards[0]->getTileSize();
+        size_t nFullPts = storedPts(layout, tile, nPts);
+        std::vector<cl_double> full;
+        size_t offset = 0;
+        for (size_t d = 0; d < shards.size(); ++d)
+        {
+            std::vector<cl_double> part = get(*shards[d]);
+            TrajectoryLayout partLayout = shards[d]->getOutputLayout();
+            cl_int partTile = shards[d]->getTileSize();
+            size_t nPartPts = storedPts(partLayout, partTile, shardNpts[d]);
+            size_t nRows = part.size() / nPartPts;
+            if (d == 0)
+                full.assign(nRows * nFullPts, 0);
+            if (nRows * nFullPts != full.size())
+                throw std::invalid_argument("shards store different numbers of points (max_store or store masks differ)");
+
+            for (size_t i = 0; i < (size_t)shardNpts[d]; ++i)
+                for (size_t r = 0; r < nRows; ++r)
+                    full[trajectoryIndex(layout, tile, nRows, nFullPts, offset + i, r)] = part[trajectoryIndex(partLayout, partTile, nRows, nPartPts, i, r)];
+            offset += shardNpts[d];
+        }
+        return full;
+    }
+
+public:
+    //makeShard constructs the solver for one device, e.g.:
+    //  [&](OpenCLResource dev) { return new CLODEfeatures(prob, stepper, observer, clSinglePrecision, dev); }
+    CLODEsharded(OpenCLResource opencl, std::function<CLODEtype *(OpenCLResource)> makeShard) : opencl(opencl)
+    {
+        for (cl_uint d = 0; d < opencl.getNumDevices(); ++d)
+            shards.push_back(std::unique_ptr<CLODEtype>(makeShard(opencl.getDeviceResource(d))));
+
+        throughput.assign(shards.size(), 0);
+        lastRunTime.assign(shards.size(), 0);
+    }
+
+    size_t getNumShards() { return shards.size(); };
+    CLODEtype &getShard(size_t d) { return *shards[d]; };
+    std::vector<cl_int> getShardNpts() { return shardNpts; };
+    std::vector<cl_double> getThroughput() { return throughput; };
+    std::vector<cl_double> getLastRunTime() { return lastRunTime; };
+    cl_int getNpts() { return nPts; };
+
+    //apply a setter to every device's solver, e.g. forEachShard([](CLODEfeatures &c) { c.setStepper("dopri5"); });
+    void forEachShard(std::function<void(CLODEtype &)> f)
+    {
+        for (auto &shard : shards)
+            f(*shard);
+    }
+
+    void buildCL()
+    {
+        forEachShard([](CLODEtype &c) { c.buildCL(); });
+    }
+
+    //extra: any trailing arguments of CLODEtype::initialize, e.g. ObserverParams for CLODEfeatures
+    template <typename... Extra>
+    void initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp, Extra... extra)
+    {
+        balance(newX0.size() / shards[0]->getNvar());
+        std::vector<std::vector<cl_double>> x0parts = scatter(newX0);
+        std::vector<std::vector<cl_double>> parsParts = scatter(newPars);
+        for (size_t d = 0; d < shards.size(); ++d)
+            shards[d]->initialize(newTspan, x0parts[d], parsParts[d], newSp, extra...);
+    }
+
+    //new batch of problem data: the split is recomputed from the latest throughput measurements
+    void setProblemData(std::vector<cl_double> newX0, std::vector<cl_double> newPars)
+    {
+        balance(newX0.size() / shards[0]->getNvar());
+        std::vector<std::vector<cl_double>> x0parts = scatter(newX0);
+        std::vector<std::vector<cl_double>> parsParts = scatter(newPars);
+        for (size_t d = 0; d < shards.size(); ++d)
+            shards[d]->setProblemData(x0parts[d], parsParts[d]);
+    }
+
+    //re-split the current device state according to the latest throughput. Observer data is not carried over
+    void rebalance()
+    {
+        std::vector<cl_double> currentX0 = getX0();
+        std::vector<cl_double> currentPars = gatherFrom<cl_double>([](CLODEtype &c) { return c.getPars(); });
+        setProblemData(currentX0, currentPars);
+    }
+
+    void setTspan(std::vector<cl_double> newTspan)
+    {
+        forEachShard([&](CLODEtype &c) { c.setTspan(newTspan); });
+    }
+
+    void setX0(std::vector<cl_double> newX0)
+    {
+        std::vector<std::vector<cl_double>> parts = scatter(newX0);
+        for (size_t d = 0; d < shards.size(); ++d)
+            shards[d]->setX0(parts[d]);
+    }
+
+    void setPars(std::vector<cl_double> newPars)
+    {
+        std::vector<std::vector<cl_double>> parts = scatter(newPars);
+        for (size_t d = 0; d < shards.size(); ++d)
+            shards[d]->setPars(parts[d]);
+    }
+
+    //launch runAsync on every device at once, wait for all, and update the throughput estimates
+    //e.g. run([](CLODEfeatures &c) { return c.featuresAsync(); });
+    void run(std::function<std::future<void>(CLODEtype &)> runAsync)
+    {
+        std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+        std::vector<std::future<void>> pending;
+        for (auto &shard : shards)
+            pending.push_back(runAsync(*shard));
+
+        //poll so each device's completion time is recorded separately
+        std::vector<bool> done(shards.size(), false);
+        size_t nDone = 0;
+        while (nDone < shards.size())
+        {
+            for (size_t d = 0; d < shards.size(); ++d)
+            {
+                if (!done[d] && pending[d].wait_for(std::chrono::milliseconds(1)) == std::future_status::ready)
+                {
+                    pending[d].get(); //rethrows any error from the device
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    lastRunTime[d] = elapsed.count();
+                    done[d] = true;
+                    ++nDone;
+                }
+            }
+        }
+
+        //exponential smoothing of the per-device throughput
+        for (size_t d = 0; d < shards.size(); ++d)
+        {
+            cl_double rate = shardNpts[d] / std::max(lastRunTime[d], 1e-6);
+            throughput[d] = throughput[d] > 0 ? 0.5 * throughput[d] + 0.5 * rate : rate;
+        }
+    }
+
+    void transient()
+    {
+        run([](CLODEtype &c) { return c.transientAsync(); });
+    }
+
+    void shiftX0()
+    {
+        forEachShard([](CLODEtype &c) { c.shiftX0(); });
+    }
+
+    //gathered outputs, in the same layout a single-device solver with all nPts would produce
+    std::vector<cl_double> getX0()
+    {
+        return gatherFrom<cl_double>([](CLODEtype &c) { return c.getX0(); });
+    }
+
+    std::vector<cl_double> getXf()
+    {
+        return gatherFrom<cl_double>([](CLODEtype &c) { return c.getXf(); });
+    }
+
+    //CLODEfeatures only
+    void features()
+    {
+        run([](CLODEtype &c) { return c.featuresAsync(); });
+    }
+
+    std::vector<cl_double> getF()
+    {
+        return gatherFrom<cl_double>([](CLODEtype &c) { return c.getF(); });
+    }
+
+    //CLODEtrajectory only
+    void trajectory()
+    {
+        run([](CLODEtype &c) { return c.trajectoryAsync(); });
+    }
+
+    //in store-at-times mode every shard stores at the same output times: those are returned as they are
+    std::vector<cl_double> getT()
+    {
+        if (!shards[0]->getStoreTimes().empty())
+            return shards[0]->getT();
+        return gatherTrajectory([](CLODEtype &c) { return c.getT(); });
+    }
+
+    std::vector<cl_double> getX()
+    {
+        return gatherTrajectory([](CLODEtype &c) { return c.getX(); });
+    }
+
+    std::vector<cl_double> getDx()
+    {
+        return gatherTrajectory([](CLODEtype &c) { return c.getDx(); });
+    }
+
+    std::vector<cl_double> getAux()
+    {
+        return gatherTrajectory([](CLODEtype &c) { return c.getAux(); });
+    }
+
+    std::vector<cl_int> getNstored()
+    {
+        return gatherFrom<cl_int>([](CLODEtype &c) { return c.getNstored(); });
+    }
+};
+
+#endif //CLODE_SHARDED_HPP_
@@ -9,6 +9,8 @@
 
 #include <algorithm> //std::max
 #include <cmath>
+#include <fstream>
+#include <memory>
 #include <stdexcept>
 #include <stdio.h>
 
@@ -18,7 +20,7 @@ CLODEtrajectory::CLODEtrajectory(ProblemInfo prob, std::string stepper, bool clS
 
 	//printf("\nCLODE has been specialized: CLODEtrajectory\n");
 
-	clprogramstring += read_file(clodeRoot + "trajectory.cl");
+	clprogramstring += getKernelSource("trajectory.cl");
 	dbg_printf("constructor clODEtrajectory\n");
 }
 
@@ -28,23 +30,43 @@ CLODEtrajectory::CLODEtrajectory(ProblemInfo prob, std::string stepper, bool clS
 
 	//printf("\nCLODE has been specialized: CLODEtrajectory\n");
 
-	clprogramstring += read_file(clodeRoot + "trajectory.cl");
+	clprogramstring += getKernelSource("trajectory.cl");
 	dbg_printf("constructor clODEtrajectory\n");
 }
 
+CLODEtrajectory::CLODEtrajectory(ProblemInfo prob, std::string stepper, NativeResource native)
+	: CLODE(prob, stepper, native), nStoreMax(0)
+{
+	clprogramstring += getKernelSource("trajectory.cl");
+	dbg_printf("constructor clODEtrajectory (native)\n");
+}
+
 CLODEtrajectory::~CLODEtrajectory() {}
 
+std::string CLODEtrajectory::getSimdProgramSource()
+{
+	return getKernelSource("transient_simd.cl") + getKernelSource("trajectory_simd.cl");
+}
+
 
 // build program and create kernel objects. requires host variables to be set
 void CLODEtrajectory::buildCL()
 {
-	buildProgram();
+	waitNative();
+	if (streamSink && !tStore.empty())
+		throw std::invalid_argument("streaming is not supported in store-at-times mode");
+	checkStorageFormat(storageFormat);
+
+	buildProgram(getOutputLayoutDefine() + getStoreMaskDefine() + getStorageDefine() + (tStore.empty() ? "" : " -DTRAJ_STORE_AT_TIMES") + (streamSink ? " -DTRAJ_STREAM" : ""));
 
 	//set up the kernels
 	try
 	{
-		cl_transient = cl::Kernel(opencl.getProgram(), "transient", &opencl.error);
-		cl_trajectory = cl::Kernel(opencl.getProgram(), "trajectory", &opencl.error);
+		if (!useNative)
+		{
+			cl_transient = cl::Kernel(opencl.getProgram(), "transient", &opencl.error);
+			cl_trajectory = cl::Kernel(opencl.getProgram(), "trajectory", &opencl.error);
+		}
 
 		// size_t preferred_multiple;
 		// cl::Device dev;
@@ -61,9 +83,253 @@ void CLODEtrajectory::buildCL()
 	dbg_printf("initialize trajectory kernel\n");
 }
 
+void CLODEtrajectory::setOutputLayout(TrajectoryLayout newLayout, cl_int newTileSize)
+{
+	waitNative();
+	if (newTileSize < 1)
+		throw std::invalid_argument("tile size must be positive");
+
+	layout = newLayout;
+	tileSize = newTileSize;
+	clInitialized = false;
+}
+
+std::string CLODEtrajectory::getOutputLayoutDefine()
+{
+	switch (layout)
+	{
+	case TrajectoryLayout::TrajectoryMajor:
+		return " -DTRAJ_LAYOUT_TRAJECTORY_MAJOR";
+	case TrajectoryLayout::Tiled:
+		return " -DTRAJ_TILE=" + std::to_string((long long)tileSize);
+	default:
+		return "";
+	}
+}
+
+//validates the index list of one mask
+static void checkStoreMask(const std::vector<cl_int> &ix, cl_int n, const char *name)
+{
+	for (cl_int j : ix)
+		if (j < 0 || j >= n)
+		{
+			printf("Invalid %s store index %d (must be in [0, %d))\n", name, j, n);
+			throw std::invalid_argument("store mask index out of range");
+		}
+}
+
+void CLODEtrajectory::setStoreMasks(std::vector<cl_int> newXIx, std::vector<cl_int> newDxIx, std::vector<cl_int> newAuxIx)
+{
+	waitNative();
+	checkStoreMask(newXIx, nVar, "x");
+	checkStoreMask(newDxIx, nVar, "dx");
+	checkStoreMask(newAuxIx, nAux, "aux");
+
+	storeXIx = newXIx;
+	storeDxIx = newDxIx;
+	storeAuxIx = newAuxIx;
+	storeAll = false;
+	clInitialized = false;
+}
+
+void CLODEtrajectory::clearStoreMasks()
+{
+	waitNative();
+	storeAll = true;
+	clInitialized = false;
+}
+
+static std::vector<cl_int> allComponents(cl_int n)
+{
+	std::vector<cl_int> ix(n);
+	for (cl_int j = 0; j < n; ++j)
+		ix[j] = j;
+	return ix;
+}
+
+std::vector<cl_int> CLODEtrajectory::getStoredXIx()
+{
+	return storeAll ? allComponents(nVar) : storeXIx;
+}
+
+std::vector<cl_int> CLODEtrajectory::getStoredDxIx()
+{
+	return storeAll ? allComponents(nVar) : storeDxIx;
+}
+
+std::vector<cl_int> CLODEtrajectory::getStoredAuxIx()
+{
+	return storeAll ? allComponents(nAux) : storeAuxIx;
+}
+
+//count and index list of each mask, e.g. " -DN_STORE_X=2 -DSTORE_X_IX=0,3". Nothing for a mask that stores everything
+std::string CLODEtrajectory::getStoreMaskDefine()
+{
+	if (storeAll)
+		return "";
+
+	//the problem may have changed since the masks were set
+	checkStoreMask(storeXIx, nVar, "x");
+	checkStoreMask(storeDxIx, nVar, "dx");
+	checkStoreMask(storeAuxIx, nAux, "aux");
+
+	std::string define;
+	const std::vector<cl_int> *masks[] = {&storeXIx, &storeDxIx, &storeAuxIx};
+	const char *names[] = {"X", "DX", "AUX"};
+	for (int m = 0; m < 3; ++m)
+	{
+		const std::vector<cl_int> &ix = *masks[m];
+		if (ix == allComponents(m == 2 ? nAux : nVar))
+			continue;
+
+		define += " -DN_STORE_" + std::string(names[m]) + "=" + std::to_string((long long)ix.size());
+		if (!ix.empty())
+		{
+			define += " -DSTORE_" + std::string(names[m]) + "_IX=";
+			for (size_t j = 0; j < ix.size(); ++j)
+				define += (j > 0 ? "," : "") + std::to_string((long long)ix[j]);
+		}
+	}
+	return define;
+}
+
+void CLODEtrajectory::setStorageFormat(StorageFormat newFormat, std::vector<cl_double> newXRange, std::vector<cl_double> newDxRange, std::vector<cl_double> newAuxRange)
+{
+	waitNative();
+	if (newFormat == StorageFormat::Quantized16)
+	{ //validate now, the maps are made at build time for the precision in use
+		getQuantizationMaps(newXRange, nVar, "x");
+		getQuantizationMaps(newDxRange, nVar, "dx");
+		getQuantizationMaps(newAuxRange, nAux, "aux");
+	}
+
+	storageFormat = newFormat;
+	xRange = newXRange;
+	dxRange = newDxRange;
+	auxRange = newAuxRange;
+	clInitialized = false;
+}
+
+//-DTRAJ_STORAGE_HALF, or -DTRAJ_STORAGE_Q16 with the maps of all variables (the kernels index them by variable, through the masks)
+std::string CLODEtrajectory::getStorageDefine()
+{
+	switch (storageFormat)
+	{
+	case StorageFormat::Half:
+		return " -DTRAJ_STORAGE_HALF";
+	case StorageFormat::Quantized16:
+		return " -DTRAJ_STORAGE_Q16" + getQuantizationDefine("TRAJ_Q16_X", getQuantizationMaps(xRange, nVar, "x")) +
+			   getQuantizationDefine("TRAJ_Q16_DX", getQuantizationMaps(dxRange, nVar, "dx")) + getQuantizationDefine("TRAJ_Q16_AUX", getQuantizationMaps(auxRange, nAux, "aux"));
+	default:
+		return "";
+	}
+}
+
+std::vector<QuantizationMap> CLODEtrajectory::getStoredQuantization(const std::vector<cl_double> &ranges, const std::vector<cl_int> &storedIx, cl_int n, const char *name)
+{
+	std::vector<QuantizationMap> maps;
+	if (storageFormat != StorageFormat::Quantized16)
+		return maps;
+
+	std::vector<QuantizationMap> all = getQuantizationMaps(ranges, n, name);
+	for (cl_int j : storedIx)
+		maps.push_back(all[j]);
+	return maps;
+}
+
+std::vector<QuantizationMap> CLODEtrajectory::getXQuantization()
+{
+	return getStoredQuantization(xRange, getStoredXIx(), nVar, "x");
+}
+
+std::vector<QuantizationMap> CLODEtrajectory::getDxQuantization()
+{
+	return getStoredQuantization(dxRange, getStoredDxIx(), nVar, "dx");
+}
+
+std::vector<QuantizationMap> CLODEtrajectory::getAuxQuantization()
+{
+	return getStoredQuantization(auxRange, getStoredAuxIx(), nAux, "aux");
+}
+
+void CLODEtrajectory::setStoreTimes(std::vector<cl_double> newTStore)
+{
+	waitNative();
+	for (size_t k = 1; k < newTStore.size(); ++k)
+		if (newTStore[k] < newTStore[k - 1])
+		{
+			printf("Invalid output times: t[%d]=%g < t[%d]=%g\n", (int)k, newTStore[k], (int)k - 1, newTStore[k - 1]);
+			throw std::invalid_argument("output times must be in ascending order");
+		}
+
+	tStore = newTStore;
+	clInitialized = false;
+}
+
+void CLODEtrajectory::setStreaming(TrajectorySink sink)
+{
+	waitNative();
+	streamSink = sink;
+	clInitialized = false;
+}
+
+//binary file sink: for each trajectory with new points, int32 {index, first, count}, then count t values, count*nX x values,
+//count*nDx dx values and count*nAux aux values, point-major, as doubles
+TrajectorySink CLODEtrajectory::fileSink(std::string filename)
+{
+	std::shared_ptr<std::ofstream> file = std::make_shared<std::ofstream>(filename, std::ios::binary | std::ios::trunc);
+	if (!file->is_open())
+	{
+		printf("Could not open %s for writing\n", filename.c_str());
+		throw std::invalid_argument("could not open trajectory file");
+	}
+
+	return [file](const TrajectorySegment &segment) {
+		for (size_t i = 0; i < segment.count.size(); ++i)
+		{
+			if (segment.count[i] == 0)
+				continue;
+
+			size_t o = segment.offset[i], n = segment.count[i];
+			cl_int header[3] = {(cl_int)i, segment.first[i], segment.count[i]};
+			file->write((const char *)header, sizeof(header));
+			file->write((const char *)&segment.t[o], n * sizeof(cl_double));
+			if (segment.nX > 0)
+				file->write((const char *)&segment.x[o * segment.nX], n * segment.nX * sizeof(cl_double));
+			if (segment.nDx > 0)
+				file->write((const char *)&segment.dx[o * segment.nDx], n * segment.nDx * sizeof(cl_double));
+			if (segment.nAux > 0)
+				file->write((const char *)&segment.aux[o * segment.nAux], n * segment.nAux * sizeof(cl_double));
+		}
+		file->flush();
+	};
+}
+
+cl_int CLODEtrajectory::getStoredPts()
+{
+	return layout == TrajectoryLayout::Tiled ? (nPts + tileSize - 1) / tileSize * tileSize : nPts;
+}
+
+size_t CLODEtrajectory::storeIndex(cl_int storeix, cl_int j, cl_int nElem, cl_int i)
+{
+	if (streamSink)
+		storeix %= nStoreMax;
+
+	switch (layout)
+	{
+	case TrajectoryLayout::TrajectoryMajor:
+		return ((size_t)i * nStoreMax + storeix) * nElem + j;
+	case TrajectoryLayout::Tiled:
+		return (((size_t)(i / tileSize) * nStoreMax + storeix) * nElem + j) * tileSize + i % tileSize;
+	default:
+		return ((size_t)storeix * nElem + j) * nPts + i;
+	}
+}
+
 //initialize everything
 void CLODEtrajectory::initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp)
 {
+	waitNative();
 
 	clInitialized = false;
 
@@ -80,6 +346,19 @@ void CLODEtrajectory::initialize(std::vector<cl_double> newTspan, std::vector<cl
 void CLODEtrajectory::resizeTrajectoryVariables()
 {
 
+	//store-at-times: one stored point per output time. The kernel reads the count from max_store
+	if (!tStore.empty() && sp.max_store != (cl_int)tStore.size())
+	{
+		SolverParams<cl_double> newSp = sp;
+		newSp.max_store = tStore.size();
+		setSolverParams(newSp);
+	}
+	if (!tStore.empty() && tStore[0] < tspan[0])
+	{
+		printf("Invalid output times: t[0]=%g is before tspan[0]=%g\n", tStore[0], tspan[0]);
+		throw std::invalid_argument("output times must not precede tspan[0]");
+	}
+
 	int currentStoreAlloc = sp.max_store; //TODO: always alloc sp.max_store? or try to compute something?
 	//catch any changes to tspan, dt, or nout:
 	// int currentStoreAlloc=(tspan[1]-tspan[0])/(sp.dt*sp.nout)+1;
@@ -90,41 +369,64 @@ void CLODEtrajectory::resizeTrajectoryVariables()
 	//~ }
 
 	//check largest desired memory chunk against device's maximum allowable variable size
-	size_t largestAlloc = std::max(1 /*t*/, std::max(nVar /*x, dx*/, nAux /*aux*/)) * nPts * currentStoreAlloc * realSize;
-
-	if (largestAlloc > opencl.getMaxMemAllocSize())
+	//only the components selected by the store masks are allocated
+	//x, dx and aux are in the storage format (2 bytes per value when reduced), t is realtype
+	cl_int nStoreX = getStoredXIx().size(), nStoreDx = getStoredDxIx().size(), nStoreAux = getStoredAuxIx().size();
+	cl_int nLargest = std::max(nStoreX, std::max(nStoreDx, nStoreAux));
+	size_t storeSize = getStorageSize(storageFormat);
+	size_t largestPointSize = std::max(realSize /*t*/, nLargest * storeSize);
+	size_t largestAlloc = largestPointSize * getStoredPts() * currentStoreAlloc;
+
+	if (!useNative && largestAlloc > opencl.getMaxMemAllocSize())
 	{
-		int estimatedMaxStoreAlloc = std::floor(opencl.getMaxMemAllocSize() / (std::max(1, std::max(nVar, nAux)) * nPts * realSize));
-		printf("ERROR: storage requested exceeds device maximum variable size. Reason: %s. Try reducing storage to <%d time points, or reducing nPts. \n", nAux > nVar ? "aux vars" : "state vars", estimatedMaxStoreAlloc);
-		throw std::invalid_argument("nPts*nStoreMax*nVar*realSize or nPts*nStoreMax*nAux*realSize is too big");
+		int estimatedMaxStoreAlloc = std::floor(opencl.getMaxMemAllocSize() / (largestPointSize * getStoredPts()));
+		printf("ERROR: storage requested exceeds device maximum variable size. Reason: %s. Try reducing storage to <%d time points, reducing nPts, or storing fewer components. \n", nLargest == nStoreAux ? "aux vars" : "state vars", estimatedMaxStoreAlloc);
+		throw std::invalid_argument("nPts*nStoreMax*nStoredComponents*realSize is too big");
 	}
 
-	size_t currentTelements = currentStoreAlloc * nPts;
+	size_t currentPtsElements = (size_t)currentStoreAlloc * getStoredPts();
+	size_t currentTelements = tStore.empty() ? currentPtsElements : tStore.size(); //output times are shared by all trajectories
 
 	//only resize device variables if size changed, or if not yet initialized
-	if (!clInitialized || nStoreMax != currentStoreAlloc || telements != currentTelements)
+	if (!clInitialized || nStoreMax != currentStoreAlloc || telements != currentTelements || xelements != nStoreX * currentPtsElements || dxelements != nStoreDx * currentPtsElements || auxelements != nStoreAux * currentPtsElements)
 	{
 
 		nStoreMax = currentStoreAlloc;
 		telements = currentTelements;
-		xelements = nVar * currentTelements;
-		auxelements = nAux * currentTelements;
-
-		t.resize(telements);
+		xelements = nStoreX * currentPtsElements;
+		dxelements = nStoreDx * currentPtsElements;
+		auxelements = nStoreAux * currentPtsElements;
+
+		if (tStore.empty())
+			t.resize(telements);
+		else
+			t = tStore;
 		x.resize(xelements);
-		dx.resize(xelements);
+		dx.resize(dxelements);
 		aux.resize(auxelements);
 		nStored.resize(nPts);
+		if (useNative)
+			return;
 
 		//resize device variables
 		try
 		{
 			//trajectory
-			d_t = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * telements, NULL, &opencl.error);
-			d_x = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * xelements, NULL, &opencl.error);
-			d_dx = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * xelements, NULL, &opencl.error);
-			d_aux = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, realSize * auxelements, NULL, &opencl.error);
-			d_nStored = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, sizeof(int) * nPts, NULL, &opencl.error);
+			d_t = cl::Buffer(opencl.getContext(), tStore.empty() ? CL_MEM_WRITE_ONLY : CL_MEM_READ_ONLY, realSize * telements, NULL, &opencl.error);
+			d_x = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, storeSize * std::max(xelements, (size_t)1), NULL, &opencl.error); //empty masks still need a valid buffer
+			d_dx = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, storeSize * std::max(dxelements, (size_t)1), NULL, &opencl.error);
+			d_aux = cl::Buffer(opencl.getContext(), CL_MEM_WRITE_ONLY, storeSize * std::max(auxelements, (size_t)1), NULL, &opencl.error);
+			d_nStored = cl::Buffer(opencl.getContext(), CL_MEM_READ_WRITE, sizeof(int) * nPts, NULL, &opencl.error);
+
+			if (!tStore.empty() && clSinglePrecision)
+			{
+				std::vector<cl_float> tStoreF(tStore.begin(), tStore.end());
+				opencl.error = opencl.getQueue().enqueueWriteBuffer(d_t, CL_TRUE, 0, realSize * telements, tStoreF.data());
+			}
+			else if (!tStore.empty())
+			{
+				opencl.error = opencl.getQueue().enqueueWriteBuffer(d_t, CL_TRUE, 0, realSize * telements, tStore.data());
+			}
 		}
 		catch (cl::Error &er)
 		{
@@ -136,33 +438,43 @@ void CLODEtrajectory::resizeTrajectoryVariables()
 }
 
 //Simulation routine
-void CLODEtrajectory::trajectory()
+bool CLODEtrajectory::trajectory()
 {
+	waitNative();
+	bool completed = false;
 	if (clInitialized)
 	{
 		//resize output variables - will only occur if nPts or nSteps has changed [~4ms overhead on Tornado]
 		resizeTrajectoryVariables();
 
+		if (useNative && streamSink)
+			return runStreamed();
+		if (useNative)
+			return runChunkedNative("trajectory", {nullptr, nullptr, devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data(), t.data(), x.data(), dx.data(), aux.data(), nStored.data(), tspan.data()});
+
 		try
 		{
-			//kernel arguments
-			int ix = 0;
-			cl_trajectory.setArg(ix++, d_tspan);
-			cl_trajectory.setArg(ix++, d_x0);
+			//kernel arguments. tspan and x0 are set per chunk
+			int ix = 2;
 			cl_trajectory.setArg(ix++, d_pars);
 			cl_trajectory.setArg(ix++, d_sp);
 			cl_trajectory.setArg(ix++, d_xf);
 			cl_trajectory.setArg(ix++, d_RNGstate);
 			cl_trajectory.setArg(ix++, d_dt);
+			cl_trajectory.setArg(ix++, d_stepCount);
+			cl_trajectory.setArg(ix++, d_tNow);
 			cl_trajectory.setArg(ix++, d_t);
 			cl_trajectory.setArg(ix++, d_x);
 			cl_trajectory.setArg(ix++, d_dx);
 			cl_trajectory.setArg(ix++, d_aux);
 			cl_trajectory.setArg(ix++, d_nStored);
+			cl_trajectory.setArg(ix++, d_tspan);
 
-			//execute the kernel
-			opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_trajectory, cl::NullRange, cl::NDRange(nPts));
-			opencl.getQueue().finish();
+			//execute the kernel, one launch per chunk. Each chunk appends to the stored trajectory
+			if (streamSink)
+				completed = runStreamed();
+			else
+				completed = runChunked(cl_trajectory);
 		}
 		catch (cl::Error &er)
 		{
@@ -175,10 +487,238 @@ void CLODEtrajectory::trajectory()
 	{
 		printf("CLODE has not been initialized\n");
 	}
+	return completed;
+}
+
+//streaming run: the chunks of runChunked, each launched until no trajectory stopped early with a full ring. Kernel args other
+//than tspan and x0 are already set (OpenCL). The rings are drained to the sink after every launch
+bool CLODEtrajectory::runStreamed()
+{
+	resetChunkState();
+	if (useNative)
+		chunkEdges = getChunkEdges();
+	else
+		setChunkTspans();
+	size_t nChunks = chunkEdges.size() - 1;
+
+	//nothing stored yet. resetChunkState put every trajectory at tspan[0]
+	std::vector<cl_int> drained(nPts, -1);
+	nStored.assign(nPts, -1);
+	if (!useNative)
+		opencl.error = opencl.getQueue().enqueueWriteBuffer(d_nStored, CL_TRUE, 0, sizeof(cl_int) * nPts, nStored.data());
+
+	bool firstLaunch = true;
+	for (size_t k = 0; k < nChunks; ++k)
+	{
+		bool ringFull = true;
+		while (ringFull)
+		{
+			if (useNative)
+			{
+				std::vector<cl_double> tchunk({chunkEdges[k], chunkEdges[k + 1]});
+				native.runKernel("trajectory", {tchunk.data(), firstLaunch ? x0.data() : xf.data(), devPars.data(), &sp, xf.data(), RNGstate.data(), dt.data(), stepCount.data(), tNow.data(), t.data(), x.data(), dx.data(), aux.data(), nStored.data(), tspan.data()}, getGlobalSize());
+			}
+			else
+			{
+				cl_trajectory.setArg(0, chunkTspans[k]);
+				cl_trajectory.setArg(1, firstLaunch ? d_x0 : d_xf);
+				opencl.error = opencl.getQueue().enqueueNDRangeKernel(cl_trajectory, cl::NullRange, cl::NDRange(getGlobalSize()));
+				opencl.error = opencl.getQueue().finish();
+			}
+			firstLaunch = false;
+			ringFull = drainStream(drained, chunkEdges[k + 1]);
+
+			if (cancelToken.isCancelled() && (ringFull || k < nChunks - 1))
+			{
+				printf("Run cancelled in chunk [%g, %g] of tspan=[%g, %g]\n", chunkEdges[k], chunkEdges[k + 1], chunkEdges[0], chunkEdges[nChunks]);
+				return false;
+			}
+		}
+
+		if (progressCallback)
+			progressCallback(getChunkFraction(k));
+		dbg_printf("run chunk %d of %d (streaming)\n", (int)k + 1, (int)nChunks);
+	}
+	return true;
+}
+
+//hand the points stored since the last drain to the sink. Returns true if a trajectory filled its ring before tEnd
+bool CLODEtrajectory::drainStream(std::vector<cl_int> &drained, cl_double tEnd)
+{
+	if (!useNative)
+	{
+		opencl.error = copy(opencl.getQueue(), d_nStored, nStored.begin(), nStored.end());
+		readToHost(d_tNow, tNow);
+		readToHost(d_t, t);
+		readStoredToHost(d_x, x, getXQuantization());
+		readStoredToHost(d_dx, dx, getDxQuantization());
+		readStoredToHost(d_aux, aux, getAuxQuantization());
+	}
+
+	TrajectorySegment segment;
+	segment.nX = getStoredXIx().size();
+	segment.nDx = getStoredDxIx().size();
+	segment.nAux = getStoredAuxIx().size();
+	segment.first.resize(nPts);
+	segment.count.resize(nPts);
+	segment.offset.resize(nPts);
+
+	size_t nPoints = 0;
+	bool ringFull = false;
+	for (cl_int i = 0; i < nPts; ++i)
+	{
+		segment.first[i] = drained[i] + 1;
+		segment.count[i] = nStored[i] - drained[i];
+		segment.offset[i] = nPoints;
+		nPoints += segment.count[i];
+		ringFull = ringFull || (segment.count[i] == nStoreMax && tNow[i] < tEnd);
+	}
+
+	segment.t.resize(nPoints);
+	segment.x.resize(nPoints * segment.nX);
+	segment.dx.resize(nPoints * segment.nDx);
+	segment.aux.resize(nPoints * segment.nAux);
+	for (cl_int i = 0; i < nPts; ++i)
+	{
+		for (cl_int k = 0; k < segment.count[i]; ++k)
+		{
+			size_t row = segment.offset[i] + k;
+			cl_int storeix = segment.first[i] + k;
+			segment.t[row] = t[storeIndex(storeix, 0, 1, i)];
+			for (cl_int j = 0; j < segment.nX; ++j)
+				segment.x[row * segment.nX + j] = x[storeIndex(storeix, j, segment.nX, i)];
+			for (cl_int j = 0; j < segment.nDx; ++j)
+				segment.dx[row * segment.nDx + j] = dx[storeIndex(storeix, j, segment.nDx, i)];
+			for (cl_int j = 0; j < segment.nAux; ++j)
+				segment.aux[row * segment.nAux + j] = aux[storeIndex(storeix, j, segment.nAux, i)];
+		}
+	}
+
+	drained = nStored;
+	streamSink(segment);
+	return ringFull;
+}
+
+void CLODEtrajectory::readToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData)
+{
+	if (hostData.empty())
+		return;
+
+	if (clSinglePrecision)
+	{
+		std::vector<cl_float> dataF(hostData.size());
+		opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, 0, realSize * dataF.size(), dataF.data());
+		hostData.assign(dataF.begin(), dataF.end());
+	}
+	else
+	{
+		opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, 0, realSize * hostData.size(), hostData.data());
+	}
+}
+
+//x, dx or aux buffer to hostData (hostData.size() values), decoded from the storage format
+void CLODEtrajectory::readStoredToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData, const std::vector<QuantizationMap> &maps)
+{
+	if (storageFormat == StorageFormat::Real)
+	{
+		readToHost(buffer, hostData);
+		return;
+	}
+	if (hostData.empty())
+		return;
+
+	std::vector<cl_ushort> raw(hostData.size());
+	opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(cl_ushort) * raw.size(), raw.data());
+	decodeTrajectory(raw, hostData, maps);
+}
+
+//Half decodes value by value. Quantized16 maps are per stored component, so the layout is walked with storeIndex
+void CLODEtrajectory::decodeTrajectory(const std::vector<cl_ushort> &raw, std::vector<cl_double> &hostData, const std::vector<QuantizationMap> &maps)
+{
+	if (storageFormat == StorageFormat::Half)
+	{
+		for (size_t k = 0; k < raw.size(); ++k)
+			hostData[k] = halfToDouble(raw[k]);
+		return;
+	}
+
+	cl_int nElem = maps.size(), storedPts = getStoredPts();
+	for (cl_int k = 0; k < nStoreMax; ++k)
+		for (cl_int j = 0; j < nElem; ++j)
+			for (cl_int i = 0; i < storedPts; ++i)
+			{
+				size_t ix = storeIndex(k, j, nElem, i);
+				hostData[ix] = decodeStored(raw[ix], storageFormat, maps[j]);
+			}
+}
+
+//non-blocking read of x, dx or aux in a reduced storage format: raw values arrive, and are decoded on get()
+std::future<std::vector<cl_double>> CLODEtrajectory::readStoredAsync(cl::Buffer &buffer, size_t nElements, std::vector<QuantizationMap> maps)
+{
+	if (storageFormat == StorageFormat::Real)
+		return readBufferAsync(buffer, nElements);
+
+	std::shared_ptr<std::vector<cl_ushort>> raw = std::make_shared<std::vector<cl_ushort>>(nElements);
+	cl::Event event;
+	opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_FALSE, 0, sizeof(cl_ushort) * nElements, raw->data(), NULL, &event);
+	std::shared_future<void> done = eventFuture(event).share();
+
+	return std::async(std::launch::deferred, [this, done, raw, maps]() {
+		done.get();
+		std::vector<cl_double> result(raw->size());
+		decodeTrajectory(*raw, result, maps);
+		return result;
+	});
+}
+
+//Non-blocking trajectory: all chunks are enqueued, then this returns
+std::future<void> CLODEtrajectory::trajectoryAsync()
+{
+	if (!clInitialized)
+		return notInitializedFuture();
+
+	if (useNative)
+		return nativeAsync([this]() { return trajectory(); });
+
+	//streaming needs the host between launches: run on a background thread, which also calls the sink
+	if (streamSink)
+		return std::async(std::launch::async, [this]() { trajectory(); });
+
+	//resize output variables - will only occur if nPts or nSteps has changed
+	resizeTrajectoryVariables();
+
+	try
+	{
+		//kernel arguments. tspan and x0 are set per chunk
+		int ix = 2;
+		cl_trajectory.setArg(ix++, d_pars);
+		cl_trajectory.setArg(ix++, d_sp);
+		cl_trajectory.setArg(ix++, d_xf);
+		cl_trajectory.setArg(ix++, d_RNGstate);
+		cl_trajectory.setArg(ix++, d_dt);
+		cl_trajectory.setArg(ix++, d_stepCount);
+		cl_trajectory.setArg(ix++, d_tNow);
+		cl_trajectory.setArg(ix++, d_t);
+		cl_trajectory.setArg(ix++, d_x);
+		cl_trajectory.setArg(ix++, d_dx);
+		cl_trajectory.setArg(ix++, d_aux);
+		cl_trajectory.setArg(ix++, d_nStored);
+		cl_trajectory.setArg(ix++, d_tspan);
+
+		return enqueueChunksAsync(cl_trajectory);
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR CLODEtrajectory::trajectoryAsync(): %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
 }
 
 std::vector<cl_double> CLODEtrajectory::getT()
 {
+	waitNative();
+	if (useNative || !tStore.empty())
+		return t;
 
 	if (clSinglePrecision)
 	{ //cast back to double
@@ -196,6 +736,15 @@ std::vector<cl_double> CLODEtrajectory::getT()
 
 std::vector<cl_double> CLODEtrajectory::getX()
 {
+	waitNative();
+	if (useNative || xelements == 0) //an empty store mask stores nothing
+		return x;
+
+	if (storageFormat != StorageFormat::Real)
+	{ //decode the reduced-precision values
+		readStoredToHost(d_x, x, getXQuantization());
+		return x;
+	}
 
 	if (clSinglePrecision)
 	{ //cast back to double
@@ -213,10 +762,19 @@ std::vector<cl_double> CLODEtrajectory::getX()
 
 std::vector<cl_double> CLODEtrajectory::getDx()
 {
+	waitNative();
+	if (useNative || dxelements == 0)
+		return dx;
+
+	if (storageFormat != StorageFormat::Real)
+	{ //decode the reduced-precision values
+		readStoredToHost(d_dx, dx, getDxQuantization());
+		return dx;
+	}
 
 	if (clSinglePrecision)
 	{ //cast back to double
-		std::vector<cl_float> dxF(xelements);
+		std::vector<cl_float> dxF(dxelements);
 		opencl.error = copy(opencl.getQueue(), d_dx, dxF.begin(), dxF.end());
 		dx.assign(dxF.begin(), dxF.end());
 	}
@@ -230,6 +788,14 @@ std::vector<cl_double> CLODEtrajectory::getDx()
 
 std::vector<cl_double> CLODEtrajectory::getAux()
 { //cast back to double
+	if (useNative || auxelements == 0)
+		return aux;
+
+	if (storageFormat != StorageFormat::Real)
+	{ //decode the reduced-precision values
+		readStoredToHost(d_aux, aux, getAuxQuantization());
+		return aux;
+	}
 
 	if (clSinglePrecision)
 	{
@@ -247,7 +813,147 @@ std::vector<cl_double> CLODEtrajectory::getAux()
 
 std::vector<cl_int> CLODEtrajectory::getNstored()
 {
+	waitNative();
+	if (useNative)
+		return nStored;
 
 	opencl.error = copy(opencl.getQueue(), d_nStored, nStored.begin(), nStored.end());
 	return nStored;
 }
+
+//number of stored points of trajectory i
+cl_int CLODEtrajectory::getNpoints(cl_int i)
+{
+	if (i < 0 || i >= nPts)
+	{
+		printf("Invalid trajectory index %d (nPts=%d)\n", i, nPts);
+		throw std::invalid_argument("trajectory index out of range");
+	}
+
+	cl_int n = 0;
+	if (useNative)
+		n = nStored[i];
+	else
+		opencl.error = opencl.getQueue().enqueueReadBuffer(d_nStored, CL_TRUE, sizeof(cl_int) * i, sizeof(cl_int), &n);
+	return n + 1; //nStored is the index of the last stored point
+}
+
+//stored points of trajectory i, point-major. Strided layouts are read with a rectangular read: one element per row
+std::vector<cl_double> CLODEtrajectory::readTrajectory(cl::Buffer &buffer, const std::vector<cl_double> &hostData, cl_int nElem, cl_int i,
+											   StorageFormat format, const std::vector<QuantizationMap> &maps)
+{
+	if (streamSink)
+		throw std::invalid_argument("per-trajectory getters are not available in streaming mode: the sink receives the points");
+
+	cl_int nPoints = getNpoints(i);
+	size_t nValues = (size_t)nPoints * nElem;
+	std::vector<cl_double> result(nValues);
+	if (nValues == 0)
+		return result;
+
+	if (useNative)
+	{
+		for (cl_int k = 0; k < nPoints; ++k)
+			for (cl_int j = 0; j < nElem; ++j)
+				result[k * nElem + j] = hostData[storeIndex(k, j, nElem, i)];
+		return result;
+	}
+
+	try
+	{
+		size_t elemSize = getStorageSize(format);
+		std::vector<cl_float> resultF(clSinglePrecision && format == StorageFormat::Real ? nValues : 0);
+		std::vector<cl_ushort> raw(format != StorageFormat::Real ? nValues : 0);
+		void *dst = format != StorageFormat::Real ? (void *)raw.data() : clSinglePrecision ? (void *)resultF.data() : (void *)result.data();
+		size_t first = storeIndex(0, 0, nElem, i);
+
+		if (layout == TrajectoryLayout::TrajectoryMajor)
+		{
+			opencl.error = opencl.getQueue().enqueueReadBuffer(buffer, CL_TRUE, elemSize * first, elemSize * nValues, dst);
+		}
+		else
+		{
+			size_t pitch = layout == TrajectoryLayout::Tiled ? tileSize : nPts; //elements between consecutive values of one trajectory
+			cl::array<cl::size_type, 3> bufferOrigin = {{elemSize * first, 0, 0}};
+			cl::array<cl::size_type, 3> hostOrigin = {{0, 0, 0}};
+			cl::array<cl::size_type, 3> region = {{elemSize, nValues, 1}};
+			opencl.error = opencl.getQueue().enqueueReadBufferRect(buffer, CL_TRUE, bufferOrigin, hostOrigin, region, elemSize * pitch, 0, elemSize, 0, dst);
+		}
+
+		if (format != StorageFormat::Real)
+		{ //point-major: value v is component v % nElem
+			for (size_t v = 0; v < nValues; ++v)
+				result[v] = format == StorageFormat::Half ? halfToDouble(raw[v]) : decodeStored(raw[v], format, maps[v % nElem]);
+		}
+		else if (clSinglePrecision)
+			result.assign(resultF.begin(), resultF.end());
+	}
+	catch (cl::Error &er)
+	{
+		printf("ERROR in CLODEtrajectory::readTrajectory(): %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+		throw er;
+	}
+	return result;
+}
+
+std::vector<cl_double> CLODEtrajectory::getT(cl_int i)
+{
+	waitNative();
+	if (tStore.empty())
+		return readTrajectory(d_t, t, 1, i);
+
+	return std::vector<cl_double>(t.begin(), t.begin() + getNpoints(i)); //the output times this trajectory reached
+}
+
+std::vector<cl_double> CLODEtrajectory::getX(cl_int i)
+{
+	waitNative();
+	return readTrajectory(d_x, x, getStoredXIx().size(), i, storageFormat, getXQuantization());
+}
+
+std::vector<cl_double> CLODEtrajectory::getDx(cl_int i)
+{
+	waitNative();
+	return readTrajectory(d_dx, dx, getStoredDxIx().size(), i, storageFormat, getDxQuantization());
+}
+
+std::vector<cl_double> CLODEtrajectory::getAux(cl_int i)
+{
+	waitNative();
+	return readTrajectory(d_aux, aux, getStoredAuxIx().size(), i, storageFormat, getAuxQuantization());
+}
+
+std::future<std::vector<cl_double>> CLODEtrajectory::getTAsync()
+{
+	if (useNative || !tStore.empty())
+		return nativeReadAsync(t);
+	return readBufferAsync(d_t, telements);
+}
+
+std::future<std::vector<cl_double>> CLODEtrajectory::getXAsync()
+{
+	if (useNative || xelements == 0)
+		return nativeReadAsync(x);
+	return readStoredAsync(d_x, xelements, getXQuantization());
+}
+
+std::future<std::vector<cl_double>> CLODEtrajectory::getDxAsync()
+{
+	if (useNative || dxelements == 0)
+		return nativeReadAsync(dx);
+	return readStoredAsync(d_dx, dxelements, getDxQuantization());
+}
+
+std::future<std::vector<cl_double>> CLODEtrajectory::getAuxAsync()
+{
+	if (useNative || auxelements == 0)
+		return nativeReadAsync(aux);
+	return readStoredAsync(d_aux, auxelements, getAuxQuantization());
+}
+
+std::future<std::vector<cl_int>> CLODEtrajectory::getNstoredAsync()
+{
+	if (useNative)
+		return nativeReadAsync(nStored);
+	return readIntBufferAsync(d_nStored, nPts);
+}
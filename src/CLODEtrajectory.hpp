@@ -27,46 +27,145 @@
 #define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY
 #include "OpenCL/cl2.hpp"
 
+#include <functional>
+#include <future>
 #include <string>
 #include <vector>
 
+//layout of the stored outputs t, x, dx, aux: element j of stored point k of trajectory i (t has one element per point)
+enum class TrajectoryLayout
+{
+    TimeMajor,       //[k][j][i]: consecutive work-items write consecutive addresses, coalesced on GPUs. The default
+    TrajectoryMajor, //[i][k][j]: each trajectory's time series is contiguous, one cache line per store on CPUs
+    Tiled            //[i/tile][k][j][i%tile]: time-major within tiles of tile trajectories (nPts padded to a multiple of tile)
+};
+
+//points stored since the previous drain of a streaming run (CLODEtrajectory::setStreaming). Trajectory i has count[i] new points,
+//numbered from first[i] in the whole trajectory, at rows offset[i]... of the point-major arrays: x[(offset[i] + k) * nX + j]
+struct TrajectorySegment
+{
+    cl_int nX, nDx, nAux; //stored components per point (store masks)
+    std::vector<cl_int> first, count;
+    std::vector<size_t> offset;
+    std::vector<cl_double> t, x, dx, aux;
+};
+
+typedef std::function<void(const TrajectorySegment &segment)> TrajectorySink;
+
 class CLODEtrajectory : public CLODE
 {
 
 protected:
+    TrajectoryLayout layout = TrajectoryLayout::TimeMajor;
+    cl_int tileSize = 32;
     cl_int nStoreMax;
+    bool storeAll = true; //no store masks: store every component of x, dx and aux
+    std::vector<cl_int> storeXIx, storeDxIx, storeAuxIx;
+    std::vector<cl_double> tStore; //output times of store-at-times mode. Empty: store every nout'th step
+    StorageFormat storageFormat = StorageFormat::Real; //of x, dx and aux
+    std::vector<cl_double> xRange, dxRange, auxRange; //Quantized16: {lo, hi} of each variable / aux variable
+    TrajectorySink streamSink; //streaming mode, if set
     std::vector<cl_int> nStored;
     std::vector<cl_double> t, x, dx, aux; //new result vectors
-    size_t telements, xelements, auxelements;
+    size_t telements, xelements, dxelements, auxelements;
 
     cl::Buffer d_t, d_x, d_dx, d_aux, d_nStored;
     cl::Kernel cl_trajectory;
 
     void resizeTrajectoryVariables(); //creates trajectory output global variables, called just before launching trajectory kernel
+    std::string getOutputLayoutDefine();
+    std::string getStoreMaskDefine();
+    std::string getStorageDefine();
+    std::vector<QuantizationMap> getStoredQuantization(const std::vector<cl_double> &ranges, const std::vector<cl_int> &storedIx, cl_int n, const char *name);
+    cl_int getStoredPts(); //nPts, padded to whole tiles in the tiled layout
+    size_t storeIndex(cl_int storeix, cl_int j, cl_int nElem, cl_int i); //as storeIndex in clODE_utilities.cl
+    cl_int getNpoints(cl_int i);
+    std::vector<cl_double> readTrajectory(cl::Buffer &buffer, const std::vector<cl_double> &hostData, cl_int nElem, cl_int i,
+                                          StorageFormat format = StorageFormat::Real, const std::vector<QuantizationMap> &maps = std::vector<QuantizationMap>());
+    std::string getSimdProgramSource();
+    void readToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData); //hostData.size() values
+    void readStoredToHost(cl::Buffer &buffer, std::vector<cl_double> &hostData, const std::vector<QuantizationMap> &maps); //x, dx or aux, decoded
+    void decodeTrajectory(const std::vector<cl_ushort> &raw, std::vector<cl_double> &hostData, const std::vector<QuantizationMap> &maps);
+    std::future<std::vector<cl_double>> readStoredAsync(cl::Buffer &buffer, size_t nElements, std::vector<QuantizationMap> maps);
+    bool runStreamed(); //runChunked for streaming mode. Returns false if cancelled
+    bool drainStream(std::vector<cl_int> &drained, cl_double tEnd);
 
 public:
     CLODEtrajectory(ProblemInfo prob, std::string stepper, bool clSinglePrecision, OpenCLResource opencl); //will construct the base class with same arguments
     CLODEtrajectory(ProblemInfo prob, std::string stepper, bool clSinglePrecision, unsigned int platformID, unsigned int deviceID);
+    CLODEtrajectory(ProblemInfo prob, std::string stepper, NativeResource native); //native CPU backend
     ~CLODEtrajectory();
 
     void buildCL(); // build program and create kernel objects
 
+    void setOutputLayout(TrajectoryLayout newLayout, cl_int newTileSize = 32); //requires buildCL
+    TrajectoryLayout getOutputLayout() { return layout; };
+    cl_int getTileSize() { return tileSize; };
+
+    //store only the listed components of x, dx and aux (indices into the variables/aux; empty: store none). Output arrays
+    //shrink to match, with the components in the listed order. requires buildCL
+    void setStoreMasks(std::vector<cl_int> newXIx, std::vector<cl_int> newDxIx, std::vector<cl_int> newAuxIx);
+    void clearStoreMasks(); //store everything (default). requires buildCL
+    std::vector<cl_int> getStoredXIx();
+    std::vector<cl_int> getStoredDxIx();
+    std::vector<cl_int> getStoredAuxIx();
+
+    //store-at-times mode: store every trajectory at the same output times (ascending, from tspan[0]), interpolated with the
+    //stepper's continuous extension, or the cubic Hermite through the step for steppers without one. rkf78 and rk549, for which
+    //that cubic is too inaccurate, end their steps at the output times instead. Sets max_store to the number of times, and nout
+    //is not used. Empty: store every nout'th step (default). requires buildCL
+    void setStoreTimes(std::vector<cl_double> newTStore);
+    std::vector<cl_double> getStoreTimes() { return tStore; };
+
+    //streaming mode: each trajectory stores into a ring of max_store points on the device, which is drained to sink after every
+    //kernel launch (once per time chunk, see setMaxChunkDuration, plus relaunches of a chunk for trajectories that filled their
+    //ring before its end). Device memory stays fixed and the total stored length is unbounded. getNstored then counts all stored
+    //points, and the other getters return the last drained ring. Not with store-at-times. nullptr: off. requires buildCL
+    void setStreaming(TrajectorySink sink);
+    static TrajectorySink fileSink(std::string filename); //appends segments to a binary file, see CLODEtrajectory.cpp
+
+    //reduced-precision device storage of x, dx and aux (t stays realtype), decoded to double by the getters. Quantized16 needs a
+    //[lo, hi] range for every variable in xRange and dxRange and every aux variable in auxRange, flattened {lo0, hi0, lo1, ...}.
+    //Not with the native backend. requires buildCL
+    void setStorageFormat(StorageFormat newFormat, std::vector<cl_double> newXRange = std::vector<cl_double>(),
+                          std::vector<cl_double> newDxRange = std::vector<cl_double>(), std::vector<cl_double> newAuxRange = std::vector<cl_double>());
+    StorageFormat getStorageFormat() { return storageFormat; };
+    //Quantized16: scale and offset of each stored component, in output order, to decode raw values elsewhere. Empty otherwise
+    std::vector<QuantizationMap> getXQuantization();
+    std::vector<QuantizationMap> getDxQuantization();
+    std::vector<QuantizationMap> getAuxQuantization();
+
     //build program, set all problem data needed to run
     virtual void initialize(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp);
 
     //simulation routine and overloads
-    void trajectory(); //integrate forward an interval of duration (tf-t0)
+    bool trajectory(); //integrate forward an interval of duration (tf-t0). Returns false if cancelled (or not initialized): the stored part of the run stays readable
+    std::future<void> trajectoryAsync(); //non-blocking: returns as soon as the kernel(s) are enqueued
     // void trajectory(std::vector<cl_double> newTspan);
     // void trajectory(std::vector<cl_double> newTspan, std::vector<cl_double> newX0);
     // void trajectory(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars);
     // void trajectory(std::vector<cl_double> newTspan, std::vector<cl_double> newX0, std::vector<cl_double> newPars, SolverParams<cl_double> newSp);
 
-    //Get functions
+    //Get functions: the whole output arrays, in the selected output layout. In store-at-times mode, getT returns the output times
     std::vector<cl_double> getT();
     std::vector<cl_double> getX();
     std::vector<cl_double> getDx();
     std::vector<cl_double> getAux();
     std::vector<cl_int> getNstored();
+
+    //stored points of trajectory i only, [nStored[i]+1] or [(nStored[i]+1)*nStoredComponents] (point-major) for any layout.
+    //Reads just that trajectory from the device: one contiguous read in the trajectory-major layout
+    std::vector<cl_double> getT(cl_int i);
+    std::vector<cl_double> getX(cl_int i);
+    std::vector<cl_double> getDx(cl_int i);
+    std::vector<cl_double> getAux(cl_int i);
+
+    //non-blocking getters: queued behind any pending runs
+    std::future<std::vector<cl_double>> getTAsync();
+    std::future<std::vector<cl_double>> getXAsync();
+    std::future<std::vector<cl_double>> getDxAsync();
+    std::future<std::vector<cl_double>> getAuxAsync();
+    std::future<std::vector<cl_int>> getNstoredAsync();
 };
 
 #endif //CLODE_HPP_
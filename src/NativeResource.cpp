@@ -0,0 +1,151 @@
+/*
+ * NativeResource.cpp
+ *
+ */
+
+#include "NativeResource.hpp"
+#include "OpenCLResource.hpp" //hashProgramSources, program cache dir
+
+//if compiling from matlab MEX, redefine printf to mexPrintf so it prints to matlab command window.
+// #define dbg_printf printf
+#define dbg_printf
+#ifdef MATLAB_MEX_FILE
+#include "mex.h"
+#define printf mexPrintf
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <thread>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+NativeResource::NativeResource(unsigned int newNThreads)
+{
+	nThreads = newNThreads > 0 ? newNThreads : std::max(1u, std::thread::hardware_concurrency());
+
+	const char *env = getenv("CLODE_NATIVE_CC");
+	compiler = env ? std::string(env) : "cc";
+}
+
+void NativeResource::buildProgramFromString(std::string source, std::string buildOptions)
+{
+#ifdef _WIN32
+	throw std::runtime_error("NativeResource: the native CPU backend is not available on Windows");
+#else
+	//keep preprocessor and include options, drop OpenCL compiler options
+	std::string options;
+	std::istringstream tokens(buildOptions);
+	std::string token;
+	while (tokens >> token)
+	{
+		if (token.compare(0, 4, "-cl-") != 0)
+			options += " " + token;
+	}
+
+	//lane-batched programs need the vector classes of the shim: C++, without the runtime
+	bool simd = options.find("-DCLODE_SIMD_LANES=") != std::string::npos;
+	std::string flags = simd ? " -x c++ -std=gnu++11 -fno-exceptions -fno-rtti -O2 -fPIC -shared -w" : " -std=gnu99 -fgnu89-inline -O2 -fPIC -shared -w";
+	std::string key = hashString(hashProgramSources(source, options) + options + compiler + flags); //the program string is mostly #include lines
+
+	std::string dir = getProgramCacheDir();
+	if (dir.empty())
+	{
+		const char *tmp = getenv("TMPDIR");
+		dir = std::string(tmp ? tmp : "/tmp") + "/clODE";
+	}
+	makeDirectories(dir);
+
+	std::string libname = dir + "/" + key + ".so";
+	if (access(libname.c_str(), R_OK) != 0)
+	{
+		//pid in the temporary names so concurrent processes don't clobber each other
+		std::string tmpbase = dir + "/" + key + "." + std::to_string((long long)getpid());
+		std::string srcname = tmpbase + ".c";
+		std::string logname = tmpbase + ".log";
+		{
+			std::ofstream file(srcname.c_str());
+			file << source;
+		}
+
+		std::string command = compiler + flags + options + " -o " + tmpbase + ".so " + srcname + " -lm > " + logname + " 2>&1";
+		dbg_printf("%s\n", command.c_str());
+		int status = std::system(command.c_str());
+
+		if (status != 0)
+		{
+			printf("Native build failed (%s):\n%s\n", command.c_str(), read_file(logname).c_str());
+			remove(srcname.c_str());
+			remove(logname.c_str());
+			throw std::runtime_error("NativeResource: compiling the program failed");
+		}
+		rename((tmpbase + ".so").c_str(), libname.c_str());
+		remove(srcname.c_str());
+		remove(logname.c_str());
+	}
+
+	void *handle = dlopen(libname.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!handle)
+	{
+		printf("ERROR in NativeResource::buildProgramFromString: %s\n", dlerror());
+		throw std::runtime_error("NativeResource: could not load the compiled program");
+	}
+	library = std::shared_ptr<void>(handle, [](void *h) { dlclose(h); });
+	kernels.clear();
+
+	run = (RunFunction)dlsym(handle, "clode_native_run");
+	if (!run)
+		throw std::runtime_error("NativeResource: clode_native_run not found, the source must start with clODE_native_shim.h");
+
+	dbg_printf("Native program built: %s\n", libname.c_str());
+#endif
+}
+
+void NativeResource::runKernel(std::string kernelName, std::vector<void *> args, size_t globalSize)
+{
+#ifndef _WIN32
+	if (!library)
+		throw std::runtime_error("NativeResource: no program has been built");
+
+	auto loc = kernels.find(kernelName);
+	if (loc == kernels.end())
+	{
+		KernelFunction kernel = (KernelFunction)dlsym(library.get(), kernelName.c_str());
+		if (!kernel)
+			throw std::invalid_argument("NativeResource: kernel not found: " + kernelName);
+		loc = kernels.insert(std::make_pair(kernelName, kernel)).first;
+	}
+	KernelFunction kernel = loc->second;
+	if (args.size() < 5 || args.size() > 18)
+		throw std::invalid_argument("NativeResource: kernels must take 5 to 18 arguments");
+
+	//dynamic schedule: each thread takes the next block of work-items until none are left
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		size_t begin;
+		while ((begin = next.fetch_add(workItemsPerTask)) < globalSize)
+			run(kernel, (int)args.size(), args.data(), begin, std::min(begin + workItemsPerTask, globalSize), globalSize);
+	};
+
+	unsigned int nWorkers = (unsigned int)std::min((size_t)nThreads, (globalSize + workItemsPerTask - 1) / workItemsPerTask);
+	std::vector<std::thread> threads;
+	for (unsigned int k = 1; k < nWorkers; ++k)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (std::thread &thread : threads)
+		thread.join();
+#endif
+}
+
+void NativeResource::print()
+{
+	printf("\nNative CPU backend: %d threads, compiler: %s\n", nThreads, compiler.c_str());
+}
@@ -0,0 +1,48 @@
+/*
+ * NativeResource.hpp
+ *
+ * A CPU "device" for CLODE that needs no OpenCL platform. The program string (kernels + RHS) is compiled by the host C
+ * compiler through the qualifier shim clODE_native_shim.h into a shared library, which is loaded at runtime. Kernels are
+ * run over the global range on a pool of std::threads, with kernel arguments passed as host pointers.
+ *
+ * The compiler defaults to "cc", or $CLODE_NATIVE_CC. Compiled libraries are cached in getProgramCacheDir(), keyed by
+ * the source and build options, so repeated builds are just a dlopen.
+ */
+
+#ifndef NATIVE_RESOURCE_HPP_
+#define NATIVE_RESOURCE_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class NativeResource
+{
+	typedef void (*KernelFunction)(void);
+	typedef void (*RunFunction)(KernelFunction kernel, int nArgs, void **args, size_t begin, size_t end, size_t globalSize);
+
+	std::shared_ptr<void> library; //dlclose on last copy
+	RunFunction run = nullptr;
+	std::map<std::string, KernelFunction> kernels;
+
+	unsigned int nThreads;
+	std::string compiler;
+	size_t workItemsPerTask = 16; //threads take work-items in blocks of this size: adaptive steppers take different numbers of steps
+
+public:
+	NativeResource(unsigned int nThreads = 0); //0: std::thread::hardware_concurrency
+
+	void setCompiler(std::string newCompiler) { compiler = newCompiler; };
+	unsigned int getNumThreads() { return nThreads; };
+
+	//source must start with clODE_native_shim.h. OpenCL-only options (-cl-*) are dropped from buildOptions
+	void buildProgramFromString(std::string source, std::string buildOptions = "");
+
+	//blocking: runs work-items 0..globalSize-1 of the named kernel. All kernel arguments are pointers to host arrays
+	void runKernel(std::string kernelName, std::vector<void *> args, size_t globalSize);
+
+	void print();
+};
+
+#endif //NATIVE_RESOURCE_HPP_
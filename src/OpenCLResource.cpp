@@ -22,9 +22,17 @@
 #define printf mexPrintf
 #endif
 
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
 #include <stdexcept>
 #include <fstream>
 #include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 /******************************** 
  * OpenCLResource Member Functions
@@ -131,6 +139,11 @@ OpenCLResource::OpenCLResource(unsigned int platformID, std::vector<unsigned int
     initializeOpenCL();
 };
 
+OpenCLResource OpenCLResource::empty()
+{
+    return OpenCLResource(EmptyTag());
+}
+
 //modified from openCLUtilities
 //TODO: check various possibilities on default? eg: any Accel, any non-intel GPU, intel GPU, any CPU
 void OpenCLResource::getPlatformAndDevices(cl_deviceType type, cl_vendor vendor)
@@ -260,9 +273,28 @@ void OpenCLResource::initializeOpenCL()
     //~ printf("OpenCLResource Created\n");
 }
 
+//A copy restricted to one device of the context. Memory objects created with getContext() are shared by all views,
+//so several single-device solvers can work side by side in the same context
+OpenCLResource OpenCLResource::getDeviceResource(cl_uint deviceID)
+{
+    if (deviceID >= devices.size())
+        throw std::out_of_range("Specified deviceID exceeds the number of devices in the context");
+
+    OpenCLResource view = *this;
+    view.devices = std::vector<cl::Device>(1, devices[deviceID]);
+    view.queues = std::vector<cl::CommandQueue>(1, queues[deviceID]);
+    view.platform_info.device_info = std::vector<deviceInfo>(1, platform_info.device_info[deviceID]);
+    view.platform_info.nDevices = 1;
+    view.program = cl::Program();
+    return view;
+}
+
 //attempt to build OpenCL program given as a string, build options empty if not supplied.
 void OpenCLResource::buildProgramFromString(std::string sourceStr, std::string buildOptions)
 {
+    std::vector<std::string> cacheKeys = getProgramCacheKeys(sourceStr, buildOptions);
+    if (buildProgramFromCache(cacheKeys, buildOptions))
+        return;
 
     cl::Program::Sources source(1, std::make_pair(sourceStr.c_str(), sourceStr.length()));
     std::string buildLog;
@@ -294,6 +326,8 @@ void OpenCLResource::buildProgramFromString(std::string sourceStr, std::string b
         }
         throw er;
     }
+
+    storeProgramBinaries(cacheKeys);
 }
 
 void OpenCLResource::buildProgramFromSource(std::string filename, std::string buildOptions)
@@ -312,6 +346,263 @@ void OpenCLResource::print()
     printPlatformInfo(platform_info);
 }
 
+/******************************** 
+ * Program binary cache
+ ********************************/
+
+static bool programCacheEnabled = true;
+static bool programCacheDirSet = false;
+static std::string programCacheDir;
+static std::map<std::string, std::vector<unsigned char>> programCache; //key -> binary for one device
+static std::mutex programCacheMutex;
+
+//64 bit FNV-1a: stable across runs and platforms, unlike std::hash
+std::string hashString(const std::string &str)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", hash);
+    return std::string(hex);
+}
+
+//append the contents of every file reached through #include "...", resolved against the -I dirs of the build options.
+//Conditional compilation is ignored, so this may hash more than is compiled, never less
+static void appendIncludedSources(const std::string &source, const std::vector<std::string> &includeDirs, std::set<std::string> &visited, std::string &allSources)
+{
+    size_t pos = 0;
+    while ((pos = source.find("#include", pos)) != std::string::npos)
+    {
+        size_t open = source.find_first_of("\"\n", pos);
+        pos += 8;
+        if (open == std::string::npos || source[open] != '"')
+            continue;
+        size_t close = source.find('"', open + 1);
+        if (close == std::string::npos)
+            break;
+        std::string name = source.substr(open + 1, close - open - 1);
+        if (visited.count(name))
+            continue;
+        visited.insert(name);
+
+        for (const std::string &dir : includeDirs)
+        {
+            std::ifstream file((dir + "/" + name).c_str());
+            if (file.good())
+            {
+                std::string included((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                allSources += included;
+                appendIncludedSources(included, includeDirs, visited, allSources);
+                break;
+            }
+        }
+    }
+}
+
+static std::string defaultProgramCacheDir()
+{
+    const char *env = getenv("CLODE_CACHE_DIR");
+    if (env)
+        return std::string(env);
+#ifdef _WIN32
+    env = getenv("LOCALAPPDATA");
+    if (env)
+        return std::string(env) + "/clODE";
+#else
+    env = getenv("HOME");
+    if (env)
+        return std::string(env) + "/.cache/clODE";
+#endif
+    return "";
+}
+
+void makeDirectories(const std::string &path)
+{
+    for (size_t pos = path.find_first_of("/\\", 1); ; pos = path.find_first_of("/\\", pos + 1))
+    {
+        std::string dir = path.substr(0, pos);
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+        if (pos == std::string::npos)
+            break;
+    }
+}
+
+void setProgramCacheDir(std::string dir)
+{
+    std::lock_guard<std::mutex> lock(programCacheMutex);
+    programCacheDir = dir;
+    programCacheDirSet = true;
+}
+
+std::string getProgramCacheDir()
+{
+    std::lock_guard<std::mutex> lock(programCacheMutex);
+    if (!programCacheDirSet)
+    {
+        programCacheDir = defaultProgramCacheDir();
+        programCacheDirSet = true;
+    }
+    return programCacheDir;
+}
+
+void setProgramCacheEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(programCacheMutex);
+    programCacheEnabled = enabled;
+}
+
+void clearProgramCache()
+{
+    std::lock_guard<std::mutex> lock(programCacheMutex);
+    programCache.clear();
+}
+
+std::string hashProgramSources(std::string sourceStr, std::string buildOptions)
+{
+    //include dirs from "-I<dir>" or "-I <dir>" options
+    std::vector<std::string> includeDirs;
+    size_t pos = 0;
+    while ((pos = buildOptions.find("-I", pos)) != std::string::npos)
+    {
+        pos = buildOptions.find_first_not_of(' ', pos + 2);
+        if (pos == std::string::npos)
+            break;
+        size_t end = buildOptions.find(' ', pos);
+        includeDirs.push_back(buildOptions.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+    }
+
+    std::string allSources = sourceStr;
+    std::set<std::string> visited;
+    appendIncludedSources(sourceStr, includeDirs, visited, allSources);
+    return hashString(allSources);
+}
+
+std::vector<std::string> OpenCLResource::getProgramCacheKeys(std::string sourceStr, std::string buildOptions)
+{
+    std::string common = hashProgramSources(sourceStr, buildOptions) + buildOptions + platform.getInfo<CL_PLATFORM_NAME>() + platform.getInfo<CL_PLATFORM_VERSION>();
+
+    std::vector<std::string> keys;
+    for (cl::Device &device : devices)
+    {
+        std::string deviceID = device.getInfo<CL_DEVICE_NAME>() + device.getInfo<CL_DEVICE_VENDOR>() + device.getInfo<CL_DEVICE_VERSION>() + device.getInfo<CL_DRIVER_VERSION>();
+        keys.push_back(hashString(common + deviceID));
+    }
+    return keys;
+}
+
+//create and build the program from cached binaries if every device has one. On any failure (e.g. stale binary) return false to build from source
+bool OpenCLResource::buildProgramFromCache(std::vector<std::string> keys, std::string buildOptions)
+{
+    if (!programCacheEnabled)
+        return false;
+
+    std::string cacheDir = getProgramCacheDir();
+    std::vector<std::vector<unsigned char>> binaries(devices.size());
+    {
+        std::lock_guard<std::mutex> lock(programCacheMutex);
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            auto loc = programCache.find(keys[i]);
+            if (loc != programCache.end())
+            {
+                binaries[i] = loc->second;
+                continue;
+            }
+
+            if (cacheDir.empty())
+                return false;
+
+            std::ifstream file((cacheDir + "/" + keys[i] + ".bin").c_str(), std::ios::binary);
+            if (!file.good())
+                return false;
+            binaries[i].assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (binaries[i].empty())
+                return false;
+            programCache[keys[i]] = binaries[i];
+        }
+    }
+
+    try
+    {
+        cl::Program::Binaries programBinaries;
+        for (size_t i = 0; i < devices.size(); ++i)
+            programBinaries.push_back(std::make_pair((const void *)binaries[i].data(), binaries[i].size()));
+
+        std::vector<cl_int> binaryStatus;
+        program = cl::Program(context, devices, programBinaries, &binaryStatus, &error);
+        program.build(devices, buildOptions.c_str());
+    }
+    catch (cl::Error &er)
+    {
+        dbg_printf("Cached program binary rejected (%s), building from source\n", CLErrorString(er.err()).c_str());
+        std::lock_guard<std::mutex> lock(programCacheMutex);
+        for (size_t i = 0; i < keys.size(); ++i)
+            programCache.erase(keys[i]);
+        return false;
+    }
+
+    dbg_printf("Program built from cached binaries\n");
+    return true;
+}
+
+//save the binaries of the freshly built program in memory and on disk
+void OpenCLResource::storeProgramBinaries(std::vector<std::string> keys)
+{
+    if (!programCacheEnabled)
+        return;
+
+    try
+    {
+        //binaries come in the order of CL_PROGRAM_DEVICES, which may include context devices we did not build for
+        std::vector<cl::Device> programDevices = program.getInfo<CL_PROGRAM_DEVICES>();
+        std::vector<std::vector<unsigned char>> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+
+        std::string cacheDir = getProgramCacheDir();
+        if (!cacheDir.empty())
+            makeDirectories(cacheDir);
+
+        std::lock_guard<std::mutex> lock(programCacheMutex);
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            for (size_t j = 0; j < programDevices.size(); ++j)
+            {
+                if (programDevices[j]() != devices[i]() || binaries[j].empty())
+                    continue;
+
+                programCache[keys[i]] = binaries[j];
+
+                if (!cacheDir.empty())
+                { //write then rename, so a concurrent reader never sees a partial file
+                    std::string filename = cacheDir + "/" + keys[i] + ".bin";
+                    std::string tmpname = filename + ".tmp";
+                    std::ofstream file(tmpname.c_str(), std::ios::binary);
+                    file.write((const char *)binaries[j].data(), binaries[j].size());
+                    file.close();
+                    if (file.good())
+                    {
+                        remove(filename.c_str());
+                        rename(tmpname.c_str(), filename.c_str());
+                    }
+                    else
+                        remove(tmpname.c_str());
+                }
+            }
+        }
+    }
+    catch (cl::Error &er)
+    { //caching is best effort
+        printf("Warning: could not cache program binaries: %s(%s)\n", er.what(), CLErrorString(er.err()).c_str());
+    }
+}
+
 /******************************** 
  * Other functions
  ********************************/
@@ -388,6 +679,7 @@ deviceInfo getDeviceInfo(cl::Device device)
     device.getInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE, &dinfo.maxWorkGroupSize);
     device.getInfo(CL_DEVICE_GLOBAL_MEM_SIZE, &dinfo.deviceMemSize);
     device.getInfo(CL_DEVICE_MAX_MEM_ALLOC_SIZE, &dinfo.maxMemAllocSize);
+    device.getInfo(CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, &dinfo.maxConstantBufferSize);
     device.getInfo(CL_DEVICE_EXTENSIONS, &dinfo.extensions);
 
     std::string doubleStr = "fp64";
@@ -453,6 +745,7 @@ void printDeviceInfo(deviceInfo dinfo)
     printf("Clock frequency:     %d MHz\n", dinfo.maxClock);
     printf("Global memory size:  %llu MB\n", (long long unsigned int)(dinfo.deviceMemSize / 1024 / 1024));
     printf("Max allocation size: %llu MB\n", (long long unsigned int)(dinfo.maxMemAllocSize / 1024 / 1024));
+    printf("Max constant buffer size: %llu KB\n", (long long unsigned int)(dinfo.maxConstantBufferSize / 1024));
     printf("Max work group/CU:   %d\n", (int)dinfo.maxWorkGroupSize);
     printf("Double support:      %s\n", (dinfo.doubleSupport ? "true" : "false"));
     printf("Device available:    %s\n", (dinfo.deviceAvailable ? "true" : "false"));
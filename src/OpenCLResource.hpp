@@ -54,6 +54,7 @@ typedef struct deviceInfo
 	size_t maxWorkGroupSize;
 	cl_ulong deviceMemSize;
 	cl_ulong maxMemAllocSize;
+	cl_ulong maxConstantBufferSize;
 	std::string extensions;
 	bool doubleSupport;
 	cl_bool deviceAvailable;
@@ -89,6 +90,16 @@ class OpenCLResource
 	void getPlatformAndDevices(unsigned int platformID, std::vector<unsigned int> deviceID); //cl_device_type collides with int... function signature ambiguous
 	void initializeOpenCL();
 
+	//program binary cache: one key per device, from a hash of the source (with #included files), build options and device/driver
+	std::vector<std::string> getProgramCacheKeys(std::string sourceStr, std::string buildOptions);
+	bool buildProgramFromCache(std::vector<std::string> keys, std::string buildOptions);
+	void storeProgramBinaries(std::vector<std::string> keys);
+
+	struct EmptyTag
+	{
+	};
+	OpenCLResource(EmptyTag) : error(CL_SUCCESS){};
+
 public:
 	//constructors
 
@@ -106,22 +117,26 @@ public:
 	OpenCLResource(unsigned int platformID, unsigned int deviceID);				 //specify the platform and optionally device by integer ID
 	OpenCLResource(unsigned int platformID, std::vector<unsigned int> deviceID); //specify the platform and optionally device by integer IDs. default uses all available devices on that platform.
 
+	static OpenCLResource empty(); //no platform, context or devices, e.g. a placeholder when CLODE runs on its native CPU backend
+
 	cl_int error; //use this for error checking in host program
 
 	cl::Program getProgram() { return program; };								  //get this program, needed for creating kernel objects
 	cl::Context getContext() { return context; };								  //get this context, needed for creating memory objects
 	cl::CommandQueue getQueue(cl_uint deviceID = 0) { return queues[deviceID]; }; //get the command queue associated with device=deviceID from the list of devices available in the context
+	cl_uint getNumDevices() { return (cl_uint)devices.size(); };
+	cl::Device getDevice(cl_uint deviceID = 0) { return devices[deviceID]; }; //e.g. to create extra queues on the device
+	OpenCLResource getDeviceResource(cl_uint deviceID); //single-device view sharing this context: programs build for, and getQueue() returns, only that device
 
 	bool getDoubleSupport(cl_uint deviceID = 0) { return platform_info.device_info[deviceID].doubleSupport; };
 	cl_ulong getMaxMemAllocSize(cl_uint deviceID = 0) { return platform_info.device_info[deviceID].maxMemAllocSize; };
+	cl_ulong getMaxConstantBufferSize(cl_uint deviceID = 0) { return platform_info.device_info[deviceID].maxConstantBufferSize; };
 	std::string getDeviceCLVersion(cl_uint deviceID = 0) { return platform_info.device_info[deviceID].version; };
 	cl_device_type getDeviceType(cl_uint deviceID = 0) { return platform_info.device_info[deviceID].devType; };
 
-	void buildProgramFromString(std::string clProgramString, std::string buildOptions = "");
+	void buildProgramFromString(std::string clProgramString, std::string buildOptions = ""); //uses cached binaries if available
 	void buildProgramFromSource(std::string filename, std::string buildOptions = "");
 
-	//TODO: add support for binary/offline compilation etc - from openCLUtilities
-
 	//prints the platform and device info related to this context
 	void print();
 };
@@ -145,4 +160,14 @@ std::string CLErrorString(cl_int cl_error);
 //read file contents into a string
 std::string read_file(std::string filename);
 
+//Program binaries are cached in memory (per process) and on disk, keyed by source, build options and device.
+//The cache directory defaults to $CLODE_CACHE_DIR, or ~/.cache/clODE (%LOCALAPPDATA%/clODE on Windows). "" disables the disk cache
+void setProgramCacheDir(std::string dir);
+std::string getProgramCacheDir();
+void setProgramCacheEnabled(bool enabled); //both levels
+void clearProgramCache();                  //in-memory level only
+std::string hashString(const std::string &str); //64 bit FNV-1a as hex, stable across runs and platforms
+std::string hashProgramSources(std::string sourceStr, std::string buildOptions); //hash of the source and every file it #includes from the -I dirs
+void makeDirectories(const std::string &path);  //mkdir -p
+
 #endif // OPENCL_RESOURCE_HPP_
@@ -0,0 +1,294 @@
+/* Qualifier shim to compile the clODE OpenCL sources as plain C for the native CPU backend (NativeResource).
+ * Prepended to the program string: address space qualifiers disappear, OpenCL scalar types and the few builtins
+ * the kernels use are mapped onto C99, and get_global_id/get_global_size read the work-item being run.
+ * clode_native_run executes a range of work-items of one kernel, on the calling thread.
+ * Lane-batched programs (CLODE_SIMD_LANES) are compiled as C++, where the OpenCL vector types are defined at the end.
+ */
+
+#ifndef CLODE_NATIVE_SHIM_H_
+#define CLODE_NATIVE_SHIM_H_
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//lane-batched programs (clODE_simd.cl) are compiled as C++, for the vector types below. Kernels keep their C names for dlsym
+#ifdef __cplusplus
+#define __kernel extern "C"
+#define restrict __restrict
+#else
+#define __kernel
+#endif
+#define __global
+#define __constant const
+#define __private
+#define __local
+
+//realtype.cl enables fp64 through the extension pragma
+#define cl_khr_fp64 1
+
+typedef uint64_t ulong;
+typedef unsigned int uint;
+typedef unsigned short ushort;
+typedef unsigned char uchar;
+
+#define clamp(x, a, b) fmin(fmax((x), (a)), (b))
+#define pown(x, n) pow((x), (double)(n))
+
+static __thread size_t clode_global_id;
+static __thread size_t clode_global_size;
+#define get_global_id(dim) ((int)clode_global_id)
+#define get_global_size(dim) ((int)clode_global_size)
+
+//all kernel arguments are pointers, so a kernel is called through a pointer type of matching arity
+#define CLODE_NATIVE_MAX_ARGS 18
+typedef void *clode_arg;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void clode_native_run(void (*kernel)(void), int nArgs, clode_arg *a, size_t begin, size_t end, size_t globalSize)
+{
+	size_t i;
+	clode_global_size = globalSize;
+	for (i = begin; i < end; ++i)
+	{
+		clode_global_id = i;
+		switch (nArgs)
+		{
+		case 5: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4]); break;
+		case 6: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+		case 7: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+		case 8: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]); break;
+		case 9: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]); break;
+		case 10: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]); break;
+		case 11: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10]); break;
+		case 12: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]); break;
+		case 13: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12]); break;
+		case 14: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13]); break;
+		case 15: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14]); break;
+		case 16: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14], a[15]); break;
+		case 17: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14], a[15], a[16]); break;
+		case 18: ((void (*)(clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg, clode_arg))kernel)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14], a[15], a[16], a[17]); break;
+		default: return;
+		}
+	}
+}
+
+#ifdef __cplusplus
+//OpenCL vector types for the lane-batched kernels: a class over a GCC/Clang vector, with scalars broadcast by the constructor
+//and comparisons giving -1 (all bits set) in the true lanes. Only what the kernels, the steppers and an RHS written for
+//vector arguments use: arithmetic, comparisons, mask logic, vloadN/vstoreN, select/any/all/step and the math builtins
+template <class T> struct clode_mask_of;
+template <> struct clode_mask_of<double> { typedef long type; };
+template <> struct clode_mask_of<float> { typedef int type; };
+template <> struct clode_mask_of<long> { typedef long type; };
+template <> struct clode_mask_of<int> { typedef int type; };
+
+template <class T, int N> struct clode_raw; //the compiler vector type
+
+template <class T, int N> struct clode_vec
+{
+	typedef T scalar;
+	typedef typename clode_raw<T, N>::type raw;
+	typedef clode_vec<typename clode_mask_of<T>::type, N> mask;
+	raw v;
+
+	clode_vec() : v() {}
+	clode_vec(T s)
+	{
+		for (int k = 0; k < N; ++k)
+			v[k] = s;
+	}
+	explicit clode_vec(raw r) : v(r) {}
+
+	friend clode_vec operator+(clode_vec a, clode_vec b) { return clode_vec(a.v + b.v); }
+	friend clode_vec operator-(clode_vec a, clode_vec b) { return clode_vec(a.v - b.v); }
+	friend clode_vec operator*(clode_vec a, clode_vec b) { return clode_vec(a.v * b.v); }
+	friend clode_vec operator/(clode_vec a, clode_vec b) { return clode_vec(a.v / b.v); }
+	friend clode_vec operator-(clode_vec a) { return clode_vec(-a.v); }
+	friend clode_vec operator+(clode_vec a) { return a; }
+	clode_vec &operator+=(clode_vec b) { v += b.v; return *this; }
+	clode_vec &operator-=(clode_vec b) { v -= b.v; return *this; }
+	clode_vec &operator*=(clode_vec b) { v *= b.v; return *this; }
+	clode_vec &operator/=(clode_vec b) { v /= b.v; return *this; }
+
+	friend mask operator<(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v < b.v)); }
+	friend mask operator>(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v > b.v)); }
+	friend mask operator<=(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v <= b.v)); }
+	friend mask operator>=(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v >= b.v)); }
+	friend mask operator==(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v == b.v)); }
+	friend mask operator!=(clode_vec a, clode_vec b) { return mask((typename mask::raw)(a.v != b.v)); }
+
+	//integer types only (masks): instantiated where used
+	friend clode_vec operator&(clode_vec a, clode_vec b) { return clode_vec(a.v & b.v); }
+	friend clode_vec operator|(clode_vec a, clode_vec b) { return clode_vec(a.v | b.v); }
+	friend clode_vec operator^(clode_vec a, clode_vec b) { return clode_vec(a.v ^ b.v); }
+	friend clode_vec operator~(clode_vec a) { return clode_vec(~a.v); }
+	clode_vec &operator&=(clode_vec b) { v &= b.v; return *this; }
+	clode_vec &operator|=(clode_vec b) { v |= b.v; return *this; }
+};
+
+#define CLODE_VEC_TYPES(N)                          \
+	template <> struct clode_raw<float, N> { typedef float type __attribute__((vector_size(N * sizeof(float)))); };    \
+	template <> struct clode_raw<double, N> { typedef double type __attribute__((vector_size(N * sizeof(double)))); }; \
+	template <> struct clode_raw<int, N> { typedef int type __attribute__((vector_size(N * sizeof(int)))); };          \
+	template <> struct clode_raw<long, N> { typedef long type __attribute__((vector_size(N * sizeof(long)))); };       \
+	typedef clode_vec<float, N> float##N;           \
+	typedef clode_vec<double, N> double##N;         \
+	typedef clode_vec<int, N> int##N;               \
+	typedef clode_vec<long, N> long##N;             \
+	template <class T>                              \
+	inline clode_vec<T, N> vload##N(size_t i, const T *p) \
+	{                                               \
+		clode_vec<T, N> r;                          \
+		for (int k = 0; k < N; ++k)                 \
+			r.v[k] = p[i * N + k];                  \
+		return r;                                   \
+	}                                               \
+	template <class T>                              \
+	inline void vstore##N(clode_vec<T, N> a, size_t i, T *p) \
+	{                                               \
+		for (int k = 0; k < N; ++k)                 \
+			p[i * N + k] = a.v[k];                  \
+	}
+CLODE_VEC_TYPES(2)
+CLODE_VEC_TYPES(4)
+CLODE_VEC_TYPES(8)
+CLODE_VEC_TYPES(16)
+
+//the sign bit selects, as in OpenCL
+template <class T, int N> inline int any(clode_vec<T, N> m)
+{
+	for (int k = 0; k < N; ++k)
+		if (m.v[k] < 0)
+			return 1;
+	return 0;
+}
+
+template <class T, int N> inline int all(clode_vec<T, N> m)
+{
+	for (int k = 0; k < N; ++k)
+		if (!(m.v[k] < 0))
+			return 0;
+	return 1;
+}
+
+template <class T, class M, int N> inline clode_vec<T, N> select(clode_vec<T, N> a, clode_vec<T, N> b, clode_vec<M, N> c)
+{
+	clode_vec<T, N> r;
+	for (int k = 0; k < N; ++k)
+		r.v[k] = c.v[k] < 0 ? b.v[k] : a.v[k];
+	return r;
+}
+
+//lane by lane through the C library. Binary functions take a scalar for either argument, like the OpenCL builtins
+#define CLODE_VEC_FUNCTION1(f)                                              \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a)   \
+	{                                                                       \
+		clode_vec<T, N> r;                                                  \
+		for (int k = 0; k < N; ++k)                                         \
+			r.v[k] = ::f(a.v[k]);                                           \
+		return r;                                                           \
+	}
+
+#define CLODE_VEC_FUNCTION2(f)                                                                                    \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a, clode_vec<T, N> b)                      \
+	{                                                                                                             \
+		clode_vec<T, N> r;                                                                                        \
+		for (int k = 0; k < N; ++k)                                                                               \
+			r.v[k] = ::f(a.v[k], b.v[k]);                                                                         \
+		return r;                                                                                                 \
+	}                                                                                                             \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a, typename clode_vec<T, N>::scalar b)     \
+	{                                                                                                             \
+		return f(a, clode_vec<T, N>(b));                                                                          \
+	}                                                                                                             \
+	template <class T, int N> inline clode_vec<T, N> f(typename clode_vec<T, N>::scalar a, clode_vec<T, N> b)     \
+	{                                                                                                             \
+		return f(clode_vec<T, N>(a), b);                                                                          \
+	}
+
+#define CLODE_VEC_FUNCTION3(f)                                                                                    \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a, clode_vec<T, N> b, clode_vec<T, N> c)   \
+	{                                                                                                             \
+		clode_vec<T, N> r;                                                                                        \
+		for (int k = 0; k < N; ++k)                                                                               \
+			r.v[k] = ::f(a.v[k], b.v[k], c.v[k]);                                                                 \
+		return r;                                                                                                 \
+	}                                                                                                             \
+	template <class T, int N> inline clode_vec<T, N> f(typename clode_vec<T, N>::scalar a, clode_vec<T, N> b, clode_vec<T, N> c) \
+	{                                                                                                             \
+		return f(clode_vec<T, N>(a), b, c);                                                                       \
+	}                                                                                                             \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a, typename clode_vec<T, N>::scalar b, clode_vec<T, N> c) \
+	{                                                                                                             \
+		return f(a, clode_vec<T, N>(b), c);                                                                       \
+	}                                                                                                             \
+	template <class T, int N> inline clode_vec<T, N> f(clode_vec<T, N> a, clode_vec<T, N> b, typename clode_vec<T, N>::scalar c) \
+	{                                                                                                             \
+		return f(a, b, clode_vec<T, N>(c));                                                                       \
+	}
+
+CLODE_VEC_FUNCTION1(fabs)
+CLODE_VEC_FUNCTION1(sqrt)
+CLODE_VEC_FUNCTION1(cbrt)
+CLODE_VEC_FUNCTION1(exp)
+CLODE_VEC_FUNCTION1(exp2)
+CLODE_VEC_FUNCTION1(expm1)
+CLODE_VEC_FUNCTION1(log)
+CLODE_VEC_FUNCTION1(log2)
+CLODE_VEC_FUNCTION1(log10)
+CLODE_VEC_FUNCTION1(log1p)
+CLODE_VEC_FUNCTION1(sin)
+CLODE_VEC_FUNCTION1(cos)
+CLODE_VEC_FUNCTION1(tan)
+CLODE_VEC_FUNCTION1(asin)
+CLODE_VEC_FUNCTION1(acos)
+CLODE_VEC_FUNCTION1(atan)
+CLODE_VEC_FUNCTION1(sinh)
+CLODE_VEC_FUNCTION1(cosh)
+CLODE_VEC_FUNCTION1(tanh)
+CLODE_VEC_FUNCTION1(floor)
+CLODE_VEC_FUNCTION1(ceil)
+CLODE_VEC_FUNCTION1(round)
+CLODE_VEC_FUNCTION1(trunc)
+CLODE_VEC_FUNCTION1(erf)
+CLODE_VEC_FUNCTION1(erfc)
+CLODE_VEC_FUNCTION2(pow)
+CLODE_VEC_FUNCTION2(fmin)
+CLODE_VEC_FUNCTION2(fmax)
+CLODE_VEC_FUNCTION2(fmod)
+CLODE_VEC_FUNCTION2(atan2)
+CLODE_VEC_FUNCTION2(hypot)
+CLODE_VEC_FUNCTION2(copysign)
+CLODE_VEC_FUNCTION2(nextafter)
+CLODE_VEC_FUNCTION3(fma)
+
+//integer min/max, which the lane-batched kernels use on step counts
+template <class T> inline T min(T a, T b)
+{
+	return b < a ? b : a;
+}
+template <class T> inline T max(T a, T b)
+{
+	return a < b ? b : a;
+}
+
+//step(edge, x): 0 where x < edge, else 1
+template <class T, int N> inline clode_vec<T, N> step(clode_vec<T, N> edge, clode_vec<T, N> x)
+{
+	return select(clode_vec<T, N>(1), clode_vec<T, N>(0), x < edge);
+}
+template <class T, int N> inline clode_vec<T, N> step(typename clode_vec<T, N>::scalar edge, clode_vec<T, N> x)
+{
+	return step(clode_vec<T, N>(edge), x);
+}
+
+//the clODE sources test __cplusplus for their host-side declarations: what follows is device code
+#undef __cplusplus
+#endif //__cplusplus
+
+#endif //CLODE_NATIVE_SHIM_H_
@@ -0,0 +1,109 @@
+//lane-batched kernels: each work-item advances CLODE_SIMD_LANES trajectories in lockstep, with realtype as a floatN/doubleN
+//vector in the steppers and the RHS. Work-item i holds points i*CLODE_SIMD_LANES ... i*CLODE_SIMD_LANES+CLODE_SIMD_LANES-1,
+//which are contiguous in the SoA arrays, so the state is read and written with vloadN/vstoreN.
+//
+//Include after all the scalar headers (utilities, observers) and before steppers.cl: from here on, realtype means the vector
+//type, so the steppers and the RHS appended to the program are compiled for vectors. Kernels use realscalar for per-point data.
+//The RHS must then be valid OpenCL for vector arguments: no if/else on state variables (use select, step, fmin/fmax...)
+
+#ifndef CLODE_SIMD_H_
+#define CLODE_SIMD_H_
+
+#include "clODE_struct_defs.cl"
+#include "clODE_utilities.cl"
+#include "realtype.cl"
+
+#if !defined(CLODE_SIMD_LANES) || (CLODE_SIMD_LANES != 2 && CLODE_SIMD_LANES != 4 && CLODE_SIMD_LANES != 8 && CLODE_SIMD_LANES != 16)
+#error "CLODE_SIMD_LANES must be 2, 4, 8 or 16"
+#endif
+
+#ifdef STOCHASTIC_EULER
+#error "Lane-batched kernels do not support stochastic steppers"
+#endif
+
+#define SIMD_CAT_(a, b) a##b
+#define SIMD_CAT(a, b) SIMD_CAT_(a, b)
+
+typedef realtype realscalar;
+
+#if defined(CLODE_SINGLE_PRECISION)
+typedef SIMD_CAT(float, CLODE_SIMD_LANES) realvec;
+typedef SIMD_CAT(int, CLODE_SIMD_LANES) maskvec; //result type of realvec comparisons: -1 (all bits set) in true lanes
+typedef int maskscalar;
+#else
+typedef SIMD_CAT(double, CLODE_SIMD_LANES) realvec;
+typedef SIMD_CAT(long, CLODE_SIMD_LANES) maskvec;
+typedef long maskscalar;
+#endif
+
+#define VLOAD SIMD_CAT(vload, CLODE_SIMD_LANES)
+#define VSTORE SIMD_CAT(vstore, CLODE_SIMD_LANES)
+
+//vector components can't be indexed at runtime: go through private arrays of one value per lane
+inline void loadVars(realvec v[], __global realscalar *src, int n, int i, int nPts)
+{
+    for (int j = 0; j < n; ++j)
+        v[j] = VLOAD(i, src + j * nPts);
+}
+
+inline void storeVars(realvec v[], __global realscalar *dst, int n, int i, int nPts)
+{
+    for (int j = 0; j < n; ++j)
+        VSTORE(v[j], i, dst + j * nPts);
+}
+
+//lane-major copy of n vectors: s[k*n+j] is component k of v[j]
+inline void splitLanes(realvec v[], int n, realscalar s[])
+{
+    realscalar lane[CLODE_SIMD_LANES];
+    for (int j = 0; j < n; ++j)
+    {
+        VSTORE(v[j], 0, lane);
+        for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+            s[k * n + j] = lane[k];
+    }
+}
+
+inline void loadParsLanes(realvec p[], PARS_PTR pars, int i, int nPts)
+{
+    realscalar pk[N_PAR], lanes[N_PAR * CLODE_SIMD_LANES];
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+    {
+        loadPars(pk, pars, i * CLODE_SIMD_LANES + k, nPts);
+        for (int j = 0; j < N_PAR; ++j)
+            lanes[j * CLODE_SIMD_LANES + k] = pk[j];
+    }
+    for (int j = 0; j < N_PAR; ++j)
+        p[j] = VLOAD(j, lanes);
+}
+
+//per-lane flags for scalar code (observers, stores) to/from a mask vector
+inline void splitMask(maskvec m, maskscalar s[])
+{
+    SIMD_CAT(vstore, CLODE_SIMD_LANES)(m, 0, s);
+}
+
+inline maskvec joinMask(maskscalar s[])
+{
+    return SIMD_CAT(vload, CLODE_SIMD_LANES)(0, s);
+}
+
+//the conditional-operator helpers of clODE_utilities.cl don't apply to vectors
+#undef MIN
+#undef MAX
+#undef heav
+#define MIN(a, b) fmin((realvec)(a), (realvec)(b))
+#define MAX(a, b) fmax((realvec)(a), (realvec)(b))
+#define heav(x) step(RCONST(0.0), (x))
+
+//PARS_PTR expands where it is used: keep it scalar
+#undef PARS_PTR
+#ifdef PARS_GLOBAL
+#define PARS_PTR __global const realscalar *restrict
+#else
+#define PARS_PTR __constant realscalar *
+#endif
+
+#define realtype realvec
+
+#endif //CLODE_SIMD_H_
@@ -20,6 +20,170 @@
 
 //TODO twosum for accurate summation (e.g. t+=dt...)?
 
+//address space of the parameter array (CLODE::setParsMemory): per-point parameters are read at a different address by every
+//work-item, which suits read-only global memory better than __constant (also capped at CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE)
+#ifdef PARS_GLOBAL
+#define PARS_PTR __global const realtype *restrict
+#else
+#define PARS_PTR __constant realtype *
+#endif
+
+//private copy of the parameters of point i. Parameters that are uniform across all points may be compiled in
+//(-DUNIFORM_PARS, -DPAR_COLUMN set by CLODE::setUniformPars): pars then holds only the varying columns, and the
+//uniform values are constants the compiler can fold into the RHS
+//In grid-sweep mode (-DGRID_AXES, -DGRID_PAR_IX set by CLODE::setParameterGrid) pars is {base values [N_PAR], then lb, step, n
+//of each axis}, and the axis parameters are generated from i, first axis fastest
+#ifdef UNIFORM_PARS
+__constant realtype uniformPars[N_PAR] = {UNIFORM_PARS};
+__constant int parColumn[N_PAR] = {PAR_COLUMN};
+#endif
+#ifdef GRID_AXES
+__constant int gridParIx[GRID_AXES] = {GRID_PAR_IX};
+#endif
+
+inline void loadPars(realtype p[], PARS_PTR pars, int i, int nPts)
+{
+#ifdef GRID_AXES
+	for (int j = 0; j < N_PAR; ++j)
+#ifdef UNIFORM_PARS
+		p[j] = parColumn[j] < 0 ? uniformPars[j] : pars[j];
+#else
+		p[j] = pars[j];
+#endif
+
+	int k = i;
+	for (int a = 0; a < GRID_AXES; ++a)
+	{
+		int n = (int)pars[N_PAR + 3 * a + 2];
+		p[gridParIx[a]] = pars[N_PAR + 3 * a] + (realtype)(k % n) * pars[N_PAR + 3 * a + 1];
+		k /= n;
+	}
+#else
+	for (int j = 0; j < N_PAR; ++j)
+#ifdef UNIFORM_PARS
+		p[j] = parColumn[j] < 0 ? uniformPars[j] : pars[parColumn[j] * nPts + i];
+#else
+		p[j] = pars[j * nPts + i];
+#endif
+#endif
+}
+
+//index of element j (of nElem) of stored point storeix of trajectory i in the trajectory outputs t/x/dx/aux, in the layout
+//chosen by CLODEtrajectory::setOutputLayout: time-major [storeix][j][i] (default, coalesced on GPUs), trajectory-major
+//[i][storeix][j] (-DTRAJ_LAYOUT_TRAJECTORY_MAJOR, one trajectory is contiguous) or tiled [i/TRAJ_TILE][storeix][j][i%TRAJ_TILE]
+inline size_t storeIndex(int storeix, int j, int nElem, int i, int nPts, int maxStore)
+{
+#ifdef TRAJ_STREAM
+	storeix %= maxStore; //ring of maxStore points per trajectory
+#endif
+#if defined(TRAJ_LAYOUT_TRAJECTORY_MAJOR)
+	return ((size_t)i * maxStore + storeix) * nElem + j;
+#elif defined(TRAJ_TILE)
+	return (((size_t)(i / TRAJ_TILE) * maxStore + storeix) * nElem + j) * TRAJ_TILE + i % TRAJ_TILE;
+#else
+	return ((size_t)storeix * nElem + j) * nPts + i;
+#endif
+}
+
+//store masks chosen by CLODEtrajectory::setStoreMasks: the trajectory kernels store only the N_STORE_X components STORE_X_IX
+//of x (an index list, e.g. -DSTORE_X_IX=0,2), and likewise for dx and aux. Without the defines, all components are stored
+#if defined(TRAJ_STREAM) && defined(TRAJ_STORE_AT_TIMES)
+#error "Streaming is not supported in store-at-times mode"
+#endif
+
+#ifndef N_STORE_X
+#define N_STORE_X N_VAR
+#endif
+#ifndef N_STORE_DX
+#define N_STORE_DX N_VAR
+#endif
+#ifndef N_STORE_AUX
+#define N_STORE_AUX N_AUX
+#endif
+
+#ifdef STORE_X_IX
+__constant int storeXIx[] = {STORE_X_IX};
+#define STORE_X(j) storeXIx[j]
+#else
+#define STORE_X(j) (j)
+#endif
+
+#ifdef STORE_DX_IX
+__constant int storeDxIx[] = {STORE_DX_IX};
+#define STORE_DX(j) storeDxIx[j]
+#else
+#define STORE_DX(j) (j)
+#endif
+
+#ifdef STORE_AUX_IX
+__constant int storeAuxIx[] = {STORE_AUX_IX};
+#define STORE_AUX(j) storeAuxIx[j]
+#else
+#define STORE_AUX(j) (j)
+#endif
+
+//reduced-precision storage (CLODEtrajectory/CLODEfeatures::setStorageFormat) of the trajectory outputs x/dx/aux
+//(-DTRAJ_STORAGE_HALF, -DTRAJ_STORAGE_Q16) and of the feature matrix F (-DFEATURE_STORAGE_HALF, -DFEATURE_STORAGE_Q16).
+//Half uses vstore_half, so no cl_khr_fp16 is needed. Q16 stores q = (value - offset)/scale rounded and saturated to ushort,
+//with {scale, offset} per component compiled in: TRAJ_Q16_X/DX (per variable), TRAJ_Q16_AUX (per aux), FEATURE_Q16 (per feature)
+//The helpers and builtins are only referenced under these defines, which the native backend never sets: its shim has no half
+//type, vstore_half or convert_ushort_sat_rte
+#if defined(TRAJ_STORAGE_Q16) || defined(FEATURE_STORAGE_Q16)
+inline ushort encodeQ16(realtype value, realtype scale, realtype offset)
+{
+	return convert_ushort_sat_rte((value - offset) / scale);
+}
+#endif
+
+#if defined(TRAJ_STORAGE_HALF)
+typedef half trajstore;
+#define STORE_TRAJ(buf, ix, value, q16, j) vstore_half((value), (ix), (buf))
+#elif defined(TRAJ_STORAGE_Q16)
+typedef ushort trajstore;
+__constant realtype trajQ16X[2 * N_VAR] = {TRAJ_Q16_X};
+__constant realtype trajQ16Dx[2 * N_VAR] = {TRAJ_Q16_DX};
+__constant realtype trajQ16Aux[2 * N_AUX] = {TRAJ_Q16_AUX};
+#define STORE_TRAJ(buf, ix, value, q16, j) ((buf)[ix] = encodeQ16((value), (q16)[2 * (j)], (q16)[2 * (j) + 1]))
+#else
+typedef realtype trajstore;
+#define STORE_TRAJ(buf, ix, value, q16, j) ((buf)[ix] = (value))
+#endif
+
+//write the stored components of point storeix, in the storage format of x/dx/aux (trajstore). Shared by trajectory.cl and odedriver.cl
+inline void storePoint(int storeix, realtype xi[], realtype dxi[], realtype auxi[], __global trajstore *x, __global trajstore *dx,
+					   __global trajstore *aux, int i, int nPts, int maxStore)
+{
+	for (int j = 0; j < N_STORE_X; ++j)
+		STORE_TRAJ(x, storeIndex(storeix, j, N_STORE_X, i, nPts, maxStore), xi[STORE_X(j)], trajQ16X, STORE_X(j));
+
+	for (int j = 0; j < N_STORE_DX; ++j)
+		STORE_TRAJ(dx, storeIndex(storeix, j, N_STORE_DX, i, nPts, maxStore), dxi[STORE_DX(j)], trajQ16Dx, STORE_DX(j));
+
+	for (int j = 0; j < N_STORE_AUX; ++j)
+		STORE_TRAJ(aux, storeIndex(storeix, j, N_STORE_AUX, i, nPts, maxStore), auxi[STORE_AUX(j)], trajQ16Aux, STORE_AUX(j));
+}
+
+#if defined(FEATURE_STORAGE_HALF)
+typedef half featurestore;
+#elif defined(FEATURE_STORAGE_Q16)
+typedef ushort featurestore;
+__constant realtype featureQ16[] = {FEATURE_Q16};
+#else
+typedef realtype featurestore;
+#endif
+
+//feature j of point i, for the observers' finalizeFeatures
+inline void storeFeature(__global featurestore *F, int j, int i, int nPts, realtype value)
+{
+#if defined(FEATURE_STORAGE_HALF)
+	vstore_half(value, j * nPts + i, F);
+#elif defined(FEATURE_STORAGE_Q16)
+	F[j * nPts + i] = encodeQ16(value, featureQ16[2 * j], featureQ16[2 * j + 1]);
+#else
+	F[j * nPts + i] = value;
+#endif
+}
+
 //1-norm
 inline realtype norm_1(realtype x[], int N)
 {
@@ -102,6 +266,13 @@ inline void runningMean(realtype *mean, realtype thisValue, int eventCount)
 	}
 }
 
+//running mean of a value held outside private memory, e.g. cold observer fields (OCOLD in observers.cl)
+inline realtype runningMeanValue(realtype mean, realtype thisValue, int eventCount)
+{
+	runningMean(&mean, thisValue, eventCount);
+	return mean;
+}
+
 //Compute a running mean and variance. NOTE: once the variance value is desired, it must be divided
 //by the final event count!
 inline void runningMeanVar(realtype *mean, realtype *variance, realtype thisValue, int eventCount)
@@ -168,9 +339,96 @@ inline void quadraticInterpVertex(realtype t[], realtype y[], realtype *tv, real
 	*yv = b0 + b1 * (*tv - t[0]) + b2 * (*tv - t[0]) * (*tv - t[1]);
 }
 
-//TODO: cubic interpolation between two points with slopes
-//~ inline realtype cubicInterp(realtype t[], realtype y[], realtype dy[], realtype ti) {
-//~ return yi;
-//~ }
+//event location: observers buffer (t, x, dx) of the last steps, so between two steps the solution is known to third order as
+//the Hermite cubic through both points with their slopes - the interpolant of the stepper, up to its own dense output.
+//Threshold crossings and extrema are placed on it by a few Illinois (modified regula falsi) iterations, so their time and
+//value do not degrade with the step size. Iterations can be set with -DEVENT_LOCATION_ITERATIONS=n
+#ifndef EVENT_LOCATION_ITERATIONS
+#define EVENT_LOCATION_ITERATIONS 10
+#endif
+
+//coefficients of the Hermite cubic on [t0,t1] in s=(t-t0)/(t1-t0): y(s) = c[0] + c[1]*s + c[2]*s^2 + c[3]*s^3
+inline void cubicInterpCoefficients(realtype t0, realtype t1, realtype y0, realtype y1, realtype dy0, realtype dy1, realtype c[4])
+{
+	realtype h = t1 - t0;
+	c[0] = y0;
+	c[1] = h * dy0;
+	c[2] = RCONST(3.0) * (y1 - y0) - h * (RCONST(2.0) * dy0 + dy1);
+	c[3] = RCONST(2.0) * (y0 - y1) + h * (dy0 + dy1);
+}
+
+//estimate yi at specified ti in [t0,t1], using the cubic through two points with slopes
+inline realtype cubicInterp(realtype t0, realtype t1, realtype y0, realtype y1, realtype dy0, realtype dy1, realtype ti)
+{
+	realtype c[4];
+	cubicInterpCoefficients(t0, t1, y0, y1, dy0, dy1, c);
+	realtype s = (ti - t0) / (t1 - t0);
+	return c[0] + s * (c[1] + s * (c[2] + s * c[3]));
+}
+
+//root in s in [0,1] of the cubic c[0] + c[1]*s + c[2]*s^2 + c[3]*s^3, which must change sign over [0,1]. Illinois iterations
+//keep the root bracketed, so this is as robust as bisection and converges superlinearly
+inline realtype cubicRootIllinois(realtype c[4])
+{
+	realtype a = RCONST(0.0), b = RCONST(1.0);
+	realtype fa = c[0], fb = c[0] + c[1] + c[2] + c[3];
+	int side = 0;
+	for (int k = 0; k < EVENT_LOCATION_ITERATIONS && fa != fb; ++k)
+	{
+		realtype s = (a * fb - b * fa) / (fb - fa);
+		realtype fs = c[0] + s * (c[1] + s * (c[2] + s * c[3]));
+		if (fs * fb > RCONST(0.0))
+		{
+			b = s;
+			fb = fs;
+			if (side == -1)
+				fa *= RCONST(0.5);
+			side = -1;
+		}
+		else if (fs * fa > RCONST(0.0))
+		{
+			a = s;
+			fa = fs;
+			if (side == 1)
+				fb *= RCONST(0.5);
+			side = 1;
+		}
+		else
+			return s; //fs == 0
+	}
+	return fa == fb ? a : (a * fb - b * fa) / (fb - fa);
+}
+
+//time in [t0,t1] at which the cubic through two points with slopes crosses level. If y0 and y1 are not on opposite sides of
+//level (e.g. the crossing was in an earlier step), returns t1: the coarse event time
+inline realtype cubicInterpCrossing(realtype t0, realtype t1, realtype y0, realtype y1, realtype dy0, realtype dy1, realtype level)
+{
+	if ((y0 - level) * (y1 - level) > RCONST(0.0) || t1 <= t0)
+		return t1;
+
+	realtype c[4];
+	cubicInterpCoefficients(t0, t1, y0, y1, dy0, dy1, c);
+	c[0] -= level;
+	return t0 + (t1 - t0) * cubicRootIllinois(c);
+}
+
+//extremum (tv, yv) in [t0,t1] of the cubic through two points with slopes, located where its slope changes sign. Returns false
+//if dy0 and dy1 have the same sign: no extremum is bracketed, and the caller keeps its coarse estimate
+inline bool cubicInterpExtremum(realtype t0, realtype t1, realtype y0, realtype y1, realtype dy0, realtype dy1, realtype *tv, realtype *yv)
+{
+	if (dy0 * dy1 > RCONST(0.0) || t1 <= t0)
+		return false;
+
+	realtype c[4], dc[4];
+	cubicInterpCoefficients(t0, t1, y0, y1, dy0, dy1, c);
+	dc[0] = c[1];
+	dc[1] = RCONST(2.0) * c[2];
+	dc[2] = RCONST(3.0) * c[3];
+	dc[3] = RCONST(0.0);
+	realtype s = cubicRootIllinois(dc);
+	*tv = t0 + (t1 - t0) * s;
+	*yv = c[0] + s * (c[1] + s * (c[2] + s * c[3]));
+	return true;
+}
 
 #endif //CL_UTILITIES_H_
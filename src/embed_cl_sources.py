@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Generates clODE_embedded_sources.hpp: the OpenCL kernel sources of clODE as string literals, so the library can be
+# compiled with -DCLODE_EMBED_SOURCES and build its programs without reading CLODE_ROOT at runtime.
+#
+# Each top-level kernel file is stored with its #include "..." tree already expanded. The stepper/observer selection is
+# left to the #ifdefs in steppers.cl and observers.cl, so one expanded source serves every stepper and observer.
+#
+# usage: python3 embed_cl_sources.py [output header]   (default: clODE_embedded_sources.hpp next to this script)
+
+import os
+import re
+import sys
+
+KERNELS = ["transient.cl", "trajectory.cl", "initializeObserver.cl", "features.cl", "odedriver.cl", "clODE_native_shim.h",
+           "transient_simd.cl", "trajectory_simd.cl", "initializeObserver_simd.cl", "features_simd.cl"]
+
+INCLUDE = re.compile(r'^\s*#\s*include\s*"([^"]+)"')
+DIRECTIVE = re.compile(r'^\s*#\s*(\w+)')
+
+# MSVC limits a single string literal to ~16K; longer sources are emitted as adjacent literals
+MAX_LITERAL = 8000
+DELIM = "clode_src"
+
+
+def has_include_guard(text):
+    """True if the first preprocessor directive is an #ifndef, i.e. the file can be expanded once per program."""
+    for line in text.splitlines():
+        m = DIRECTIVE.match(line)
+        if m:
+            return m.group(1) == "ifndef"
+    return False
+
+
+def expand(name, root, guarded_seen):
+    with open(os.path.join(root, name)) as f:
+        text = f.read()
+
+    if has_include_guard(text):
+        if name in guarded_seen:
+            return ""
+        guarded_seen.add(name)
+
+    out = []
+    for line in text.splitlines(keepends=True):
+        m = INCLUDE.match(line)
+        if m:
+            # keep includes that are commented out or not found (e.g. <string> for C++) untouched
+            if os.path.isfile(os.path.join(root, m.group(1))):
+                out.append("// " + line.lstrip())
+                out.append(expand(m.group(1), root, guarded_seen))
+                if not out[-1].endswith("\n"):
+                    out.append("\n")
+                continue
+        out.append(line)
+    return "".join(out)
+
+
+def literal(text):
+    chunks = [text[i:i + MAX_LITERAL] for i in range(0, len(text), MAX_LITERAL)] or [""]
+    return "\n".join('R"%s(%s)%s"' % (DELIM, chunk, DELIM) for chunk in chunks)
+
+
+def main():
+    root = os.path.dirname(os.path.abspath(__file__))
+    output = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, "clODE_embedded_sources.hpp")
+
+    entries = []
+    for kernel in KERNELS:
+        source = expand(kernel, root, set())
+        if (")" + DELIM + '"') in source:
+            sys.exit("embed_cl_sources.py: raw string delimiter found in " + kernel)
+        entries.append('    {"%s",\n%s},' % (kernel, literal(source)))
+
+    header = (
+        "// Generated by embed_cl_sources.py from the clODE kernel sources. Do not edit.\n"
+        "#ifndef CLODE_EMBEDDED_SOURCES_HPP_\n"
+        "#define CLODE_EMBEDDED_SOURCES_HPP_\n\n"
+        "#include <map>\n"
+        "#include <string>\n\n"
+        "static const std::map<std::string, std::string> clodeEmbeddedSources = {\n"
+        + "\n".join(entries)
+        + "\n};\n\n"
+        "#endif //CLODE_EMBEDDED_SOURCES_HPP_\n"
+    )
+
+    # only touch the header when its contents change, to avoid needless rebuilds
+    if os.path.isfile(output):
+        with open(output) as f:
+            if f.read() == header:
+                return
+    with open(output, "w") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
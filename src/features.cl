@@ -8,30 +8,32 @@
 #include "steppers.cl"
 
 __kernel void features(
-	__constant realtype *tspan,         //time vector [t0,tf] - adds (tf-t0) to these at the end
+	__constant realtype *tspan,         //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
 	__global realtype *x0,              //initial state 				[nPts*nVar]
-	__constant realtype *pars,          //parameter values				[nPts*nPar]
+	PARS_PTR pars,                      //parameter values				[nPts*nPar]
 	__constant struct SolverParams *sp, //dtmin/max, tols, etc
 	__global realtype *xf,              //final state 				[nPts*nVar]
 	__global ulong *RNGstate,           //state for RNG					[nPts*nRNGstate]
     __global realtype *d_dt,            //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realtype *tNow,            //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
 	__global ObserverData *OData,		//for continue
 	__constant struct ObserverParams *opars,
-	__global realtype *F)
+	__global featurestore *F,
+	__constant realtype *tspanFull)     //time vector [t0,tf] of the whole run - adds (tf-t0) to observer times at the end
 {
 	int i = get_global_id(0);
 	int nPts = get_global_size(0);
 
 	realtype ti, dt;
-    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR + STEPPER_HISTORY_SIZE], auxi[N_AUX], wi[N_WIENER];
 	rngData rd;
 
 	//get private copy of ODE parameters, initial data, and compute slope at initial state
-	ti = tspan[0];
-	dt = sp->dt;
+	ti = tNow[i]; //tspan[0], or where the previous chunk of the run stopped
+	dt = d_dt[i]; //sp->dt, or the step size carried over from the previous chunk
 
-	for (int j = 0; j < N_PAR; ++j)
-		p[j] = pars[j * nPts + i];
+	loadPars(p, pars, i, nPts);
 
 	for (int j = 0; j < N_VAR; ++j)
 		xi[j] = x0[j * nPts + i];
@@ -48,11 +50,13 @@ __kernel void features(
         wi[j] = RCONST(0.0);
 #endif
 	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5)
+	resetStepperHistory(dxi);
 
 	ObserverData odata = OData[i]; //private copy of observer data
+	ObserverCold ocold = getObserverCold(OData, i, nPts);
 
 	//time-stepping loop, main time interval
-    int step = 0;
+    int step = stepCount[i];
     int stepflag = 0;
 	bool eventOccurred;
 	bool terminalEvent;
@@ -66,24 +70,26 @@ __kernel void features(
 
 		//TODO: Update solution buffers here?
 
-		eventOccurred = eventFunction(&ti, xi, dxi, auxi, &odata, opars);
+		eventOccurred = eventFunction(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 		if (eventOccurred)
 		{
-			terminalEvent = computeEventFeatures(&ti, xi, dxi, auxi, &odata, opars);
+			terminalEvent = computeEventFeatures(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 			if (terminalEvent)
 			{
+				step = sp->max_steps; //later chunks of the run take no steps either
 				break;
 			};
 		}
 
-		updateObserverData(&ti, xi, dxi, auxi, &odata, opars); 
+		updateObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars); 
 	}
 
 	//readout features of interest and write to global F:
-	finalizeFeatures(&ti, xi, dxi, auxi, &odata, opars, F, i, nPts);
+	finalizeFeatures(&ti, xi, dxi, auxi, &odata, &ocold, opars, F, i, nPts);
 
-	//finalize observerdata for possible continuation
-	finalizeObserverData(&ti, xi, dxi, auxi, &odata, opars, tspan);
+	//finalize observerdata for possible continuation. Observer times stay absolute between chunks of one run
+	if (tspan[1] == tspanFull[1])
+		finalizeObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars, tspanFull);
 
 	OData[i] = odata;
 
@@ -95,6 +101,9 @@ __kernel void features(
 	for (int j = 0; j < N_RNGSTATE; ++j)
 		RNGstate[j * nPts + i] = rd.state[j];
 
+    tNow[i] = ti;
+    stepCount[i] = step;
+
     // update dt to its final value (for adaptive stepper continue)
-    // d_dt[i] = dt;
+    d_dt[i] = dt;
 }
@@ -0,0 +1,117 @@
+// lane-batched features (CLODE::setSimdLanes): the trajectories are integrated as vectors, and the observer routines run per
+// lane on scalar copies of the state after each step. A lane stops at its terminal event. Same arguments as features.cl
+
+#include "clODE_random.cl"
+#include "clODE_struct_defs.cl"
+#include "clODE_utilities.cl"
+#include "observers.cl"
+#include "clODE_simd.cl"
+#include "steppers.cl"
+
+__kernel void features(
+	__constant realscalar *tspan,       //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
+	__global realscalar *x0,            //initial state 				[nPts*nVar]
+	PARS_PTR pars,                      //parameter values				[nPts*nPar]
+	__constant struct SolverParams *sp, //dtmin/max, tols, etc
+	__global realscalar *xf,            //final state 				[nPts*nVar]
+	__global ulong *RNGstate,           //state for RNG					[nPts*nRNGstate]
+    __global realscalar *d_dt,          //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realscalar *tNow,          //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+	__global ObserverData *OData,		//for continue
+	__constant struct ObserverParams *opars,
+	__global featurestore *F,
+	__constant realscalar *tspanFull)   //time vector [t0,tf] of the whole run - adds (tf-t0) to observer times at the end
+{
+	int i = get_global_id(0);
+	int nPts = get_global_size(0) * CLODE_SIMD_LANES;
+
+	realtype ti, dt;
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+	realscalar tl[CLODE_SIMD_LANES], xl[CLODE_SIMD_LANES * N_VAR], dxl[CLODE_SIMD_LANES * N_VAR], auxl[CLODE_SIMD_LANES * N_AUX];
+
+	//get private copy of ODE parameters, initial data, and compute slope at initial state
+	ti = VLOAD(i, tNow); //tspan[0], or where the previous chunk of the run stopped
+	dt = VLOAD(i, d_dt); //sp->dt, or the step size carried over from the previous chunk
+
+	loadParsLanes(p, pars, i, nPts);
+	loadVars(xi, x0, N_VAR, i, nPts);
+
+	for (int j = 0; j < N_WIENER; ++j)
+		wi[j] = RCONST(0.0);
+
+	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5)
+
+	ObserverData odata[CLODE_SIMD_LANES]; //private copy of observer data, per lane
+	ObserverCold ocold[CLODE_SIMD_LANES];
+	maskscalar running[CLODE_SIMD_LANES], activel[CLODE_SIMD_LANES];
+	int step = sp->max_steps; //shared by the lanes. A lane stopped by a terminal event in an earlier chunk holds max_steps
+	for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+	{
+		odata[k] = OData[i * CLODE_SIMD_LANES + k];
+		ocold[k] = getObserverCold(OData, i * CLODE_SIMD_LANES + k, nPts);
+		running[k] = stepCount[i * CLODE_SIMD_LANES + k] < sp->max_steps ? -1 : 0;
+		step = min(step, stepCount[i * CLODE_SIMD_LANES + k]);
+	}
+
+	//time-stepping loop, main time interval. Lanes that reach tspan[1] or a terminal event are masked out until all are done
+	maskvec active;
+	while (true)
+	{
+		active = (ti < tspan[1]) & joinMask(running);
+		if (!any(active) || step >= sp->max_steps)
+			break;
+
+		++step;
+        stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active);
+
+		VSTORE(ti, 0, tl);
+		splitLanes(xi, N_VAR, xl);
+		splitLanes(dxi, N_VAR, dxl);
+		splitLanes(auxi, N_AUX, auxl);
+		splitMask(active, activel);
+		for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+		{
+			if (!activel[k])
+				continue;
+
+			realscalar *xk = xl + k * N_VAR, *dxk = dxl + k * N_VAR, *auxk = auxl + k * N_AUX;
+			++odata[k].stepcount;
+			if (eventFunction(&tl[k], xk, dxk, auxk, &odata[k], &ocold[k], opars))
+			{
+				if (computeEventFeatures(&tl[k], xk, dxk, auxk, &odata[k], &ocold[k], opars))
+				{
+					running[k] = 0;
+					continue;
+				}
+			}
+
+			updateObserverData(&tl[k], xk, dxk, auxk, &odata[k], &ocold[k], opars);
+		}
+	}
+
+	//readout features of interest and write to global F. tl, xl... hold the final state of every lane
+	VSTORE(ti, 0, tl);
+	splitLanes(xi, N_VAR, xl);
+	splitLanes(dxi, N_VAR, dxl);
+	splitLanes(auxi, N_AUX, auxl);
+	for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+	{
+		int ik = i * CLODE_SIMD_LANES + k;
+		finalizeFeatures(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars, F, ik, nPts);
+
+		//finalize observerdata for possible continuation. Observer times stay absolute between chunks of one run
+		if (tspan[1] == tspanFull[1])
+			finalizeObserverData(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars, tspanFull);
+
+		OData[ik] = odata[k];
+		stepCount[ik] = running[k] ? step : sp->max_steps;
+	}
+
+    //write the final solution values to global memory.
+	storeVars(xi, xf, N_VAR, i, nPts);
+	VSTORE(ti, i, tNow);
+
+    // update dt to its final value (for adaptive stepper continue)
+    VSTORE(dt, i, d_dt);
+}
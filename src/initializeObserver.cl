@@ -9,7 +9,7 @@
 __kernel void initializeObserver(
 	__constant realtype *tspan,			//time vector [t0,tf] - adds (tf-t0) to these at the end
 	__global realtype *x0,				//initial state 				[nPts*nVar]
-	__constant realtype *pars,			//parameter values				[nPts*nPar]
+	PARS_PTR pars,					//parameter values				[nPts*nPar]
 	__constant struct SolverParams *sp, //dtmin/max, tols, etc
 	__global ulong *RNGstate,			//enables host seeding/continued streams	    [nPts*nRNGstate]
     __global realtype *d_dt,            //array of dt values, one per solver
@@ -20,15 +20,14 @@ __kernel void initializeObserver(
 	int nPts = get_global_size(0);
 
 	realtype ti, dt;
-    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR + STEPPER_HISTORY_SIZE], auxi[N_AUX], wi[N_WIENER];
 	rngData rd;
 
 	//get private copy of ODE parameters, initial data, and compute slope at initial state
 	ti = tspan[0];
 	dt = sp->dt;
 
-	for (int j = 0; j < N_PAR; ++j)
-		p[j] = pars[j * nPts + i];
+	loadPars(p, pars, i, nPts);
 
 	for (int j = 0; j < N_VAR; ++j)
 		xi[j] = x0[j * nPts + i];
@@ -43,12 +42,15 @@ __kernel void initializeObserver(
         wi[j] = randn(&rd) / sqrt(dt);
 #endif
 	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL
+	resetStepperHistory(dxi);
 
 	ObserverData odata = OData[i]; //private copy of observer data
+	ObserverCold ocold = getObserverCold(OData, i, nPts);
 
-	initializeObserverData(&ti, xi, dxi, auxi, &odata, opars);
+	initializeObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 
 #ifdef TWO_PASS_EVENT_DETECTOR
+	initializeWarmupData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 
     int step = 0;
     int stepflag = 0;
@@ -59,15 +61,111 @@ __kernel void initializeObserver(
         // if (stepflag!=0)
         //     break;
 
-		warmupObserverData(&ti, xi, dxi, auxi, &odata, opars);
+		warmupObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 	}
 
 #endif //TWO_PASS_EVENT_DETECTOR
 
-	initializeEventDetector(&ti, xi, dxi, auxi, &odata, opars);
+	initializeEventDetector(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 
 	//update the global ObserverData array
 	OData[i] = odata;
 
 	//dt only evolves for TWO_PASS_EVENT_DETECTOR, in which case we want to restart. Don't save dt.
 }
+
+//transient with the observer initialization fused in (CLODEfeatures::setTransientWarmup): two-pass observers warm up on the
+//transient, and at its end the observer is initialized at the end state, for a features run that continues from xf (shiftX0)
+//over the same tspan. Saves the separate warmup integration of initializeObserver. Same arguments as transient.cl, plus the
+//observer data and the whole run's tspan: chunks of one run carry the warmup data, and the last one initializes the observer
+__kernel void transientObserver(
+	__constant realtype *tspan,			//time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
+	__global realtype *x0,				//initial state 				[nPts*nVar]
+	PARS_PTR pars,					//parameter values				[nPts*nPar]
+	__constant struct SolverParams *sp, //dtmin/max, tols, etc
+	__global realtype *xf,				//final state 				[nPts*nVar]
+	__global ulong *RNGstate,			//state for RNG					[nPts*nRNGstate]
+    __global realtype *d_dt,            //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realtype *tNow,            //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+	__global ObserverData *OData,
+	__constant struct ObserverParams *opars,
+	__constant realtype *tspanFull)		//time vector [t0,tf] of the whole run
+{
+	int i = get_global_id(0);
+	int nPts = get_global_size(0);
+
+	realtype ti, dt;
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR + STEPPER_HISTORY_SIZE], auxi[N_AUX], wi[N_WIENER];
+	rngData rd;
+
+	//get private copy of ODE parameters, initial data, and compute slope at initial state
+	ti = tNow[i]; //tspan[0], or where the previous chunk of the run stopped
+	dt = d_dt[i]; //sp->dt, or the step size carried over from the previous chunk
+
+	loadPars(p, pars, i, nPts);
+
+	for (int j = 0; j < N_VAR; ++j)
+		xi[j] = x0[j * nPts + i];
+
+	for (int j = 0; j < N_RNGSTATE; ++j)
+		rd.state[j] = RNGstate[j * nPts + i];
+
+	rd.randnUselast = 0;
+
+    for (int j = 0; j < N_WIENER; ++j)
+#ifdef STOCHASTIC_STEPPER
+        wi[j] = randn(&rd) / sqrt(dt);
+#else
+        wi[j] = RCONST(0.0);
+#endif
+	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5)
+	resetStepperHistory(dxi);
+
+	ObserverData odata = OData[i]; //private copy of observer data
+	ObserverCold ocold = getObserverCold(OData, i, nPts);
+
+#ifdef TWO_PASS_EVENT_DETECTOR
+	if (tspan[0] == tspanFull[0])
+		initializeWarmupData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
+#endif
+
+	//time-stepping loop, main time interval
+    int step = stepCount[i];
+    int stepflag = 0;
+	while (ti < tspan[1] && step < sp->max_steps)
+	{
+		++step;
+        stepflag = stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, &rd);
+        // if (stepflag!=0)
+        //     break;
+
+#ifdef TWO_PASS_EVENT_DETECTOR
+		warmupObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
+#endif
+	}
+
+	//the features run starts at tspanFull[0] from this state. Initialization keeps the warmup data, so thresholds come from it
+	if (tspan[1] == tspanFull[1])
+	{
+		realtype t0 = tspanFull[0];
+		initializeObserverData(&t0, xi, dxi, auxi, &odata, &ocold, opars);
+		initializeEventDetector(&t0, xi, dxi, auxi, &odata, &ocold, opars);
+	}
+
+	OData[i] = odata;
+
+    //write the final solution values to global memory.
+	for (int j = 0; j < N_VAR; ++j)
+		xf[j * nPts + i] = xi[j];
+
+    // To get same RNG on repeat (non-continued) run, need to set the seed to same value
+	for (int j = 0; j < N_RNGSTATE; ++j)
+		RNGstate[j * nPts + i] = rd.state[j];
+
+    tNow[i] = ti;
+    stepCount[i] = step;
+
+    // update dt to its final value (for adaptive stepper continue)
+    d_dt[i] = dt;
+}
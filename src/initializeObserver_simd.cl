@@ -0,0 +1,92 @@
+
+#include "clODE_random.cl"
+#include "clODE_struct_defs.cl"
+#include "clODE_utilities.cl"
+#include "observers.cl"
+#include "clODE_simd.cl"
+#include "steppers.cl"
+
+// lane-batched initializeObserver (CLODE::setSimdLanes): the trajectories are integrated as vectors, and the observer routines
+// run per lane on scalar copies of the state. Same arguments as initializeObserver.cl
+__kernel void initializeObserver(
+	__constant realscalar *tspan,		//time vector [t0,tf] - adds (tf-t0) to these at the end
+	__global realscalar *x0,			//initial state 				[nPts*nVar]
+	PARS_PTR pars,					//parameter values				[nPts*nPar]
+	__constant struct SolverParams *sp, //dtmin/max, tols, etc
+	__global ulong *RNGstate,			//enables host seeding/continued streams	    [nPts*nRNGstate]
+    __global realscalar *d_dt,          //array of dt values, one per solver
+	__global ObserverData *OData,		//for continue
+	__constant struct ObserverParams *opars)
+{
+	int i = get_global_id(0);
+	int nPts = get_global_size(0) * CLODE_SIMD_LANES;
+
+	realtype ti, dt;
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+	realscalar tl[CLODE_SIMD_LANES], xl[CLODE_SIMD_LANES * N_VAR], dxl[CLODE_SIMD_LANES * N_VAR], auxl[CLODE_SIMD_LANES * N_AUX];
+
+	//get private copy of ODE parameters, initial data, and compute slope at initial state
+	ti = tspan[0];
+	dt = sp->dt;
+
+	loadParsLanes(p, pars, i, nPts);
+	loadVars(xi, x0, N_VAR, i, nPts);
+
+	for (int j = 0; j < N_WIENER; ++j)
+		wi[j] = RCONST(0.0);
+
+	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL
+
+	ObserverData odata[CLODE_SIMD_LANES]; //private copy of observer data, per lane
+	ObserverCold ocold[CLODE_SIMD_LANES];
+	for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+	{
+		odata[k] = OData[i * CLODE_SIMD_LANES + k];
+		ocold[k] = getObserverCold(OData, i * CLODE_SIMD_LANES + k, nPts);
+	}
+
+	VSTORE(ti, 0, tl);
+	splitLanes(xi, N_VAR, xl);
+	splitLanes(dxi, N_VAR, dxl);
+	splitLanes(auxi, N_AUX, auxl);
+	for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+	{
+		initializeObserverData(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars);
+#ifdef TWO_PASS_EVENT_DETECTOR
+		initializeWarmupData(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars);
+#endif
+	}
+
+#ifdef TWO_PASS_EVENT_DETECTOR
+
+	int step = 0;
+	maskvec active = ti < tspan[1];
+	maskscalar activel[CLODE_SIMD_LANES];
+	while (any(active) && step < sp->max_steps)
+	{
+		++step;
+		stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active);
+
+		VSTORE(ti, 0, tl);
+		splitLanes(xi, N_VAR, xl);
+		splitLanes(dxi, N_VAR, dxl);
+		splitLanes(auxi, N_AUX, auxl);
+		splitMask(active, activel);
+		for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+			if (activel[k])
+				warmupObserverData(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars);
+
+		active = ti < tspan[1];
+	}
+
+#endif //TWO_PASS_EVENT_DETECTOR
+
+	//update the global ObserverData array
+	for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+	{
+		initializeEventDetector(&tl[k], xl + k * N_VAR, dxl + k * N_VAR, auxl + k * N_AUX, &odata[k], &ocold[k], opars);
+		OData[i * CLODE_SIMD_LANES + k] = odata[k];
+	}
+
+	//dt only evolves for TWO_PASS_EVENT_DETECTOR, in which case we want to restart. Don't save dt.
+}
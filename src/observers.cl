@@ -11,6 +11,31 @@
  * - eventFunction: check for an event. Optionally refine location of event within timestep. Compute event-based quantities
  * - computeEventFeatures: when event is detected, compute desired per-event features
  * - finalizeFeatures: post-integration cleanup and write to global feature array
+ *
+ * Event location: threshold crossings, extrema and neighborhood entries are placed within the step on the Hermite cubic
+ * through the buffered points (cubicInterpCrossing, cubicInterpExtremum in clODE_utilities.cl), so event-based features
+ * (periods, amplitudes, durations) stay accurate when adaptive steppers take large steps
+ *
+ * Observer state: kernels keep a private copy of the ObserverData struct of their trajectory. With -DOBSERVER_STATE_GLOBAL
+ * (CLODEfeatures::setObserverStateGlobal), observers that list cold fields - trajectory max/min/mean and dt statistics, only
+ * touched by running updates - drop them from the struct and access them with OCOLD(od, oc, field, j) in global memory instead.
+ * There they are stored structure-of-arrays after the nPts structs of the OData buffer: element j at [j*nPts + i], so the
+ * accesses of neighbouring work-items coalesce. The private struct shrinks to the hot fields (solution buffers, event state):
+ *
+ *   observer   private reals, default -> global mode     cold traffic per step (global mode)          features, native (ms)
+ *   basic      5                                         unchanged (no cold fields)                   2940 -> 2981
+ *   localmax   23                                        unchanged (no cold fields)                   3168 -> 3027
+ *   basicall   5*N_VAR + 3*N_AUX -> 0                    read+write of 5*N_VAR + 3*N_AUX reals        3382 -> 4151
+ *   nhood1     12*N_VAR + 15 + 3*N_AUX -> 7*N_VAR + 12   read+write of 5*N_VAR + 3*N_AUX + 3,         3662 -> 5096
+ *                                                        eventFunction reads 2*N_VAR more
+ *   nhood2     12*N_VAR + 16 + 3*N_AUX -> 7*N_VAR + 13   as nhood1                                    6596 -> 8020
+ *   thresh2    11*N_VAR + 34 + 3*N_AUX -> 6*N_VAR + 31   read+write of 5*N_VAR + 3*N_AUX + 3          5699 -> 6687
+ *
+ * The times are for features() on the lactotroph sample (N_VAR=4, N_AUX=1; rk4, 512 points, tspan [0, 1000]) with the native
+ * backend on one CPU thread, where the private struct is on the stack and global mode only adds memory traffic: 1.2-1.4x
+ * slower for the observers with cold fields. Global mode is meant for devices where the private struct spills or limits
+ * occupancy. Its private memory saving (getFeaturesKernelInfo) and speed there are not measured here: compare both modes on
+ * the target device
  */
 
 #include "realtype.cl"
@@ -48,11 +73,39 @@ typedef struct ObserverInfo
 	std::string define;
 	size_t observerDataSizeFloat;
 	size_t observerDataSizeDouble;
+	size_t observerColdReals = 0; //per trajectory: realtype fields moved out of the struct by OBSERVER_STATE_GLOBAL
 	std::vector<std::string> featureNames;
 } ObserverInfo;
 
 #endif
 
+#ifndef __cplusplus
+//handle to the cold observer fields of trajectory i (OBSERVER_STATE_GLOBAL). Passed to every observer function; unused otherwise
+typedef struct ObserverCold
+{
+    __global realtype *data;
+    int i;
+    int nPts;
+} ObserverCold;
+
+#ifdef OBSERVER_STATE_GLOBAL
+#define OCOLD(od, oc, field, j) ((oc)->data[(OCOLD_##field + (j)) * (oc)->nPts + (oc)->i])
+#else
+#define OCOLD(od, oc, field, j) ((od)->field[j])
+#endif
+
+//SoA layout of the cold fields. Shared by the observers that collect trajectory statistics, each using a prefix of it
+#define OCOLD_xTrajectoryMax 0
+#define OCOLD_xTrajectoryMin (N_VAR)
+#define OCOLD_xTrajectoryMean (2 * N_VAR)
+#define OCOLD_dxTrajectoryMax (3 * N_VAR)
+#define OCOLD_dxTrajectoryMin (4 * N_VAR)
+#define OCOLD_auxTrajectoryMax (5 * N_VAR)
+#define OCOLD_auxTrajectoryMin (5 * N_VAR + N_AUX)
+#define OCOLD_auxTrajectoryMean (5 * N_VAR + 2 * N_AUX)
+#define OCOLD_stepDt (5 * N_VAR + 3 * N_AUX)
+#endif
+
 
 ////////////////////////////////////////////////
 // one-pass detectors
@@ -107,6 +160,20 @@ availableObserverNames=newNames;
 }
 #endif
 
+#ifndef __cplusplus
+//the cold region starts after the nPts ObserverData structs, rounded up to a multiple of sizeof(realtype). The host allocates
+//d_odata with the same layout (CLODEfeatures::getObserverDataBytes)
+inline ObserverCold getObserverCold(__global ObserverData *OData, int i, int nPts)
+{
+    ObserverCold oc;
+    size_t offset = ((nPts * sizeof(ObserverData) + sizeof(realtype) - 1) / sizeof(realtype)) * sizeof(realtype);
+    oc.data = (__global realtype *)((__global char *)OData + offset);
+    oc.i = i;
+    oc.nPts = nPts;
+    return oc;
+}
+#endif
+
 
 #endif //OBSERVERS_H_
 
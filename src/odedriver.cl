@@ -1,3 +1,8 @@
+//odedriver: features and trajectory in one integration (CLODEdriver). The observer runs as in features.cl, and every
+//sp.nout'th step is stored as in trajectory.cl. Once max_store points are stored, storage stops but the integration and the
+//observer continue to tspan[1], so F matches features() for the same run
+//Chunked runs (CLODE::setMaxChunkDuration) append to the stored trajectory, and observer times stay absolute between chunks
+
 #include "clODE_random.cl"
 #include "clODE_struct_defs.cl"
 #include "clODE_utilities.cl"
@@ -6,36 +11,37 @@
 #include "steppers.cl"
 
 __kernel void odedriver(
-    __constant realtype *tspan,         //time vector [t0,tf] - adds (tf-t0) to these at the end
+    __constant realtype *tspan,         //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
     __global realtype *x0,              //initial state 				[nPts*nVar]
-    __constant realtype *pars,          //parameter values				[nPts*nPar]
+    PARS_PTR pars,                      //parameter values				[nPts*nPar]
     __constant struct SolverParams *sp, //dtmin/max, tols, etc
     __global realtype *xf,              //final state 				[nPts*nVar]
-    __global ulong *RNGstate,            //state for RNG					[nPts*nRNGstate]
-    __global ObserverData *OData,        //Observer data. Assume it is initialized externally by initialize observer kernel!
+    __global ulong *RNGstate,           //state for RNG				[nPts*nRNGstate]
+    __global realtype *d_dt,            //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realtype *tNow,            //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+    __global ObserverData *OData,       //Observer data. Assume it is initialized externally by initialize observer kernel!
     __constant struct ObserverParams *opars,
-    __global realtype *F,  //feature results
-    __global realtype *t,  // trajectory storage: t, x, dx, aux
-    __global realtype *x,
-    __global realtype *dx,
-    __global realtype *aux,
-    __global int *nStored)
+    __global featurestore *F,           //feature results				[nFeatures*nPts]
+    __global realtype *t,               //stored times				[max_store*nPts]
+    __global trajstore *x,              //stored x components			[max_store*N_STORE_X*nPts]
+    __global trajstore *dx,             //stored dx components			[max_store*N_STORE_DX*nPts]
+    __global trajstore *aux,            //stored aux components			[max_store*N_STORE_AUX*nPts]
+    __global int *nStored,
+    __constant realtype *tspanFull)     //time vector [t0,tf] of the whole run - adds (tf-t0) to observer times at the end
 {
-
     int i = get_global_id(0);
     int nPts = get_global_size(0);
 
     realtype ti, dt;
-    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR + STEPPER_HISTORY_SIZE], auxi[N_AUX], wi[N_WIENER];
     rngData rd;
-    __constant realtype * const tspanPtr = tspan;
 
     //get private copy of ODE parameters, initial data, and compute slope at initial state
-    ti = tspan[0];
-    dt = sp->dt;
+    ti = tNow[i]; //tspan[0], or where the previous chunk of the run stopped
+    dt = d_dt[i]; //sp->dt, or the step size carried over from the previous chunk
 
-    for (int j = 0; j < N_PAR; ++j)
-        p[j] = pars[j * nPts + i];
+    loadPars(p, pars, i, nPts);
 
     for (int j = 0; j < N_VAR; ++j)
         xi[j] = x0[j * nPts + i];
@@ -45,76 +51,76 @@ __kernel void odedriver(
 
     rd.randnUselast = 0;
 
-#ifdef STOCHASTIC_STEPPER
     for (int j = 0; j < N_WIENER; ++j)
+#ifdef STOCHASTIC_STEPPER
         wi[j] = randn(&rd) / sqrt(dt);
+#else
+        wi[j] = RCONST(0.0);
 #endif
-	getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5)
-
-    //store the initial point --> could be set elsewhere using an "init" kernel?
-    int storeix = 0;
-    t[storeix + i] = tspan[0];
-    for (int j = 0; j < N_VAR; ++j)
-        x[storeix * nPts * N_VAR + j * nPts + i] = xi[j];
+    getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5) and for DX output
+    resetStepperHistory(dxi);
 
-    for (int j = 0; j < N_VAR; ++j)
-        dx[storeix * nPts * N_VAR + j * nPts + i] = dxi[j];
-
-    for (int j = 0; j < N_AUX; ++j)
-        aux[storeix * nPts * N_AUX + j * nPts + i] = auxi[j];
+    //store the initial point. Later chunks append after the last point stored by the previous chunk
+    int storeix, lastix = sp->max_store - 1;
+    if (tspan[0] == tspanFull[0])
+    {
+        storeix = 0;
+        t[storeIndex(storeix, 0, 1, i, nPts, sp->max_store)] = ti;
+        storePoint(storeix, xi, dxi, auxi, x, dx, aux, i, nPts, sp->max_store);
+    }
+    else
+    {
+        storeix = nStored[i];
+    }
 
-    ObserverData odata = OData[i]; //private copy of observer data. Assume it is initialized externally by initialize observer kernel
+    ObserverData odata = OData[i]; //private copy of observer data
+    ObserverCold ocold = getObserverCold(OData, i, nPts);
 
     //time-stepping loop, main time interval
-    int step = 0;
+    int step = stepCount[i];
     int stepflag = 0;
     bool eventOccurred;
     bool terminalEvent;
-    while (ti < tspan[1] && step < sp->max_steps && storeix < sp->max_store)
+    while (ti < tspan[1] && step < sp->max_steps)
     {
-
         ++step;
         ++odata.stepcount;
-        stepflag = stepper(&ti, xi, dxi, p, sp, &dt, tspanPtr, auxi, wi, step, &rd);
-        if (stepflag!=0)
-            break;
+        stepflag = stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, &rd);
+        // if (stepflag!=0)
+        //     break;
 
-        eventOccurred = eventFunction(&ti, xi, dxi, auxi, &odata, opars);
+        eventOccurred = eventFunction(&ti, xi, dxi, auxi, &odata, &ocold, opars);
         if (eventOccurred)
         {
-            terminalEvent = computeEventFeatures(&ti, xi, dxi, auxi, &odata, opars);
+            terminalEvent = computeEventFeatures(&ti, xi, dxi, auxi, &odata, &ocold, opars);
             if (terminalEvent)
             {
+                step = sp->max_steps; //later chunks of the run take no steps either
                 break;
             };
         }
 
-        updateObserverData(&ti, xi, dxi, auxi, &odata, opars); //TODO: if not FSAL, dxi buffer is delayed by one. (dxi is slope at LAST timestep)
+        updateObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars);
 
-        //store every sp.nout'th step after the initial point
-        if (step % sp->nout == 0)
+        //store every sp.nout'th step after the initial point, while there is room
+        if (step % sp->nout == 0 && storeix < lastix)
         {
             ++storeix;
-
-            t[storeix * nPts + i] = ti; //adaptive steppers give different timepoints for each trajectory
-
-            for (int j = 0; j < N_VAR; ++j)
-                x[storeix * nPts * N_VAR + j * nPts + i] = xi[j];
-
-            for (int j = 0; j < N_VAR; ++j)
-                dx[storeix * nPts * N_VAR + j * nPts + i] = dxi[j];
-
-            for (int j = 0; j < N_AUX; ++j)
-                aux[storeix * nPts * N_AUX + j * nPts + i] = auxi[j];
+            t[storeIndex(storeix, 0, 1, i, nPts, sp->max_store)] = ti; //adaptive steppers give different timepoints for each trajectory
+            storePoint(storeix, xi, dxi, auxi, x, dx, aux, i, nPts, sp->max_store);
         }
     }
 
     //readout features of interest and write to global F:
-    finalizeFeatures(&ti, xi, dxi, auxi, &odata, opars, F, i, nPts);
+    finalizeFeatures(&ti, xi, dxi, auxi, &odata, &ocold, opars, F, i, nPts);
 
-    //finalize observerdata for possible continuation
-    finalizeObserverData(&ti, xi, dxi, auxi, &odata, opars, tspan);
+    //finalize observerdata for possible continuation. Observer times stay absolute between chunks of one run
+    if (tspan[1] == tspanFull[1])
+        finalizeObserverData(&ti, xi, dxi, auxi, &odata, &ocold, opars, tspanFull);
 
+    OData[i] = odata;
+
+    nStored[i] = storeix; //storeix ranged from 0 to nStored-1
 
     //write the final solution values to global memory.
     for (int j = 0; j < N_VAR; ++j)
@@ -124,7 +130,9 @@ __kernel void odedriver(
     for (int j = 0; j < N_RNGSTATE; ++j)
         RNGstate[j * nPts + i] = rd.state[j];
 
-    OData[i] = odata;
-    
-    nStored[i] = storeix; //storeix ranged from 0 to nStored-1
+    tNow[i] = ti;
+    stepCount[i] = step;
+
+    // update dt to its final value (for adaptive stepper continue)
+    d_dt[i] = dt;
 }
@@ -23,8 +23,17 @@ std::map<std::string, std::string> newMap;
 newMap["euler"]="EXPLICIT_EULER";
 newMap["heun"]="EXPLICIT_HEUN";
 newMap["rk4"]="EXPLICIT_RK4";
+newMap["abm4"]="MULTISTEP_ABM4";
+newMap["rushlarsen"]="EXPONENTIAL_RUSH_LARSEN";
+newMap["rushlarsen2"]="EXPONENTIAL_RUSH_LARSEN2";
 newMap["bs23"]="EXPLICIT_BS23";
 newMap["dopri5"]="EXPLICIT_DOPRI5";
+newMap["rk435"]="RK435_KENNEDY";
+newMap["rk549"]="RK549_KENNEDY";
+newMap["rkf78"]="EXPLICIT_RKF78";
+newMap["vabm4"]="MULTISTEP_VABM4";
+newMap["ros3p"]="ROSENBROCK_ROS3P";
+newMap["rodas3"]="ROSENBROCK_RODAS3";
 newMap["seuler"]="STOCHASTIC_EULER";
 
 //export vector of names for access in C++
@@ -40,7 +49,7 @@ availableStepperNames=newNames;
 
 #include "realtype.cl"
 
-//forward declaration of the RHS function
+//forward declaration of the RHS function. With CLODE_SIMD_LANES, realtype is the vector type here (clODE_simd.cl)
 void getRHS(const realtype t, const realtype x_[], const realtype p_[], realtype dx_[], realtype aux_[], const realtype w_[]);
 
 // FIXED STEPSIZE EXPLICIT METHODS
@@ -66,19 +75,34 @@ void getRHS(const realtype t, const realtype x_[], const realtype p_[], realtype
 #include "steppers/fixed_explicit_RK4.clh"
 #endif
 
+// Rush-Larsen: gating variables marked in the RHS file (getGates) are integrated exactly, the rest explicitly
+#ifdef EXPONENTIAL_RUSH_LARSEN
+#include "steppers/fixed_exponential_RushLarsen.clh"
+#endif
+
+#ifdef EXPONENTIAL_RUSH_LARSEN2
+#include "steppers/fixed_exponential_RushLarsen2.clh"
+#endif
+
 //~ #ifdef RK higher order?
 //~ #endif
 
 //~ #ifdef SSPRK3
 //~ #endif
 
+// FIXED STEP MULTI STEP METHODS
+// The history of past slopes is kept after the current slope in k1 (see multistep_abm_common.clh), with RK4 startup steps
+#ifdef MULTISTEP_ABM4
+#include "steppers/fixed_multistep_ABM4.clh"
+#endif
+
 #ifdef FIXED_STEPSIZE_EXPLICIT
+#ifdef CLODE_SIMD_LANES
+#include "steppers/fixed_explicit_step_simd.clh"
+#else
 #include "steppers/fixed_explicit_step.clh"
 #endif
-
-// TODO: FIXED STEP MULTI STEP METHODS
-// need to fill the first few steps with a single stepper, so if MULTI_STEP is defined also include Euler or RK4 or something
-// #define MULTI_STEP
+#endif
 
 
 // ADAPTIVE STEPSIZE EXPLICIT METHODS
@@ -97,23 +121,68 @@ void getRHS(const realtype t, const realtype x_[], const realtype p_[], realtype
 #include "steppers/adaptive_dp45.clh"
 #endif
 
-//~ #ifdef RKF87
-//~ #endif
+#ifdef EXPLICIT_RKF78
+#include "steppers/adaptive_rkf78.clh"
+#endif
 
-// low-register use adaptive stepsize solvers, from rktides
-//~ #ifdef RK435_KENNEDY
-//~ #endif
+// low-register use adaptive stepsize solvers: 2R low-storage pairs of Kennedy, Carpenter & Lewis (2000)
+#ifdef RK435_KENNEDY
+#include "steppers/adaptive_rk435.clh"
+#endif
 
-//~ #ifdef RK549_KENNEDY
-//~ #endif
+#ifdef RK549_KENNEDY
+#include "steppers/adaptive_rk549.clh"
+#endif
 
-#ifdef ADAPTIVE_STEPSIZE_EXPLICIT
+// variable-step multistep method
+#ifdef MULTISTEP_VABM4
+#include "steppers/adaptive_abm4.clh"
+#endif
+
+// ADAPTIVE STEPSIZE LINEARLY IMPLICIT (ROSENBROCK) METHODS, for stiff problems. They reuse the explicit stepsize control
+#ifdef ROSENBROCK_ROS3P
+#include "steppers/adaptive_ros3p.clh"
+#endif
+
+#ifdef ROSENBROCK_RODAS3
+#include "steppers/adaptive_rodas3.clh"
+#endif
+
+//extra elements of the kernels' slope array (k1, dxi) that hold the history of multistep steppers. Steppers that use it
+//define it before this point, and provide resetStepperHistory, which the kernels call after the slope at their initial point
+#ifndef STEPPER_HISTORY_SIZE
+#define STEPPER_HISTORY_SIZE 0
+inline void resetStepperHistory(realtype k1[]) {} //no history
+#endif
+
+#if defined(ADAPTIVE_STEPSIZE_EXPLICIT) || defined(ADAPTIVE_STEPSIZE_ROSENBROCK)
+#ifdef CLODE_SIMD_LANES
+#include "steppers/adaptive_explicit_step_simd.clh"
+#else
 #include "steppers/adaptive_explicit_step.clh"
 #endif
+#endif
+
 
 
+//TODO: fully implicit fixed/adaptive steppers
 
-//TODO: implicit fixed/adaptive steppers
+
+//continuous extension of the last step, from (t0, x0, f0) to (t0+h, x1, f1), at t0+theta*h (Hairer & Wanner's form):
+//the cubic Hermite interpolant, plus the quartic term dense[] of steppers with their own dense output (stepperDense).
+//Pass dense[] = 0 for the plain Hermite cubic
+inline void denseOutput(realtype theta, realtype h, const realtype x0[], const realtype f0[], const realtype x1[],
+                        const realtype f1[], const realtype dense[], realtype xOut[])
+{
+    realtype theta1 = RCONST(1.0) - theta;
+    for (int j = 0; j < N_VAR; j++)
+    {
+        realtype dx = x1[j] - x0[j];
+        realtype c3 = h * f0[j] - dx;
+        realtype c4 = dx - h * f1[j] - c3;
+        xOut[j] = x0[j] + theta * (dx + theta1 * (c3 + theta * (c4 + theta1 * dense[j])));
+    }
+}
 
 
 
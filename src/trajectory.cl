@@ -1,8 +1,11 @@
 //trajectory: stores in global variables directly
 
-//TODO: optionally store only a subset of variables (allow bigger nPts): sp.varIx vector of indices? already in observerpars...???
-//TODO: alternate storage at specified time points only - host sets t vector, interp and store x/dx/aux whenever ti passes t[nextstoreix]
-//TODO: support dense output (refine option) for solvers like Dopri45 (or all if we force FSAL; use interpolant of same order as solver)
+//Store-at-times mode (-DTRAJ_STORE_AT_TIMES, CLODEtrajectory::setStoreTimes): t is an input, the output times shared by all
+//trajectories [max_store], ascending. Each step is interpolated at the output times it passes (denseOutput in steppers.cl),
+//so steps are not limited by the output spacing. nStored is the index of the last output time reached, as in the default mode
+//Streaming mode (-DTRAJ_STREAM, CLODEtrajectory::setStreaming): point storeix goes to slot storeix % max_store, a ring that the
+//host drains after every launch. nStored counts across launches (-1 before the first), and a trajectory stops early when it
+//has filled its ring in this launch. tNow holds where each trajectory stopped, and the host relaunches the chunk to continue it
 //TODO: is there any way to avoid writing to global at each store step? shared mem?
 
 #include "clODE_random.cl"
@@ -12,32 +15,35 @@
 #include "steppers.cl"
 
 __kernel void trajectory(
-    __constant realtype *tspan,         //time vector [t0,tf] - adds (tf-t0) to these at the end
+    __constant realtype *tspan,         //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
     __global realtype *x0,              //initial state 				[nPts*nVar]
-    __constant realtype *pars,          //parameter values				[nPts*nPar]
+    PARS_PTR pars,                      //parameter values				[nPts*nPar]
     __constant struct SolverParams *sp, //dtmin/max, tols, etc
     __global realtype *xf,              //final state 				[nPts*nVar]
     __global ulong *RNGstate,           //state for RNG				[nPts*nRNGstate]
     __global realtype *d_dt,            //array of dt values, one per solver
-    __global realtype *t,               //
-    __global realtype *x,               //
-    __global realtype *dx,              //
-    __global realtype *aux,             //
-    __global int *nStored)
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realtype *tNow,            //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+    __global realtype *t,               //stored times, or the output times in store-at-times mode
+    __global trajstore *x,              //stored x components			[max_store*N_STORE_X*nPts]
+    __global trajstore *dx,             //stored dx components			[max_store*N_STORE_DX*nPts]
+    __global trajstore *aux,            //stored aux components			[max_store*N_STORE_AUX*nPts]
+    __global int *nStored,
+    __constant realtype *tspanFull      //time vector [t0,tf] of the whole run. Same as tspan when not chunked
+    )
 {
     int i = get_global_id(0);
     int nPts = get_global_size(0);
 
     realtype ti, dt;
-    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR + STEPPER_HISTORY_SIZE], auxi[N_AUX], wi[N_WIENER];
     rngData rd;
 
     //get private copy of ODE parameters, initial data, and compute slope at initial state
-    ti = tspan[0];
-    dt = sp->dt;
+    ti = tNow[i]; //tspan[0], or where the previous launch stopped this trajectory
+    dt = d_dt[i]; //sp->dt, or the step size carried over from the previous chunk
 
-    for (int j = 0; j < N_PAR; ++j)
-        p[j] = pars[j * nPts + i];
+    loadPars(p, pars, i, nPts);
 
     for (int j = 0; j < N_VAR; ++j)
         xi[j] = x0[j * nPts + i];
@@ -54,24 +60,80 @@ __kernel void trajectory(
         wi[j] = RCONST(0.0);
 #endif
     getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5) and for DX output
+    resetStepperHistory(dxi);
 
-    //store the initial point
+#ifdef TRAJ_STORE_AT_TIMES
+    //continue at the first output time not reached by the previous chunk. Output times at the initial point are stored as is
+    int nextOut = tspan[0] == tspanFull[0] ? 0 : nStored[i] + 1;
+    while (nextOut < sp->max_store && t[nextOut] <= ti)
+        storePoint(nextOut++, xi, dxi, auxi, x, dx, aux, i, nPts, sp->max_store);
 
-    int storeix = 0;
-    t[storeix * nPts + i] = ti;
+    //time-stepping loop, main time interval
+    int step = stepCount[i];
+    int stepflag = 0;
+    realtype tOld, xOld[N_VAR], dxOld[N_VAR], dense[N_VAR], xs[N_VAR], dxs[N_VAR], auxs[N_AUX];
     for (int j = 0; j < N_VAR; ++j)
-        x[storeix * nPts * N_VAR + j * nPts + i] = xi[j];
+        dense[j] = RCONST(0.0); //Hermite cubic, unless the stepper has its own dense output
+    while (ti < tspan[1] && step < sp->max_steps && nextOut < sp->max_store)
+    {
+        ++step;
+        tOld = ti;
+        for (int j = 0; j < N_VAR; ++j)
+        {
+            xOld[j] = xi[j];
+            dxOld[j] = dxi[j];
+        }
+#ifdef STEP_TO_OUTPUT_PROPERTY
+        //shorten the step to end at the next output time. If it gets there, the proposal it replaced is kept for the next step
+        realtype dtProposal = dt;
+        bool toOutput = t[nextOut] - ti < dt;
+        dt = toOutput ? t[nextOut] - ti : dt;
+#endif
+#ifdef DENSE_OUTPUT_PROPERTY
+        stepflag = stepperDense(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, &rd, dense);
+#else
+        stepflag = stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, &rd);
+#endif
+#ifdef STEP_TO_OUTPUT_PROPERTY
+        dt = toOutput && t[nextOut] <= ti ? fmax(dt, dtProposal) : dt;
+#endif
 
-    for (int j = 0; j < N_VAR; ++j)
-        dx[storeix * nPts * N_VAR + j * nPts + i] = dxi[j];
+        //interpolate at the output times passed by this step
+        while (nextOut < sp->max_store && t[nextOut] <= ti)
+        {
+            realtype h = ti - tOld;
+            denseOutput((t[nextOut] - tOld) / h, h, xOld, dxOld, xi, dxi, dense, xs);
+#if N_STORE_DX > 0 || N_STORE_AUX > 0
+            getRHS(t[nextOut], xs, p, dxs, auxs, wi); //dx and aux at the interpolated state
+#endif
+            storePoint(nextOut++, xs, dxs, auxs, x, dx, aux, i, nPts, sp->max_store);
+        }
+    }
 
-    for (int j = 0; j < N_AUX; ++j)
-        aux[storeix * nPts * N_AUX + j * nPts + i] = auxi[j];
+    nStored[i] = nextOut - 1; //-1 if no output time was reached
+#else
+    //store the initial point. Later chunks append after the last point stored by the previous chunk
+    int storeix, lastix = sp->max_store - 1;
+#ifdef TRAJ_STREAM
+    lastix = nStored[i] + sp->max_store; //the ring was drained: room for max_store points
+    if (nStored[i] < 0)
+#else
+    if (tspan[0] == tspanFull[0])
+#endif
+    {
+        storeix = 0;
+        t[storeIndex(storeix, 0, 1, i, nPts, sp->max_store)] = ti;
+        storePoint(storeix, xi, dxi, auxi, x, dx, aux, i, nPts, sp->max_store);
+    }
+    else
+    {
+        storeix = nStored[i];
+    }
 
     //time-stepping loop, main time interval
-    int step = 0;
+    int step = stepCount[i];
     int stepflag = 0;
-    while (ti < tspan[1] && step < sp->max_steps && storeix < sp->max_store)
+    while (ti < tspan[1] && step < sp->max_steps && storeix < lastix)
     {
         ++step;
         stepflag = stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, &rd);
@@ -82,21 +144,13 @@ __kernel void trajectory(
         if (step % sp->nout == 0)
         {
             ++storeix;
-
-            t[storeix * nPts + i] = ti; //adaptive steppers give different timepoints for each trajectory
-
-            for (int j = 0; j < N_VAR; ++j)
-                x[storeix * nPts * N_VAR + j * nPts + i] = xi[j];
-
-            for (int j = 0; j < N_VAR; ++j)
-                dx[storeix * nPts * N_VAR + j * nPts + i] = dxi[j];
-
-            for (int j = 0; j < N_AUX; ++j)
-                aux[storeix * nPts * N_AUX + j * nPts + i] = auxi[j];
+            t[storeIndex(storeix, 0, 1, i, nPts, sp->max_store)] = ti; //adaptive steppers give different timepoints for each trajectory
+            storePoint(storeix, xi, dxi, auxi, x, dx, aux, i, nPts, sp->max_store);
         }
     }
 
     nStored[i] = storeix; //storeix ranged from 0 to nStored-1
+#endif
 
     //write the final solution values to global memory.
     for (int j = 0; j < N_VAR; ++j)
@@ -106,6 +160,9 @@ __kernel void trajectory(
     for (int j = 0; j < N_RNGSTATE; ++j)
         RNGstate[j * nPts + i] = rd.state[j];
 
+    tNow[i] = ti;
+    stepCount[i] = step;
+
     // update dt to its final value (for adaptive stepper continue)
-    // d_dt[i] = dt;
+    d_dt[i] = dt;
 }
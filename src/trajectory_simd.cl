@@ -0,0 +1,213 @@
+//lane-batched trajectory (CLODE::setSimdLanes): work-item i integrates points i*CLODE_SIMD_LANES + [0, CLODE_SIMD_LANES).
+//Same arguments, output layout and modes as trajectory.cl. Stores are per lane: continued chunks may start at a different
+//nStored in each lane, and in store-at-times mode a step may pass a different number of output times in each lane
+
+#include "clODE_random.cl"
+#include "clODE_struct_defs.cl"
+#include "clODE_utilities.cl"
+#include "clODE_simd.cl"
+#include "steppers.cl"
+
+//write the stored point of each lane in store to its next slot
+inline void storeLanes(maskscalar store[], int storeix[], realtype ti, realtype xi[], realtype dxi[], realtype auxi[],
+                       __global realscalar *t, __global trajstore *x, __global trajstore *dx, __global trajstore *aux, int i, int nPts, int maxStore)
+{
+    realscalar tl[CLODE_SIMD_LANES], xl[CLODE_SIMD_LANES * N_VAR], dxl[CLODE_SIMD_LANES * N_VAR], auxl[CLODE_SIMD_LANES * N_AUX];
+    VSTORE(ti, 0, tl);
+    splitLanes(xi, N_VAR, xl);
+    splitLanes(dxi, N_VAR, dxl);
+    splitLanes(auxi, N_AUX, auxl);
+
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+    {
+        if (!store[k])
+            continue;
+
+        int ik = i * CLODE_SIMD_LANES + k;
+#ifndef TRAJ_STORE_AT_TIMES
+        t[storeIndex(storeix[k], 0, 1, ik, nPts, maxStore)] = tl[k];
+#endif
+
+        for (int j = 0; j < N_STORE_X; ++j)
+            STORE_TRAJ(x, storeIndex(storeix[k], j, N_STORE_X, ik, nPts, maxStore), xl[k * N_VAR + STORE_X(j)], trajQ16X, STORE_X(j));
+
+        for (int j = 0; j < N_STORE_DX; ++j)
+            STORE_TRAJ(dx, storeIndex(storeix[k], j, N_STORE_DX, ik, nPts, maxStore), dxl[k * N_VAR + STORE_DX(j)], trajQ16Dx, STORE_DX(j));
+
+        for (int j = 0; j < N_STORE_AUX; ++j)
+            STORE_TRAJ(aux, storeIndex(storeix[k], j, N_STORE_AUX, ik, nPts, maxStore), auxl[k * N_AUX + STORE_AUX(j)], trajQ16Aux, STORE_AUX(j));
+    }
+}
+
+__kernel void trajectory(
+    __constant realscalar *tspan,       //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
+    __global realscalar *x0,            //initial state 				[nPts*nVar]
+    PARS_PTR pars,                      //parameter values				[nPts*nPar]
+    __constant struct SolverParams *sp, //dtmin/max, tols, etc
+    __global realscalar *xf,            //final state 				[nPts*nVar]
+    __global ulong *RNGstate,           //state for RNG				[nPts*nRNGstate]
+    __global realscalar *d_dt,          //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realscalar *tNow,          //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+    __global realscalar *t,             //stored times, or the output times in store-at-times mode
+    __global trajstore *x,              //
+    __global trajstore *dx,             //
+    __global trajstore *aux,            //
+    __global int *nStored,
+    __constant realscalar *tspanFull    //time vector [t0,tf] of the whole run. Same as tspan when not chunked
+    )
+{
+    int i = get_global_id(0);
+    int nPts = get_global_size(0) * CLODE_SIMD_LANES;
+
+    realtype ti, dt;
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+
+    //get private copy of ODE parameters, initial data, and compute slope at initial state
+    ti = VLOAD(i, tNow); //tspan[0], or where the previous launch stopped the lane
+    dt = VLOAD(i, d_dt); //sp->dt, or the step size carried over from the previous chunk
+
+    loadParsLanes(p, pars, i, nPts);
+    loadVars(xi, x0, N_VAR, i, nPts);
+
+    for (int j = 0; j < N_WIENER; ++j)
+        wi[j] = RCONST(0.0);
+
+    getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5) and for DX output
+
+#ifdef TRAJ_STORE_AT_TIMES
+    //continue at the first output time not reached by the previous chunk. Output times at the initial point are stored as is
+    int nextOut[CLODE_SIMD_LANES];
+    maskscalar store[CLODE_SIMD_LANES], room[CLODE_SIMD_LANES];
+    realscalar tl[CLODE_SIMD_LANES], tOutl[CLODE_SIMD_LANES];
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+        nextOut[k] = tspan[0] == tspanFull[0] ? 0 : nStored[i * CLODE_SIMD_LANES + k] + 1;
+
+    int step = stepCount[i * CLODE_SIMD_LANES]; //shared by the lanes
+    realtype tOld, xOld[N_VAR], dxOld[N_VAR], dense[N_VAR], xs[N_VAR], dxs[N_VAR], auxs[N_AUX];
+    for (int j = 0; j < N_VAR; ++j)
+    {
+        xOld[j] = xi[j]; //a zero-length step at the initial point: interpolation returns xi
+        dxOld[j] = dxi[j];
+        dense[j] = RCONST(0.0); //Hermite cubic, unless the stepper has its own dense output
+    }
+    tOld = ti;
+
+    //time-stepping loop, main time interval. Lanes that reach tspan[1] or their last output time are masked out until all are done
+    maskvec active = (maskvec)(-1);
+    while (true)
+    {
+        //interpolate each lane at the output times passed by its last step (at the first pass: those at the initial point)
+        VSTORE(ti, 0, tl);
+        while (true)
+        {
+            for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+            {
+                store[k] = nextOut[k] < sp->max_store && t[nextOut[k]] <= tl[k] ? -1 : 0;
+                tOutl[k] = store[k] ? t[nextOut[k]] : tl[k];
+            }
+            if (!any(joinMask(store)))
+                break;
+
+            realtype tOut = VLOAD(0, tOutl);
+            realtype h = ti - tOld;
+            denseOutput(select((realtype)(RCONST(1.0)), (tOut - tOld) / h, h > RCONST(0.0)), h, xOld, dxOld, xi, dxi, dense, xs);
+#if N_STORE_DX > 0 || N_STORE_AUX > 0
+            getRHS(tOut, xs, p, dxs, auxs, wi); //dx and aux at the interpolated state
+#endif
+            storeLanes(store, nextOut, tOut, xs, dxs, auxs, t, x, dx, aux, i, nPts, sp->max_store);
+            for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+                nextOut[k] += store[k] ? 1 : 0;
+        }
+
+        for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+            room[k] = nextOut[k] < sp->max_store ? -1 : 0;
+        active = (ti < tspan[1]) & joinMask(room);
+        if (!any(active) || step >= sp->max_steps)
+            break;
+
+        ++step;
+        tOld = ti;
+        for (int j = 0; j < N_VAR; ++j)
+        {
+            xOld[j] = xi[j];
+            dxOld[j] = dxi[j];
+        }
+#ifdef STEP_TO_OUTPUT_PROPERTY
+        //shorten each lane's step to end at its next output time, as in trajectory.cl
+        for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+            tOutl[k] = nextOut[k] < sp->max_store ? t[nextOut[k]] : tspan[1];
+        realtype tNext = VLOAD(0, tOutl), dtProposal = dt;
+        maskvec toOutput = active & (tNext - ti < dt);
+        dt = select(dt, tNext - ti, toOutput);
+#endif
+#ifdef DENSE_OUTPUT_PROPERTY
+        stepperDense(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active, dense);
+#else
+        stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active);
+#endif
+#ifdef STEP_TO_OUTPUT_PROPERTY
+        dt = select(dt, fmax(dt, dtProposal), toOutput & (tNext <= ti));
+#endif
+    }
+
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+        nStored[i * CLODE_SIMD_LANES + k] = nextOut[k] - 1; //-1 if no output time was reached
+#else
+    //store the initial point. Later chunks append after the last point stored by the previous chunk
+    int storeix[CLODE_SIMD_LANES], lastix[CLODE_SIMD_LANES];
+    maskscalar store[CLODE_SIMD_LANES], room[CLODE_SIMD_LANES];
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+    {
+#ifdef TRAJ_STREAM
+        storeix[k] = nStored[i * CLODE_SIMD_LANES + k];
+        lastix[k] = storeix[k] + sp->max_store; //the ring was drained: room for max_store points
+        store[k] = storeix[k] < 0 ? -1 : 0;
+        storeix[k] = store[k] ? 0 : storeix[k];
+#else
+        storeix[k] = tspan[0] == tspanFull[0] ? 0 : nStored[i * CLODE_SIMD_LANES + k];
+        lastix[k] = sp->max_store - 1;
+        store[k] = tspan[0] == tspanFull[0] ? -1 : 0;
+#endif
+    }
+    storeLanes(store, storeix, ti, xi, dxi, auxi, t, x, dx, aux, i, nPts, sp->max_store);
+
+    //time-stepping loop, main time interval. Lanes that reach tspan[1] or fill their storage are masked out until all are done
+    int step = stepCount[i * CLODE_SIMD_LANES]; //shared by the lanes
+    maskvec active;
+    while (true)
+    {
+        for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+            room[k] = storeix[k] < lastix[k] ? -1 : 0;
+        active = (ti < tspan[1]) & joinMask(room);
+        if (!any(active) || step >= sp->max_steps)
+            break;
+
+        ++step;
+        stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active);
+
+        //store every sp.nout'th step after the initial point
+        if (step % sp->nout == 0)
+        {
+            splitMask(active, store);
+            for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+                storeix[k] += store[k] ? 1 : 0;
+
+            storeLanes(store, storeix, ti, xi, dxi, auxi, t, x, dx, aux, i, nPts, sp->max_store);
+        }
+    }
+
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+        nStored[i * CLODE_SIMD_LANES + k] = storeix[k]; //storeix ranged from 0 to nStored-1
+#endif
+
+    //write the final solution values to global memory.
+    storeVars(xi, xf, N_VAR, i, nPts);
+    VSTORE(ti, i, tNow);
+
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+        stepCount[i * CLODE_SIMD_LANES + k] = step;
+
+    // update dt to its final value (for adaptive stepper continue)
+    VSTORE(dt, i, d_dt);
+}
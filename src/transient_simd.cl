@@ -0,0 +1,58 @@
+#include "clODE_random.cl"
+#include "clODE_struct_defs.cl"
+#include "clODE_utilities.cl"
+#include "clODE_simd.cl"
+#include "steppers.cl"
+
+// lane-batched transient (CLODE::setSimdLanes): work-item i integrates points i*CLODE_SIMD_LANES + [0, CLODE_SIMD_LANES).
+// Same arguments as transient.cl. No RNG: stochastic steppers are not supported in lane-batched kernels
+__kernel void transient(
+    __constant realscalar *tspan,       //time vector [t0,tf] of this launch (one chunk of the run, in chunked mode)
+    __global realscalar *x0,            //initial state 				[nPts*nVar]
+    PARS_PTR pars,                      //parameter values				[nPts*nPar]
+    __constant struct SolverParams *sp, //dtmin/max, tols, etc
+    __global realscalar *xf,            //final state 				[nPts*nVar]
+    __global ulong *RNGstate,           //state for RNG					[nPts*nRNGstate]
+    __global realscalar *d_dt,          //array of dt values, one per solver
+    __global int *stepCount,            //steps taken so far in the run [nPts]: max_steps applies across chunks
+    __global realscalar *tNow           //time reached so far in the run [nPts]: fixed steps can end past a chunk's edge
+)
+{
+    int i = get_global_id(0);
+    int nPts = get_global_size(0) * CLODE_SIMD_LANES;
+
+    realtype ti, dt;
+    realtype p[N_PAR], xi[N_VAR], dxi[N_VAR], auxi[N_AUX], wi[N_WIENER];
+
+    //get private copy of ODE parameters, initial data, and compute slope at initial state
+    ti = VLOAD(i, tNow); //tspan[0], or where the previous chunk of the run stopped
+    dt = VLOAD(i, d_dt); //sp->dt, or the step size carried over from the previous chunk
+
+    loadParsLanes(p, pars, i, nPts);
+    loadVars(xi, x0, N_VAR, i, nPts);
+
+    for (int j = 0; j < N_WIENER; ++j)
+        wi[j] = RCONST(0.0);
+
+    getRHS(ti, xi, p, dxi, auxi, wi); //slope at initial point, needed for FSAL steppers (bs23, dorpri5)
+
+    //time-stepping loop, main time interval. Lanes that reach tspan[1] are masked out until all are done
+    int step = stepCount[i * CLODE_SIMD_LANES]; //shared by the lanes
+    maskvec active = ti < tspan[1];
+    while (any(active) && step < sp->max_steps)
+    {
+        ++step;
+        stepper(&ti, xi, dxi, p, sp, &dt, tspan, auxi, wi, active);
+        active = ti < tspan[1];
+    }
+
+    //write the final solution values to global memory.
+    storeVars(xi, xf, N_VAR, i, nPts);
+    VSTORE(ti, i, tNow);
+
+    for (int k = 0; k < CLODE_SIMD_LANES; ++k)
+        stepCount[i * CLODE_SIMD_LANES + k] = step;
+
+    // update dt to its final value (for adaptive stepper continue)
+    VSTORE(dt, i, d_dt);
+}